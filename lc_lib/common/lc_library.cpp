@@ -31,7 +31,11 @@
 #define LC_LIBRARY_CACHE_VERSION   0x0104
 #define LC_LIBRARY_CACHE_ARCHIVE   0x0001
 #define LC_LIBRARY_CACHE_DIRECTORY 0x0002
+#define LC_LIBRARY_CACHE_PACK_ID   LC_FOURCC('L', 'C', 'M', 'P')
+#define LC_LIBRARY_CACHE_PACK_VERSION 0x0002
+#define LC_LIBRARY_CACHE_PACK_SLACK (16 * 1024 * 1024)
 #define LC_LIBRARY_PART_TYPE       1
+#define LC_LIBRARY_SUBFILE_CACHE_SIZE (64 * 1024 * 1024)
 
 lcPiecesLibrary::lcPiecesLibrary()
 {
@@ -57,6 +61,17 @@ lcPiecesLibrary::lcPiecesLibrary()
 	mZipFiles[LC_ZIPFILE_OFFICIAL] = NULL;
 	mZipFiles[LC_ZIPFILE_UNOFFICIAL] = NULL;
 	mBuffersDirty = false;
+
+	mSubFileCache.setMaxCost(LC_LIBRARY_SUBFILE_CACHE_SIZE);
+	mSubFileCacheHits = 0;
+	mSubFileCacheMisses = 0;
+	mPiecesDecoded = 0;
+	mPieceDecodeTime = 0;
+
+	mCachePack = NULL;
+	mCachePackData = NULL;
+	mCachePackMappedSize = 0;
+	mCachePackDeadSize = 0;
 }
 
 lcPiecesLibrary::~lcPiecesLibrary()
@@ -78,11 +93,19 @@ void lcPiecesLibrary::Unload()
 		delete mTextures[TextureIdx];
 	mTextures.RemoveAll();
 
+	mPieceIndex.clear();
+	mPrimitiveIndex.clear();
+	mTextureIndex.clear();
+
+	ClearSubFileCache();
+
 	mNumOfficialPieces = 0;
 	delete mZipFiles[LC_ZIPFILE_OFFICIAL];
 	mZipFiles[LC_ZIPFILE_OFFICIAL] = NULL;
 	delete mZipFiles[LC_ZIPFILE_UNOFFICIAL];
 	mZipFiles[LC_ZIPFILE_UNOFFICIAL] = NULL;
+
+	CloseCachePack();
 }
 
 void lcPiecesLibrary::RemoveTemporaryPieces()
@@ -97,6 +120,7 @@ void lcPiecesLibrary::RemoveTemporaryPieces()
 		if (!Info->IsLoaded())
 		{
 			mPieces.RemoveIndex(PieceIdx);
+			mPieceIndex.remove(QByteArray(Info->m_strName), Info);
 			delete Info;
 		}
 	}
@@ -105,17 +129,51 @@ void lcPiecesLibrary::RemoveTemporaryPieces()
 void lcPiecesLibrary::RemovePiece(PieceInfo* Info)
 {
 	mPieces.Remove(Info);
+	mPieceIndex.remove(QByteArray(Info->m_strName), Info);
 	delete Info;
 }
 
+void lcPiecesLibrary::RenamePiece(PieceInfo* Info, const char* OldName)
+{
+	if (mPieceIndex.remove(QByteArray(OldName), Info))
+		mPieceIndex.insert(QByteArray(Info->m_strName), Info);
+}
+
+void lcPiecesLibrary::AddPiece(PieceInfo* Info)
+{
+	mPieces.Add(Info);
+	mPieceIndex.insert(QByteArray(Info->m_strName), Info);
+}
+
+void lcPiecesLibrary::AddPrimitive(lcLibraryPrimitive* Primitive)
+{
+	QByteArray Name(Primitive->mName);
+
+	// The first primitive with a name wins, as it did for the linear search.
+	if (!mPrimitiveIndex.contains(Name))
+		mPrimitiveIndex.insert(Name, mPrimitives.GetSize());
+
+	mPrimitives.Add(Primitive);
+}
+
+void lcPiecesLibrary::AddTexture(lcTexture* Texture)
+{
+	QByteArray Name(Texture->mName);
+
+	if (!mTextureIndex.contains(Name))
+		mTextureIndex.insert(Name, Texture);
+
+	mTextures.Add(Texture);
+}
+
 PieceInfo* lcPiecesLibrary::FindPiece(const char* PieceName, Project* Project, bool CreatePlaceholder)
 {
-	for (int PieceIdx = 0; PieceIdx < mPieces.GetSize(); PieceIdx++)
-	{
-		PieceInfo* Info = mPieces[PieceIdx];
+	// values() lists the most recently inserted first, walk it backwards to keep mPieces order.
+	const QList<PieceInfo*> Candidates = mPieceIndex.values(QByteArray::fromRawData(PieceName, (int)strlen(PieceName)));
 
-		if (strcmp(PieceName, Info->m_strName))
-			continue;
+	for (int CandidateIdx = Candidates.size() - 1; CandidateIdx >= 0; CandidateIdx--)
+	{
+		PieceInfo* Info = Candidates[CandidateIdx];
 
 		if (Project && Info->IsModel() && Project->GetModels().FindIndex(Info->GetModel()) == -1)
 			continue;
@@ -128,7 +186,7 @@ PieceInfo* lcPiecesLibrary::FindPiece(const char* PieceName, Project* Project, b
 		PieceInfo* Info = new PieceInfo();
 
 		Info->CreatePlaceholder(PieceName);
-		mPieces.Add(Info);
+		AddPiece(Info);
 
 		return Info;
 	}
@@ -138,15 +196,14 @@ PieceInfo* lcPiecesLibrary::FindPiece(const char* PieceName, Project* Project, b
 
 lcTexture* lcPiecesLibrary::FindTexture(const char* TextureName)
 {
-	for (int TextureIdx = 0; TextureIdx < mTextures.GetSize(); TextureIdx++)
-		if (!strcmp(TextureName, mTextures[TextureIdx]->mName))
-			return mTextures[TextureIdx];
-
-	return NULL;
+	return mTextureIndex.value(QByteArray::fromRawData(TextureName, (int)strlen(TextureName)), NULL);
 }
 
 bool lcPiecesLibrary::Load(const char* LibraryPath)
 {
+	QElapsedTimer Timer;
+	Timer.start();
+
 	Unload();
 
 	if (OpenArchive(LibraryPath, LC_ZIPFILE_OFFICIAL))
@@ -194,6 +251,9 @@ bool lcPiecesLibrary::Load(const char* LibraryPath)
 
 	lcLoadDefaultCategories();
 
+	logStatus() << "Library load took" << Timer.elapsed() << "milliseconds for"
+	            << mPieces.GetSize() << "pieces and" << mPrimitives.GetSize() << "primitives.";
+
 	return true;
 }
 
@@ -207,6 +267,8 @@ bool lcPiecesLibrary::OpenArchive(const char* FileName, lcZipFileType ZipFileTyp
 		return false;
 	}
 
+	mZipFiles[ZipFileType]->MapFile(FileName);
+
 	return true;
 }
 
@@ -258,12 +320,13 @@ bool lcPiecesLibrary::OpenArchive(lcFile* File, const char* FileName, lcZipFileT
 			if (!memcmp(Dst, ".PNG", 4) && !memcmp(Name, "LDRAW/PARTS/TEXTURES/", 21))
 			{
 				lcTexture* Texture = new lcTexture();
-				mTextures.Add(Texture);
 
 				*Dst = 0;
 				strncpy(Texture->mName, Name + 21, sizeof(Texture->mName));
 				Texture->mName[sizeof(Texture->mName) - 1] = 0;
 
+				AddTexture(Texture);
+
 			}
 
 			continue;
@@ -289,12 +352,13 @@ bool lcPiecesLibrary::OpenArchive(lcFile* File, const char* FileName, lcZipFileT
 				if (!Info)
 				{
 					Info = new PieceInfo();
-					mPieces.Add(Info);
 
 					strncpy(Info->m_strName, Name, sizeof(Info->m_strName));
 					Info->m_strName[sizeof(Info->m_strName) - 1] = 0;
 					Info->m_iPartType = LC_LIBRARY_PART_TYPE;
 
+					AddPiece(Info);
+
 				}
 
 				Info->SetZipFile(ZipFileType, FileIdx);
@@ -304,7 +368,7 @@ bool lcPiecesLibrary::OpenArchive(lcFile* File, const char* FileName, lcZipFileT
 				int PrimitiveIndex = FindPrimitiveIndex(Name);
 
 				if (PrimitiveIndex == -1)
-					mPrimitives.Add(new lcLibraryPrimitive(Name, ZipFileType, FileIdx, false, true));
+					AddPrimitive(new lcLibraryPrimitive(Name, ZipFileType, FileIdx, false, true));
 				else
 					mPrimitives[PrimitiveIndex]->SetZipFile(ZipFileType, FileIdx);
 			}
@@ -316,7 +380,7 @@ bool lcPiecesLibrary::OpenArchive(lcFile* File, const char* FileName, lcZipFileT
 			int PrimitiveIndex = FindPrimitiveIndex(Name);
 
 			if (PrimitiveIndex == -1)
-				mPrimitives.Add(new lcLibraryPrimitive(Name, ZipFileType, FileIdx, (memcmp(Name, "STU", 3) == 0), false));
+				AddPrimitive(new lcLibraryPrimitive(Name, ZipFileType, FileIdx, (memcmp(Name, "STU", 3) == 0), false));
 			else
 				mPrimitives[PrimitiveIndex]->SetZipFile(ZipFileType, FileIdx);
 		}
@@ -385,6 +449,8 @@ void lcPiecesLibrary::ReadArchiveDescriptions(const QString& OfficialFileName, c
 
 		SaveCacheIndex(IndexFileName);
 	}
+
+	OpenCachePack();
 }
 
 
@@ -445,13 +511,14 @@ bool lcPiecesLibrary::OpenDirectory(const char* Path)
 				continue;
 
 			PieceInfo* Info = new PieceInfo();
-			mPieces.Add(Info);
 
 			strncpy(Info->m_strName, Line, sizeof(Info->m_strName));
 			Info->m_strName[sizeof(Info->m_strName) - 1] = 0;
 
 			strncpy(Info->m_strDescription, Description, sizeof(Info->m_strDescription));
 			Info->m_strDescription[sizeof(Info->m_strDescription) - 1] = 0;
+
+			AddPiece(Info);
 		}
 	}
 
@@ -501,7 +568,6 @@ bool lcPiecesLibrary::OpenDirectory(const char* Path)
 				continue;
 
 			PieceInfo* Info = new PieceInfo();
-			mPieces.Add(Info);
 
 			Src = (char*)Line + 2;
 			Dst = Info->m_strDescription;
@@ -520,6 +586,8 @@ bool lcPiecesLibrary::OpenDirectory(const char* Path)
 
 			strncpy(Info->m_strName, Name, sizeof(Info->m_strName));
 			Info->m_strName[sizeof(Info->m_strName) - 1] = 0;
+
+			AddPiece(Info);
 		}
 	}
 
@@ -568,7 +636,7 @@ bool lcPiecesLibrary::OpenDirectory(const char* Path)
 
 			bool SubFile = SubFileDirectories[DirectoryIdx];
 			lcLibraryPrimitive* Prim = new lcLibraryPrimitive(Name, LC_NUM_ZIPFILES, 0, !SubFile && (memcmp(Name, "STU", 3) == 0), SubFile);
-			mPrimitives.Add(Prim);
+			AddPrimitive(Prim);
 		}
 	}
 
@@ -608,10 +676,11 @@ bool lcPiecesLibrary::OpenDirectory(const char* Path)
 		*Dst = 0;
 
 		lcTexture* Texture = new lcTexture();
-		mTextures.Add(Texture);
 
 		strncpy(Texture->mName, Name, sizeof(Texture->mName));
 		Texture->mName[sizeof(Texture->mName) - 1] = 0;
+
+		AddTexture(Texture);
 	}
 
 	return true;
@@ -823,14 +892,318 @@ bool lcPiecesLibrary::SaveCacheIndex(const QString& FileName)
 	return WriteCacheFile(FileName, IndexFile);
 }
 
+bool lcPiecesLibrary::OpenCachePack(bool Compact)
+{
+	CloseCachePack();
+
+	mCachePack = new QFile(QFileInfo(QDir(mCachePath), QLatin1String("meshes.pack")).absoluteFilePath());
+
+	if (!mCachePack->open(QIODevice::ReadWrite))
+	{
+		CloseCachePack();
+		return false;
+	}
+
+	// Only the official archive is checked here, the records of unofficial pieces carry their own stamp.
+	quint32 PackHeader[2];
+	qint64 PackCheckSum[2];
+	bool Valid = mCachePack->read((char*)PackHeader, sizeof(PackHeader)) == sizeof(PackHeader) && mCachePack->read((char*)PackCheckSum, sizeof(PackCheckSum)) == sizeof(PackCheckSum) &&
+	             PackHeader[0] == LC_LIBRARY_CACHE_PACK_ID && PackHeader[1] == LC_LIBRARY_CACHE_PACK_VERSION && !memcmp(PackCheckSum, mArchiveCheckSum, sizeof(PackCheckSum));
+
+	// Start over when the pack is new or was written for another library.
+	if (!Valid)
+	{
+		PackHeader[0] = LC_LIBRARY_CACHE_PACK_ID;
+		PackHeader[1] = LC_LIBRARY_CACHE_PACK_VERSION;
+
+		if (!mCachePack->resize(0) || !mCachePack->seek(0) || mCachePack->write((char*)PackHeader, sizeof(PackHeader)) != sizeof(PackHeader) ||
+		    mCachePack->write((char*)mArchiveCheckSum, sizeof(PackCheckSum)) != sizeof(PackCheckSum) || !mCachePack->flush())
+		{
+			CloseCachePack();
+			return false;
+		}
+
+		return true;
+	}
+
+	if (!MapCachePack())
+	{
+		CloseCachePack();
+		return false;
+	}
+
+	// Each record is a name length, data length, data crc, source archive and source stamp followed by the name and the data.
+	const qint64 HeaderSize = sizeof(PackHeader) + sizeof(PackCheckSum);
+	const qint64 RecordSize = 5 * sizeof(quint32);
+	qint64 Offset = HeaderSize;
+
+	while (Offset + RecordSize <= mCachePackMappedSize)
+	{
+		quint32 Record[5];
+		memcpy(Record, mCachePackData + Offset, sizeof(Record));
+
+		if (Offset + RecordSize + Record[0] + Record[1] > mCachePackMappedSize)
+			break;
+
+		lcCachePackEntry Entry;
+		Entry.RecordOffset = Offset;
+		Entry.Offset = Offset + RecordSize + Record[0];
+		Entry.Size = Record[1];
+		Entry.Crc32 = Record[2];
+		Entry.Source = Record[3];
+		Entry.Stamp = Record[4];
+
+		QByteArray Name((const char*)mCachePackData + Offset + RecordSize, Record[0]);
+		PieceInfo* Info = FindPiece(Name.constData(), NULL, false);
+
+		// A mesh saved again leaves its older record behind, and the meshes of pieces
+		// whose archive changed since they were saved are out of date.
+		QHash<QByteArray, lcCachePackEntry>::iterator Old = mCachePackIndex.find(Name);
+
+		if (Old != mCachePackIndex.end())
+		{
+			mCachePackDeadSize += Old.value().Offset + Old.value().Size - Old.value().RecordOffset;
+			mCachePackIndex.erase(Old);
+		}
+
+		if (Info && Entry.Source == (quint32)Info->mZipFileType && Entry.Stamp == GetCachePackStamp(Info))
+			mCachePackIndex.insert(Name, Entry);
+		else
+			mCachePackDeadSize += Entry.Offset + Entry.Size - Entry.RecordOffset;
+
+		Offset = Entry.Offset + Entry.Size;
+	}
+
+	// Drop a record left half written by an interrupted append.
+	if (Offset != mCachePackMappedSize)
+	{
+		mCachePack->unmap(mCachePackData);
+		mCachePackData = NULL;
+		mCachePackMappedSize = 0;
+
+		if (!mCachePack->resize(Offset) || !MapCachePack())
+		{
+			CloseCachePack();
+			return false;
+		}
+	}
+
+	logStatus() << "Mesh cache pack opened with" << mCachePackIndex.size() << "meshes," << mCachePackDeadSize / 1024 << "KB out of date.";
+
+	// Rewrite the pack once most of it is out of date.
+	if (Compact && mCachePackDeadSize > LC_LIBRARY_CACHE_PACK_SLACK && mCachePackDeadSize * 2 > mCachePackMappedSize)
+	{
+		CompactCachePack();
+		return OpenCachePack(false);
+	}
+
+	return true;
+}
+
+bool lcPiecesLibrary::CompactCachePack()
+{
+	QString PackFileName = mCachePack->fileName();
+	QString NewPackFileName = PackFileName + QLatin1String(".new");
+	QFile NewPack(NewPackFileName);
+
+	bool Written = NewPack.open(QIODevice::WriteOnly | QIODevice::Truncate);
+
+	// The header stays as it is, followed by the records still in use.
+	const qint64 HeaderSize = 2 * sizeof(quint32) + 2 * sizeof(qint64);
+	Written = Written && NewPack.write((const char*)mCachePackData, HeaderSize) == HeaderSize;
+
+	for (QHash<QByteArray, lcCachePackEntry>::const_iterator it = mCachePackIndex.constBegin(); Written && it != mCachePackIndex.constEnd(); ++it)
+	{
+		const lcCachePackEntry& Entry = it.value();
+		qint64 RecordSize = Entry.Offset + Entry.Size - Entry.RecordOffset;
+
+		Written = NewPack.write((const char*)mCachePackData + Entry.RecordOffset, RecordSize) == RecordSize;
+	}
+
+	Written = Written && NewPack.flush();
+	NewPack.close();
+
+	qint64 OldSize = mCachePackMappedSize;
+
+	// The pack must be unmapped and closed before it can be replaced on Windows.
+	CloseCachePack();
+
+	if (!Written || !QFile::remove(PackFileName) || !QFile::rename(NewPackFileName, PackFileName))
+	{
+		QFile::remove(NewPackFileName);
+		return false;
+	}
+
+	logStatus() << "Mesh cache pack rewritten from" << OldSize / 1024 << "KB to" << QFileInfo(PackFileName).size() / 1024 << "KB.";
+
+	return true;
+}
+
+void lcPiecesLibrary::CloseCachePack()
+{
+	if (mCachePack && mCachePackData)
+		mCachePack->unmap(mCachePackData);
+
+	delete mCachePack;
+	mCachePack = NULL;
+	mCachePackData = NULL;
+	mCachePackMappedSize = 0;
+	mCachePackDeadSize = 0;
+	mCachePackIndex.clear();
+}
+
+bool lcPiecesLibrary::MapCachePack()
+{
+	if (mCachePackData)
+		mCachePack->unmap(mCachePackData);
+
+	mCachePackMappedSize = mCachePack->size();
+	mCachePackData = mCachePack->map(0, mCachePackMappedSize);
+
+	if (!mCachePackData)
+		mCachePackMappedSize = 0;
+
+	return mCachePackData != NULL;
+}
+
+quint32 lcPiecesLibrary::GetCachePackStamp(const PieceInfo* Info) const
+{
+	// Official pieces only use the official archive, which the pack header covers.
+	if (Info->mZipFileType != LC_ZIPFILE_UNOFFICIAL)
+		return 0;
+
+	return crc32(0, (const Bytef*)&mArchiveCheckSum[2], 2 * sizeof(mArchiveCheckSum[0]));
+}
+
+bool lcPiecesLibrary::ReadCachePack(PieceInfo* Info, lcMemFile& MeshData)
+{
+	if (!mCachePack)
+		return false;
+
+	const char* Name = Info->m_strName;
+	QHash<QByteArray, lcCachePackEntry>::iterator it = mCachePackIndex.find(QByteArray::fromRawData(Name, (int)strlen(Name)));
+
+	if (it == mCachePackIndex.end())
+		return false;
+
+	const lcCachePackEntry& Entry = it.value();
+
+	// The unofficial archive was reloaded since the mesh was saved.
+	if (Entry.Source != (quint32)Info->mZipFileType || Entry.Stamp != GetCachePackStamp(Info))
+	{
+		mCachePackDeadSize += Entry.Offset + Entry.Size - Entry.RecordOffset;
+		mCachePackIndex.erase(it);
+		return false;
+	}
+
+	// Records appended since the file was mapped need a new mapping.
+	if (Entry.Offset + Entry.Size > mCachePackMappedSize && !MapCachePack())
+		return false;
+
+	const unsigned char* Data = mCachePackData + Entry.Offset;
+
+	if (crc32(0, Data, Entry.Size) != Entry.Crc32)
+		return false;
+
+	// MeshData reads straight from the mapping, the caller must detach it with ReleaseCachePack().
+	MeshData.Close();
+	MeshData.mBuffer = (unsigned char*)Data;
+	MeshData.mBufferSize = Entry.Size;
+	MeshData.mFileSize = Entry.Size;
+	MeshData.mPosition = 0;
+
+	return true;
+}
+
+void lcPiecesLibrary::ReleaseCachePack(lcMemFile& MeshData)
+{
+	MeshData.mBuffer = NULL;
+	MeshData.mBufferSize = 0;
+	MeshData.mFileSize = 0;
+	MeshData.mPosition = 0;
+}
+
+bool lcPiecesLibrary::WriteCachePack(PieceInfo* Info, lcMemFile& MeshData)
+{
+	if (!mCachePack)
+		return false;
+
+	const char* Name = Info->m_strName;
+
+	quint32 Record[5];
+	Record[0] = strlen(Name);
+	Record[1] = MeshData.GetLength();
+	Record[2] = crc32(0, MeshData.mBuffer, Record[1]);
+	Record[3] = Info->mZipFileType;
+	Record[4] = GetCachePackStamp(Info);
+
+	QByteArray Buffer;
+	Buffer.reserve(sizeof(Record) + Record[0] + Record[1]);
+	Buffer.append((const char*)Record, sizeof(Record));
+	Buffer.append(Name, Record[0]);
+	Buffer.append((const char*)MeshData.mBuffer, Record[1]);
+
+	// The record goes out in one write, a torn one is dropped the next time the pack is opened.
+	qint64 Offset = mCachePack->size();
+
+	if (!mCachePack->seek(Offset) || mCachePack->write(Buffer) != Buffer.size() || !mCachePack->flush())
+	{
+		// A mapped file can't be truncated on Windows, ReadCachePack() maps it again.
+		if (mCachePackData)
+		{
+			mCachePack->unmap(mCachePackData);
+			mCachePackData = NULL;
+			mCachePackMappedSize = 0;
+		}
+
+		mCachePack->resize(Offset);
+		return false;
+	}
+
+	lcCachePackEntry Entry;
+	Entry.RecordOffset = Offset;
+	Entry.Offset = Offset + sizeof(Record) + Record[0];
+	Entry.Size = Record[1];
+	Entry.Crc32 = Record[2];
+	Entry.Source = Record[3];
+	Entry.Stamp = Record[4];
+
+	QHash<QByteArray, lcCachePackEntry>::iterator Old = mCachePackIndex.find(QByteArray(Name));
+
+	if (Old != mCachePackIndex.end())
+		mCachePackDeadSize += Old.value().Offset + Old.value().Size - Old.value().RecordOffset;
+
+	mCachePackIndex.insert(QByteArray(Name), Entry);
+
+	return true;
+}
+
 bool lcPiecesLibrary::LoadCachePiece(PieceInfo* Info)
 {
-	QString FileName = QFileInfo(QDir(mCachePath), QString::fromLatin1(Info->m_strName)).absoluteFilePath();
 	lcMemFile MeshData;
 
-	if (!ReadCacheFile(FileName, MeshData))
+	if (ReadCachePack(Info, MeshData))
+	{
+		bool Loaded = LoadCacheMesh(Info, MeshData);
+		ReleaseCachePack(MeshData);
+
+		if (Loaded)
+			return true;
+	}
+
+	QString FileName = QFileInfo(QDir(mCachePath), QString::fromLatin1(Info->m_strName)).absoluteFilePath();
+
+	if (!ReadCacheFile(FileName, MeshData) || !LoadCacheMesh(Info, MeshData))
 		return false;
 
+	// Move meshes from the old per-piece cache into the pack as they are used.
+	WriteCachePack(Info, MeshData);
+
+	return true;
+}
+
+bool lcPiecesLibrary::LoadCacheMesh(PieceInfo* Info, lcMemFile& MeshData)
+{
 	lcMesh* Mesh = new lcMesh;
 	Info->SetMesh(Mesh);
 
@@ -866,6 +1239,9 @@ bool lcPiecesLibrary::SaveCachePiece(PieceInfo* Info)
 	if (!Info->GetMesh()->FileSave(MeshData))
 		return false;
 
+	if (WriteCachePack(Info, MeshData))
+		return true;
+
 	QString FileName = QFileInfo(QDir(mCachePath), QString::fromLatin1(Info->m_strName)).absoluteFilePath();
 
 	return WriteCacheFile(FileName, MeshData);
@@ -915,6 +1291,9 @@ static int LibraryMeshSectionCompare(lcMergeSection const& First, lcMergeSection
 
 bool lcPiecesLibrary::LoadPiece(PieceInfo* Info)
 {
+	QElapsedTimer Timer;
+	Timer.start();
+
 	lcLibraryMeshData MeshData;
 	lcArray<lcLibraryTextureMap> TextureStack;
 
@@ -962,6 +1341,14 @@ bool lcPiecesLibrary::LoadPiece(PieceInfo* Info)
 	if (mZipFiles[LC_ZIPFILE_OFFICIAL])
 		SaveCachePiece(Info);
 
+	mPiecesDecoded++;
+	mPieceDecodeTime += Timer.elapsed();
+
+	logDebug() << "Piece" << Info->m_strName << "loaded in" << Timer.elapsed() << "milliseconds with"
+	           << MeshData.mVertices[LC_MESHDATA_SHARED].GetSize() << "shared vertices, sub-file cache"
+	           << mSubFileCacheHits << "hits" << mSubFileCacheMisses << "misses,"
+	           << mPiecesDecoded << "pieces decoded in" << mPieceDecodeTime << "milliseconds in all.";
+
 	return true;
 }
 
@@ -1342,11 +1729,7 @@ bool lcPiecesLibrary::LoadTexture(lcTexture* Texture)
 
 int lcPiecesLibrary::FindPrimitiveIndex(const char* Name) const
 {
-	for (int PrimitiveIndex = 0; PrimitiveIndex < mPrimitives.GetSize(); PrimitiveIndex++)
-		if (!strcmp(mPrimitives[PrimitiveIndex]->mName, Name))
-			return PrimitiveIndex;
-
-	return -1;
+	return mPrimitiveIndex.value(QByteArray::fromRawData(Name, (int)strlen(Name)), -1);
 }
 
 bool lcPiecesLibrary::LoadPrimitive(int PrimitiveIndex)
@@ -1414,6 +1797,7 @@ bool lcPiecesLibrary::LoadPrimitive(int PrimitiveIndex)
 			return false;
 	}
 
+	Primitive->mMeshData.ClearVertexGrids();
 	Primitive->mLoaded = true;
 
 	return true;
@@ -1626,7 +2010,7 @@ bool lcPiecesLibrary::ReadMeshData(lcFile& File, const lcMatrix44& CurrentTransf
 						MeshData.AddMeshDataNoDuplicateCheck(Primitive->mMeshData, IncludeTransform, ColorCode, TextureMap, MeshDataType);
 					else if (!Primitive->mSubFile)
 						MeshData.AddMeshData(Primitive->mMeshData, IncludeTransform, ColorCode, TextureMap, MeshDataType);
-					else
+					else if (!AddCachedSubFile(Primitive->mName, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
 					{
 						if (mZipFiles[LC_ZIPFILE_OFFICIAL])
 						{
@@ -1635,7 +2019,7 @@ bool lcPiecesLibrary::ReadMeshData(lcFile& File, const lcMatrix44& CurrentTransf
 							if (!mZipFiles[Primitive->mZipFileType]->ExtractFile(Primitive->mZipFileIndex, IncludeFile))
 								continue;
 
-							if (!ReadMeshData(IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
+							if (!ReadSubFileMeshData(Primitive->mName, IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
 								continue;
 						}
 						else
@@ -1654,20 +2038,20 @@ bool lcPiecesLibrary::ReadMeshData(lcFile& File, const lcMatrix44& CurrentTransf
 							if (!IncludeFile.Open(FileName, "rt"))
 								continue;
 
-							if (!ReadMeshData(IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
+							if (!ReadSubFileMeshData(Primitive->mName, IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
 								continue;
 						}
 					}
 				}
 				else
 				{
-					for (int PieceInfoIndex = 0; PieceInfoIndex < mPieces.GetSize(); PieceInfoIndex++)
-					{
-						PieceInfo* Info = mPieces[PieceInfoIndex];
+					PieceInfo* Info = FindPiece(FileName, NULL, false);
 
-						if (strcmp(Info->m_strName, FileName))
-							continue;
+					if (Info && AddCachedSubFile(Info->m_strName, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
+						Info = NULL;
 
+					while (Info)
+					{
 						if (mZipFiles[LC_ZIPFILE_OFFICIAL])
 						{
 							lcMemFile IncludeFile;
@@ -1675,7 +2059,7 @@ bool lcPiecesLibrary::ReadMeshData(lcFile& File, const lcMatrix44& CurrentTransf
 							if (!mZipFiles[Info->mZipFileType]->ExtractFile(Info->mZipFileIndex, IncludeFile))
 								break;
 
-							if (!ReadMeshData(IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
+							if (!ReadSubFileMeshData(Info->m_strName, IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
 								break;
 						}
 						else
@@ -1691,7 +2075,7 @@ bool lcPiecesLibrary::ReadMeshData(lcFile& File, const lcMatrix44& CurrentTransf
 							if (!IncludeFile.Open(FileName, "rt"))
 								break;
 
-							if (!ReadMeshData(IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
+							if (!ReadSubFileMeshData(Info->m_strName, IncludeFile, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType))
 								break;
 						}
 
@@ -1764,6 +2148,85 @@ bool lcPiecesLibrary::ReadMeshData(lcFile& File, const lcMatrix44& CurrentTransf
 	return true;
 }
 
+bool lcPiecesLibrary::AddCachedSubFile(const char* Name, const lcMatrix44& IncludeTransform, lcuint32 ColorCode, const lcArray<lcLibraryTextureMap>& TextureStack, lcLibraryMeshData& MeshData, lcMeshDataType MeshDataType)
+{
+	// Lines inside an active texture map are read in place, see ReadSubFileMeshData().
+	if (TextureStack.GetSize())
+		return false;
+
+	lcLibraryMeshData* SubFileData = mSubFileCache.object(QByteArray::fromRawData(Name, (int)strlen(Name)));
+
+	if (!SubFileData)
+		return false;
+
+	mSubFileCacheHits++;
+	MeshData.AddMeshData(*SubFileData, IncludeTransform, ColorCode, NULL, MeshDataType);
+
+	return true;
+}
+
+bool lcPiecesLibrary::ReadSubFileMeshData(const char* Name, lcFile& File, const lcMatrix44& IncludeTransform, lcuint32 ColorCode, lcArray<lcLibraryTextureMap>& TextureStack, lcLibraryMeshData& MeshData, lcMeshDataType MeshDataType)
+{
+	QByteArray Key(Name);
+
+	// Texture coordinates depend on where the file is included, so textured files are not cached.
+	if (TextureStack.GetSize() || mTexturedSubFiles.contains(Key))
+		return ReadMeshData(File, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType);
+
+	mSubFileCacheMisses++;
+
+	lcLibraryMeshData* SubFileData = new lcLibraryMeshData();
+
+	if (!ReadMeshData(File, lcMatrix44Identity(), 16, TextureStack, *SubFileData, LC_MESHDATA_SHARED))
+	{
+		delete SubFileData;
+		return false;
+	}
+
+	bool Textured = false;
+	int Cost = sizeof(lcLibraryMeshData);
+
+	for (int MeshDataIdx = 0; MeshDataIdx < LC_NUM_MESHDATA_TYPES; MeshDataIdx++)
+	{
+		const lcArray<lcLibraryMeshSection*>& Sections = SubFileData->mSections[MeshDataIdx];
+
+		Cost += SubFileData->mVertices[MeshDataIdx].GetSize() * sizeof(lcVertex);
+		Cost += SubFileData->mTexturedVertices[MeshDataIdx].GetSize() * sizeof(lcVertexTextured);
+
+		if (SubFileData->mTexturedVertices[MeshDataIdx].GetSize())
+			Textured = true;
+
+		for (int SectionIdx = 0; SectionIdx < Sections.GetSize(); SectionIdx++)
+		{
+			Cost += sizeof(lcLibraryMeshSection) + Sections[SectionIdx]->mIndices.GetSize() * sizeof(lcuint32);
+
+			if (Sections[SectionIdx]->mTexture)
+				Textured = true;
+		}
+	}
+
+	if (Textured)
+	{
+		delete SubFileData;
+		mTexturedSubFiles.insert(Key);
+
+		File.Seek(0, SEEK_SET);
+		return ReadMeshData(File, IncludeTransform, ColorCode, TextureStack, MeshData, MeshDataType);
+	}
+
+	SubFileData->ClearVertexGrids();
+	MeshData.AddMeshData(*SubFileData, IncludeTransform, ColorCode, NULL, MeshDataType);
+	mSubFileCache.insert(Key, SubFileData, Cost);
+
+	return true;
+}
+
+void lcPiecesLibrary::ClearSubFileCache()
+{
+	mSubFileCache.clear();
+	mTexturedSubFiles.clear();
+}
+
 void lcLibraryMeshData::ResequenceQuad(int* Indices, int a, int b, int c, int d)
 {
 	Indices[0] = a;
@@ -1975,10 +2438,19 @@ void lcLibraryMeshData::AddMeshData(const lcLibraryMeshData& Data, const lcMatri
 		const lcArray<lcVertex>& DataVertices = Data.mVertices[MeshDataIdx];
 		lcArray<lcVertex>& Vertices = mVertices[DestIndex];
 		lcArray<lcVertexTextured>& TexturedVertices = mTexturedVertices[DestIndex];
+		lcLibraryVertexGrid& VertexGrid = mVertexGrids[DestIndex];
+		lcLibraryVertexGrid& TexturedVertexGrid = mTexturedVertexGrids[DestIndex];
+
+		for (int VertexIdx = VertexGrid.GetSize(); VertexIdx < Vertices.GetSize(); VertexIdx++)
+			VertexGrid.Add(Vertices[VertexIdx].Position);
+
+		for (int VertexIdx = TexturedVertexGrid.GetSize(); VertexIdx < TexturedVertices.GetSize(); VertexIdx++)
+			TexturedVertexGrid.Add(TexturedVertices[VertexIdx].Position);
 
 		int VertexCount = DataVertices.GetSize();
 		lcArray<lcuint32> IndexRemap(VertexCount);
 		const float DistanceEpsilon = 0.05f;
+		int Cell[3];
 
 		if (!TextureMap)
 		{
@@ -1989,15 +2461,23 @@ void lcLibraryMeshData::AddMeshData(const lcLibraryMeshData& Data, const lcMatri
 				lcVector3 Position = lcMul31(DataVertices[SrcVertexIdx].Position, Transform);
 				int Index = -1;
 
-				for (int DstVertexIdx = Vertices.GetSize() - 1; DstVertexIdx >= 0; DstVertexIdx--)
+				// Pick the highest matching index from the neighbouring cells, as the old backwards scan did.
+				lcLibraryVertexGrid::GetCell(Position, Cell);
+
+				for (int CellIdx = 0; CellIdx < 27; CellIdx++)
 				{
-					lcVertex& DstVertex = Vertices[DstVertexIdx];
+					int DstVertexIdx = VertexGrid.GetFirst(Cell[0] + CellIdx % 3 - 1, Cell[1] + CellIdx / 3 % 3 - 1, Cell[2] + CellIdx / 9 - 1);
 
-	//				if (Vertex == Vertices[DstVertexIdx])
-					if (fabsf(Position.x - DstVertex.Position.x) < DistanceEpsilon && fabsf(Position.y - DstVertex.Position.y) < DistanceEpsilon && fabsf(Position.z - DstVertex.Position.z) < DistanceEpsilon)
+					for (; DstVertexIdx > Index; DstVertexIdx = VertexGrid.GetNext(DstVertexIdx))
 					{
-						Index = DstVertexIdx;
-						break;
+						lcVertex& DstVertex = Vertices[DstVertexIdx];
+
+		//				if (Vertex == Vertices[DstVertexIdx])
+						if (fabsf(Position.x - DstVertex.Position.x) < DistanceEpsilon && fabsf(Position.y - DstVertex.Position.y) < DistanceEpsilon && fabsf(Position.z - DstVertex.Position.z) < DistanceEpsilon)
+						{
+							Index = DstVertexIdx;
+							break;
+						}
 					}
 				}
 
@@ -2006,6 +2486,7 @@ void lcLibraryMeshData::AddMeshData(const lcLibraryMeshData& Data, const lcMatri
 					Index = Vertices.GetSize();
 					lcVertex& DstVertex = Vertices.Add();
 					DstVertex.Position = Position;
+					VertexGrid.Add(Position);
 				}
 
 				IndexRemap.Add(Index);
@@ -2023,16 +2504,23 @@ void lcLibraryMeshData::AddMeshData(const lcLibraryMeshData& Data, const lcMatri
 								   lcDot3(lcVector3(Position.x, Position.y, Position.z), TextureMap->Params[1]) + TextureMap->Params[1].w);
 				int Index = -1;
 
-				for (int DstVertexIdx = TexturedVertices.GetSize() - 1; DstVertexIdx >= 0; DstVertexIdx--)
+				lcLibraryVertexGrid::GetCell(Position, Cell);
+
+				for (int CellIdx = 0; CellIdx < 27; CellIdx++)
 				{
-					lcVertexTextured& DstVertex = TexturedVertices[DstVertexIdx];
+					int DstVertexIdx = TexturedVertexGrid.GetFirst(Cell[0] + CellIdx % 3 - 1, Cell[1] + CellIdx / 3 % 3 - 1, Cell[2] + CellIdx / 9 - 1);
 
-	//				if (Vertex == mTexturedVertices[DstVertexIdx])
-					if (fabsf(Position.x - DstVertex.Position.x) < DistanceEpsilon && fabsf(Position.y - DstVertex.Position.y) < DistanceEpsilon && fabsf(Position.z - DstVertex.Position.z) < DistanceEpsilon &&
-						fabsf(TexCoord.x - DstVertex.TexCoord.x) < 0.01f && fabsf(TexCoord.y - DstVertex.TexCoord.y) < 0.01f)
+					for (; DstVertexIdx > Index; DstVertexIdx = TexturedVertexGrid.GetNext(DstVertexIdx))
 					{
-						Index = DstVertexIdx;
-						break;
+						lcVertexTextured& DstVertex = TexturedVertices[DstVertexIdx];
+
+		//				if (Vertex == mTexturedVertices[DstVertexIdx])
+						if (fabsf(Position.x - DstVertex.Position.x) < DistanceEpsilon && fabsf(Position.y - DstVertex.Position.y) < DistanceEpsilon && fabsf(Position.z - DstVertex.Position.z) < DistanceEpsilon &&
+							fabsf(TexCoord.x - DstVertex.TexCoord.x) < 0.01f && fabsf(TexCoord.y - DstVertex.TexCoord.y) < 0.01f)
+						{
+							Index = DstVertexIdx;
+							break;
+						}
 					}
 				}
 
@@ -2042,6 +2530,7 @@ void lcLibraryMeshData::AddMeshData(const lcLibraryMeshData& Data, const lcMatri
 					lcVertexTextured& DstVertex = TexturedVertices.Add();
 					DstVertex.Position = Position;
 					DstVertex.TexCoord = TexCoord;
+					TexturedVertexGrid.Add(Position);
 				}
 
 				IndexRemap.Add(Index);
@@ -2062,16 +2551,23 @@ void lcLibraryMeshData::AddMeshData(const lcLibraryMeshData& Data, const lcMatri
 				lcVector3 Position = lcMul31(SrcVertex.Position, Transform);
 				int Index = -1;
 
-				for (int DstVertexIdx = TexturedVertices.GetSize() - 1; DstVertexIdx >= 0; DstVertexIdx--)
+				lcLibraryVertexGrid::GetCell(Position, Cell);
+
+				for (int CellIdx = 0; CellIdx < 27; CellIdx++)
 				{
-					lcVertexTextured& DstVertex = TexturedVertices[DstVertexIdx];
+					int DstVertexIdx = TexturedVertexGrid.GetFirst(Cell[0] + CellIdx % 3 - 1, Cell[1] + CellIdx / 3 % 3 - 1, Cell[2] + CellIdx / 9 - 1);
 
-	//				if (Vertex == mTexturedVertices[DstVertexIdx])
-					if (fabsf(Position.x - DstVertex.Position.x) < 0.1f && fabsf(Position.y - DstVertex.Position.y) < 0.1f && fabsf(Position.z - DstVertex.Position.z) < 0.1f &&
-						fabsf(SrcVertex.TexCoord.x - DstVertex.TexCoord.x) < 0.01f && fabsf(SrcVertex.TexCoord.y - DstVertex.TexCoord.y) < 0.01f)
+					for (; DstVertexIdx > Index; DstVertexIdx = TexturedVertexGrid.GetNext(DstVertexIdx))
 					{
-						Index = DstVertexIdx;
-						break;
+						lcVertexTextured& DstVertex = TexturedVertices[DstVertexIdx];
+
+		//				if (Vertex == mTexturedVertices[DstVertexIdx])
+						if (fabsf(Position.x - DstVertex.Position.x) < 0.1f && fabsf(Position.y - DstVertex.Position.y) < 0.1f && fabsf(Position.z - DstVertex.Position.z) < 0.1f &&
+							fabsf(SrcVertex.TexCoord.x - DstVertex.TexCoord.x) < 0.01f && fabsf(SrcVertex.TexCoord.y - DstVertex.TexCoord.y) < 0.01f)
+						{
+							Index = DstVertexIdx;
+							break;
+						}
 					}
 				}
 
@@ -2081,6 +2577,7 @@ void lcLibraryMeshData::AddMeshData(const lcLibraryMeshData& Data, const lcMatri
 					lcVertexTextured& DstVertex = TexturedVertices.Add();
 					DstVertex.Position = Position;
 					DstVertex.TexCoord = SrcVertex.TexCoord;
+					TexturedVertexGrid.Add(Position);
 				}
 
 				TexturedIndexRemap.Add(Index);
@@ -2444,11 +2941,17 @@ bool lcPiecesLibrary::LoadBuiltinPieces()
 	return true;
 }
 
-bool lcPiecesLibrary::ReloadUnoffLib()
+void lcPiecesLibrary::ReleaseUnoffLib()
 {
-    //unload unofficial library content
+    //unload unofficial library content, closing the archive so it can be replaced
     delete mZipFiles[LC_ZIPFILE_UNOFFICIAL];
     mZipFiles[LC_ZIPFILE_UNOFFICIAL] = NULL;
+    ClearSubFileCache();
+}
+
+bool lcPiecesLibrary::ReloadUnoffLib()
+{
+    ReleaseUnoffLib();
 
     //load unofficial library content
     if (OpenArchive(mUnofficialFileName, LC_ZIPFILE_UNOFFICIAL)){
@@ -57,6 +57,79 @@ struct lcLibraryTextureMap
 	bool Next;
 };
 
+// Spatial hash over a vertex array, each cell chains its vertices newest first.
+class lcLibraryVertexGrid
+{
+public:
+	void Clear()
+	{
+		mCells.clear();
+		mNext.RemoveAll();
+	}
+
+	int GetSize() const
+	{
+		return mNext.GetSize();
+	}
+
+	// Vertices must be added in array order.
+	void Add(const lcVector3& Position)
+	{
+		int Cell[3];
+		GetCell(Position, Cell);
+
+		QHash<quint64, int>::iterator it = mCells.find(GetCellKey(Cell[0], Cell[1], Cell[2]));
+
+		if (it == mCells.end())
+		{
+			mCells.insert(GetCellKey(Cell[0], Cell[1], Cell[2]), mNext.GetSize());
+			mNext.Add(-1);
+		}
+		else
+		{
+			mNext.Add(it.value());
+			it.value() = mNext.GetSize() - 1;
+		}
+	}
+
+	int GetFirst(int x, int y, int z) const
+	{
+		return mCells.value(GetCellKey(x, y, z), -1);
+	}
+
+	int GetNext(int VertexIdx) const
+	{
+		return mNext[VertexIdx];
+	}
+
+	// Cells are larger than the largest weld distance so matches are at most one cell away.
+	static void GetCell(const lcVector3& Position, int* Cell)
+	{
+		Cell[0] = (int)floorf(Position.x * 8.0f);
+		Cell[1] = (int)floorf(Position.y * 8.0f);
+		Cell[2] = (int)floorf(Position.z * 8.0f);
+	}
+
+protected:
+	static quint64 GetCellKey(int x, int y, int z)
+	{
+		return ((quint64)(x & 0x1fffff) << 42) | ((quint64)(y & 0x1fffff) << 21) | (quint64)(z & 0x1fffff);
+	}
+
+	QHash<quint64, int> mCells;
+	lcArray<int> mNext;
+};
+
+struct lcCachePackEntry
+{
+	qint64 RecordOffset;
+	qint64 Offset;
+	quint32 Size;
+	quint32 Crc32;
+	quint32 Source;
+	quint32 Stamp;
+};
+
 enum lcMeshDataType
 {
 	LC_MESHDATA_HIGH,
@@ -87,9 +160,22 @@ public:
 	void TestQuad(int* QuadIndices, const lcVector3* Vertices);
 	void ResequenceQuad(int* QuadIndices, int a, int b, int c, int d);
 
+	void ClearVertexGrids()
+	{
+		for (int MeshDataIdx = 0; MeshDataIdx < LC_NUM_MESHDATA_TYPES; MeshDataIdx++)
+		{
+			mVertexGrids[MeshDataIdx].Clear();
+			mTexturedVertexGrids[MeshDataIdx].Clear();
+		}
+	}
+
 	lcArray<lcLibraryMeshSection*> mSections[LC_NUM_MESHDATA_TYPES];
 	lcArray<lcVertex> mVertices[LC_NUM_MESHDATA_TYPES];
 	lcArray<lcVertexTextured> mTexturedVertices[LC_NUM_MESHDATA_TYPES];
+
+	// Weld lookups for AddMeshData, caught up with the vertex arrays on each call.
+	lcLibraryVertexGrid mVertexGrids[LC_NUM_MESHDATA_TYPES];
+	lcLibraryVertexGrid mTexturedVertexGrids[LC_NUM_MESHDATA_TYPES];
 };
 
 class lcLibraryPrimitive
@@ -130,9 +216,11 @@ public:
 
 	bool Load(const char* LibraryPath);
 	bool ReloadUnoffLib();
+	void ReleaseUnoffLib();
 	void Unload();
 	void RemoveTemporaryPieces();
 	void RemovePiece(PieceInfo* Info);
+	void RenamePiece(PieceInfo* Info, const char* OldName);
 
 	PieceInfo* FindPiece(const char* PieceName, Project* Project, bool CreatePlaceholder);
 	bool LoadPiece(PieceInfo* Info);
@@ -185,16 +273,56 @@ protected:
 	bool LoadCacheIndex(const QString& FileName);
 	bool SaveCacheIndex(const QString& FileName);
 	bool LoadCachePiece(PieceInfo* Info);
+	bool LoadCacheMesh(PieceInfo* Info, lcMemFile& MeshData);
 	bool SaveCachePiece(PieceInfo* Info);
 
+	bool OpenCachePack(bool Compact = true);
+	bool CompactCachePack();
+	void CloseCachePack();
+	bool MapCachePack();
+	quint32 GetCachePackStamp(const PieceInfo* Info) const;
+	bool ReadCachePack(PieceInfo* Info, lcMemFile& MeshData);
+	void ReleaseCachePack(lcMemFile& MeshData);
+	bool WriteCachePack(PieceInfo* Info, lcMemFile& MeshData);
+
 	int FindPrimitiveIndex(const char* Name) const;
 	bool LoadPrimitive(int PrimitiveIndex);
 
+	bool AddCachedSubFile(const char* Name, const lcMatrix44& IncludeTransform, lcuint32 ColorCode, const lcArray<lcLibraryTextureMap>& TextureStack, lcLibraryMeshData& MeshData, lcMeshDataType MeshDataType);
+	bool ReadSubFileMeshData(const char* Name, lcFile& File, const lcMatrix44& IncludeTransform, lcuint32 ColorCode, lcArray<lcLibraryTextureMap>& TextureStack, lcLibraryMeshData& MeshData, lcMeshDataType MeshDataType);
+	void ClearSubFileCache();
+
+	void AddPiece(PieceInfo* Info);
+	void AddPrimitive(lcLibraryPrimitive* Primitive);
+	void AddTexture(lcTexture* Texture);
+
+	// Name lookups for mPieces, mPrimitives and mTextures.
+	QMultiHash<QByteArray, PieceInfo*> mPieceIndex;
+	QHash<QByteArray, int> mPrimitiveIndex;
+	QHash<QByteArray, lcTexture*> mTextureIndex;
+
+	// Decoded sub-files and included pieces, least recently used dropped first.
+	QCache<QByteArray, lcLibraryMeshData> mSubFileCache;
+	QSet<QByteArray> mTexturedSubFiles;
+	int mSubFileCacheHits;
+	int mSubFileCacheMisses;
+
+	// Pieces read from their LDraw files, and the time spent on them.
+	int mPiecesDecoded;
+	qint64 mPieceDecodeTime;
+
 	QString mCachePath;
 	qint64 mArchiveCheckSum[4];
 	char mLibraryFileName[LC_MAXPATH];
 	char mUnofficialFileName[LC_MAXPATH];
 	lcZipFile* mZipFiles[LC_NUM_ZIPFILES];
+
+	// Single file mesh cache, mapped and indexed by piece name.
+	QFile* mCachePack;
+	uchar* mCachePackData;
+	qint64 mCachePackMappedSize;
+	qint64 mCachePackDeadSize;
+	QHash<QByteArray, lcCachePackEntry> mCachePackIndex;
 };
 
 #endif // _LC_LIBRARY_H_
@@ -20,11 +20,15 @@ lcZipFile::lcZipFile()
 {
 	mModified = false;
 	mFile = NULL;
+	mData = NULL;
+	mDataSize = 0;
+	mMapFile = NULL;
 }
 
 lcZipFile::~lcZipFile()
 {
 	Flush();
+	delete mMapFile;
 	delete mFile;
 }
 
@@ -40,6 +44,8 @@ bool lcZipFile::OpenRead(const char* FilePath)
 		return false;
 	}
 
+	MapFile(FilePath);
+
 	return true;
 }
 
@@ -53,9 +59,70 @@ bool lcZipFile::OpenRead(lcFile* File)
 		return false;
 	}
 
+	lcMemFile* MemFile = dynamic_cast<lcMemFile*>(File);
+
+	if (MemFile)
+	{
+		mData = MemFile->mBuffer;
+		mDataSize = MemFile->GetLength();
+	}
+
 	return true;
 }
 
+bool lcZipFile::MapFile(const char* FilePath)
+{
+	if (mData)
+		return true;
+
+	QFile* MapFile = new QFile(QString::fromLocal8Bit(FilePath));
+
+	if (!MapFile->open(QIODevice::ReadOnly) || MapFile->size() != (qint64)mFile->GetLength())
+	{
+		delete MapFile;
+		return false;
+	}
+
+	mData = MapFile->map(0, MapFile->size());
+
+	if (!mData)
+	{
+		delete MapFile;
+		return false;
+	}
+
+	mDataSize = MapFile->size();
+	mMapFile = MapFile;
+
+	return true;
+}
+
+bool lcZipFile::ReadAt(lcuint64 Offset, void* Buffer, lcuint64 Bytes)
+{
+	if (mData)
+	{
+		if (Offset + Bytes > mDataSize)
+			return false;
+
+		memcpy(Buffer, mData + Offset, Bytes);
+		return true;
+	}
+
+	QMutexLocker Lock(&mFileMutex);
+
+	mFile->Seek((long)Offset, SEEK_SET);
+	return mFile->ReadBuffer(Buffer, Bytes) == Bytes;
+}
+
+void lcZipFile::AddFileIndex(int FileIndex)
+{
+	QByteArray Name = QByteArray(mFiles[FileIndex].file_name).toLower();
+
+	// Keep the first entry with a name, as the old search did.
+	if (!mFileIndex.contains(Name))
+		mFileIndex.insert(Name, FileIndex);
+}
+
 bool lcZipFile::OpenWrite(const char* FilePath, bool Append)
 {
 	lcDiskFile* File = new lcDiskFile();
@@ -215,53 +282,61 @@ lcuint64 lcZipFile::SearchCentralDir64()
 	return RelativeOffset;
 }
 
+static inline lcuint16 lcZipReadU16(const lcuint8* Data)
+{
+	return Data[0] | (Data[1] << 8);
+}
+
+static inline lcuint32 lcZipReadU32(const lcuint8* Data)
+{
+	return Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((lcuint32)Data[3] << 24);
+}
+
 bool lcZipFile::CheckFileCoherencyHeader(int FileIndex, lcuint32* SizeVar, lcuint64* OffsetLocalExtraField, lcuint32* SizeLocalExtraField)
 {
-	lcuint16 Number16, Flags;
-	lcuint32 Number32, Magic;
+	lcuint16 Flags;
+	lcuint32 Number32;
 	lcuint16 SizeFilename, SizeExtraField;
 	const lcZipFileInfo& FileInfo = mFiles[FileIndex];
+	lcuint8 Header[0x1e];
 
 	*SizeVar = 0;
 	*OffsetLocalExtraField = 0;
 	*SizeLocalExtraField = 0;
 
-	mFile->Seek((long)(FileInfo.offset_curfile + mBytesBeforeZipFile), SEEK_SET);
-
-	if (mFile->ReadU32(&Magic, 1) != 1 || Magic != 0x04034b50)
+	if (!ReadAt(FileInfo.offset_curfile + mBytesBeforeZipFile, Header, sizeof(Header)))
 		return false;
 
-	if (mFile->ReadU16(&Number16, 1) != 1)
+	if (lcZipReadU32(Header) != 0x04034b50)
 		return false;
 
-	if (mFile->ReadU16(&Flags, 1) != 1)
-		return false;
+	Flags = lcZipReadU16(Header + 6);
 
-	if (mFile->ReadU16(&Number16, 1) != 1 || Number16 != FileInfo.compression_method)
+	if (lcZipReadU16(Header + 8) != FileInfo.compression_method)
 		return false;
 
 	if (FileInfo.compression_method != 0 && FileInfo.compression_method != Z_DEFLATED)
 		return false;
 
-	if (mFile->ReadU32(&Number32, 1) != 1)
-		return false;
-
-	if (mFile->ReadU32(&Number32, 1) != 1 || ((Number32 != FileInfo.crc) && ((Flags & 8)==0)))
+	Number32 = lcZipReadU32(Header + 14);
+	if ((Number32 != FileInfo.crc) && ((Flags & 8)==0))
 		return false;
 
-	if (mFile->ReadU32(&Number32, 1) != 1 || (Number32 != 0xffffffffU && (Number32 != FileInfo.compressed_size) && ((Flags & 8)==0)))
+	Number32 = lcZipReadU32(Header + 18);
+	if (Number32 != 0xffffffffU && (Number32 != FileInfo.compressed_size) && ((Flags & 8)==0))
 		return false;
 
-	if (mFile->ReadU32(&Number32, 1) != 1 || (Number32 != 0xffffffffU && (Number32 != FileInfo.uncompressed_size) && ((Flags & 8)==0)))
+	Number32 = lcZipReadU32(Header + 22);
+	if (Number32 != 0xffffffffU && (Number32 != FileInfo.uncompressed_size) && ((Flags & 8)==0))
 		return false;
 
-	if (mFile->ReadU16(&SizeFilename, 1) != 1 || SizeFilename != FileInfo.size_filename)
+	SizeFilename = lcZipReadU16(Header + 26);
+	if (SizeFilename != FileInfo.size_filename)
 		return false;
 
 	*SizeVar += SizeFilename;
 
-	if (mFile->ReadU16(&SizeExtraField, 1) != 1)
-		return false;
+	SizeExtraField = lcZipReadU16(Header + 28);
 
 	*OffsetLocalExtraField= FileInfo.offset_curfile + 0x1e + SizeFilename;
 	*SizeLocalExtraField = SizeExtraField;
@@ -592,20 +667,20 @@ bool lcZipFile::ReadCentralDir()
 		mFile->Seek(Seek, SEEK_CUR);
 	}
 
+	for (int FileIdx = 0; FileIdx < mFiles.GetSize(); FileIdx++)
+		AddFileIndex(FileIdx);
+
 	return true;
 }
 
 bool lcZipFile::ExtractFile(const char* FileName, lcMemFile& File, lcuint32 MaxLength)
 {
-	for (int FileIdx = 0; FileIdx < mFiles.GetSize(); FileIdx++)
-	{
-		lcZipFileInfo& FileInfo = mFiles[FileIdx];
+	QHash<QByteArray, int>::const_iterator it = mFileIndex.constFind(QByteArray(FileName).toLower());
 
-		if (!stricmp(FileInfo.file_name, FileName))
-			return ExtractFile(FileIdx, File, MaxLength);
-	}
+	if (it == mFileIndex.constEnd())
+		return false;
 
-	return false;
+	return ExtractFile(it.value(), File, MaxLength);
 }
 
 bool lcZipFile::ExtractFile(int FileIndex, lcMemFile& File, lcuint32 MaxLength)
@@ -618,136 +693,69 @@ bool lcZipFile::ExtractFile(int FileIndex, lcMemFile& File, lcuint32 MaxLength)
 	if (!CheckFileCoherencyHeader(FileIndex, &SizeVar, &OffsetLocalExtraField, &SizeLocalExtraField))
 		return false;
 
-	const int BufferSize = 16384;
-	char ReadBuffer[BufferSize];
-	z_stream Stream;
-	lcuint32 Crc32;
-	lcuint64 PosInZipfile;
-	lcuint64 RestReadCompressed;
-	lcuint64 RestReadUncompressed;
-
-	Crc32 = 0;
-	Stream.total_out = 0;
+	lcuint64 PosInZipfile = FileInfo.offset_curfile + 0x1e + SizeVar + mBytesBeforeZipFile;
+	QByteArray ReadBuffer;
+	const Bytef* Compressed;
 
-	if (FileInfo.compression_method == Z_DEFLATED)
+	// The whole compressed entry is handed to zlib at once, straight from the view when there is one.
+	if (mData)
 	{
-		Stream.zalloc = (alloc_func)0;
-		Stream.zfree = (free_func)0;
-		Stream.opaque = (voidpf)0;
-		Stream.next_in = 0;
-		Stream.avail_in = 0;
-
-		int err = inflateInit2(&Stream, -MAX_WBITS);
-		if (err != Z_OK)
+		if (PosInZipfile + FileInfo.compressed_size > mDataSize)
 			return false;
+
+		Compressed = (const Bytef*)mData + PosInZipfile;
 	}
+	else
+	{
+		ReadBuffer.resize((int)FileInfo.compressed_size);
 
-	RestReadCompressed = FileInfo.compressed_size;
-	RestReadUncompressed = FileInfo.uncompressed_size;
-	PosInZipfile = FileInfo.offset_curfile + 0x1e + SizeVar;
+		if (!ReadAt(PosInZipfile, ReadBuffer.data(), FileInfo.compressed_size))
+			return false;
 
-	Stream.avail_in = (uInt)0;
+		Compressed = (const Bytef*)ReadBuffer.constData();
+	}
 
 	lcuint32 Length = lcMin((lcuint32)FileInfo.uncompressed_size, MaxLength);
 	File.SetLength(Length);
 	File.Seek(0, SEEK_SET);
 
-	Stream.next_out = (Bytef*)File.mBuffer;
-	Stream.avail_out = Length;
-
-	lcuint32 Read = 0;
-
-	while (Stream.avail_out > 0)
+	if (FileInfo.compression_method == 0)
 	{
-		if ((Stream.avail_in == 0) && (RestReadCompressed > 0))
-		{
-			lcuint32 ReadThis = BufferSize;
-
-			if (RestReadCompressed < ReadThis)
-				ReadThis = (lcuint32)RestReadCompressed;
-
-			if (ReadThis == 0)
-				return false;
-
-			mFile->Seek((long)(PosInZipfile + mBytesBeforeZipFile), SEEK_SET);
-			if (mFile->ReadBuffer(ReadBuffer, ReadThis) != ReadThis)
-				return false;
-
-			PosInZipfile += ReadThis;
-
-			RestReadCompressed -= ReadThis;
-
-			Stream.next_in = (Bytef*)ReadBuffer;
-			Stream.avail_in = (uInt)ReadThis;
-		}
-
-		if (FileInfo.compression_method == 0)
-		{
-			lcuint32 DoCopy, i;
-
-			if ((Stream.avail_in == 0) && (RestReadCompressed == 0))
-				return (Read == 0) ? false : true;
-
-			if (Stream.avail_out < Stream.avail_in)
-				DoCopy = Stream.avail_out;
-			else
-				DoCopy = Stream.avail_in;
-
-			for (i = 0; i < DoCopy; i++)
-				*(Stream.next_out+i) = *(Stream.next_in+i);
-
-			Crc32 = crc32(Crc32, Stream.next_out, DoCopy);
-			RestReadUncompressed -= DoCopy;
-			Stream.avail_in -= DoCopy;
-			Stream.avail_out -= DoCopy;
-			Stream.next_out += DoCopy;
-			Stream.next_in += DoCopy;
-			Stream.total_out += DoCopy;
-			Read += DoCopy;
-		}
-		else
-		{
-			lcuint64 TotalOutBefore, TotalOutAfter;
-			const Bytef *bufBefore;
-			lcuint64 OutThis;
-			int flush = Z_SYNC_FLUSH;
-
-			TotalOutBefore = Stream.total_out;
-			bufBefore = Stream.next_out;
-
-			int err = inflate(&Stream,flush);
+		if (FileInfo.compressed_size < Length)
+			return false;
 
-			if ((err >= 0) && (Stream.msg != NULL))
-				err = Z_DATA_ERROR;
+		memcpy(File.mBuffer, Compressed, Length);
 
-			TotalOutAfter = Stream.total_out;
-			OutThis = TotalOutAfter - TotalOutBefore;
+		return Length == FileInfo.uncompressed_size ? crc32(0, File.mBuffer, Length) == FileInfo.crc : true;
+	}
 
-			Crc32 = crc32(Crc32, bufBefore, (uInt)(OutThis));
+	z_stream Stream;
 
-			RestReadUncompressed -= OutThis;
+	Stream.zalloc = (alloc_func)0;
+	Stream.zfree = (free_func)0;
+	Stream.opaque = (voidpf)0;
+	Stream.next_in = (Bytef*)Compressed;
+	Stream.avail_in = (uInt)FileInfo.compressed_size;
+	Stream.next_out = (Bytef*)File.mBuffer;
+	Stream.avail_out = Length;
 
-			Read += (uInt)(TotalOutAfter - TotalOutBefore);
+	if (inflateInit2(&Stream, -MAX_WBITS) != Z_OK)
+		return false;
 
-			if (err != Z_OK)
-			{
-				inflateEnd(&Stream);
+	int err;
 
-				if (RestReadUncompressed == 0)
-				{
-					if (Crc32 != FileInfo.crc)
-						return false;
-				}
+	do
+	{
+		err = inflate(&Stream, Z_SYNC_FLUSH);
+	} while (err == Z_OK && Stream.avail_out > 0 && Stream.avail_in > 0);
 
-				if (err == Z_STREAM_END)
-					return (Read == 0) ? false : true;
+	inflateEnd(&Stream);
 
-				return false;
-			}
-		}
-	}
+	if ((err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) || Stream.avail_out > 0)
+		return false;
 
-	inflateEnd(&Stream);
+	if (Length == FileInfo.uncompressed_size && crc32(0, File.mBuffer, Length) != FileInfo.crc)
+		return false;
 
 	return true;
 }
@@ -833,6 +841,8 @@ bool lcZipFile::AddFile(const char* FileName, lcMemFile& File)
 	Info.write_buffer = OutFile;
 	Info.deleted = false;
 
+	AddFileIndex(mFiles.GetSize() - 1);
+
 	mModified = true;
 
 	return true;
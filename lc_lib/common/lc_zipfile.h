@@ -2,12 +2,16 @@
 #define _LC_ZIPFILE_H_
 
 #include "lc_array.h"
+#include <QHash>
+#include <QByteArray>
+#include <QMutex>
 
 #ifdef DeleteFile
 #undef DeleteFile
 #endif
 
 class lcFile;
+class QFile;
 
 // Date/time info.
 //struct tm_unz //changed on 05/12/2015 move LDSearch directories to lc_application
@@ -59,6 +63,7 @@ public:
 	bool OpenRead(const char* FilePath);
 	bool OpenRead(lcFile* File);
 	bool OpenWrite(const char* FilePath, bool Append);
+	bool MapFile(const char* FilePath);
 
 	bool ExtractFile(int FileIndex, lcMemFile& File, lcuint32 MaxLength = 0xffffffff);
 	bool ExtractFile(const char* FileName, lcMemFile& File, lcuint32 MaxLength = 0xffffffff);
@@ -74,9 +79,19 @@ protected:
 	lcuint64 SearchCentralDir();
 	lcuint64 SearchCentralDir64();
 	bool CheckFileCoherencyHeader(int FileIndex, lcuint32* SizeVar, lcuint64* OffsetLocalExtraField, lcuint32* SizeLocalExtraField);
+	bool ReadAt(lcuint64 Offset, void* Buffer, lcuint64 Bytes);
+	void AddFileIndex(int FileIndex);
 
 	lcFile* mFile;
 
+	// Extraction reads from mData when the archive is mapped or in memory, otherwise
+	// through mFile under mFileMutex, so ExtractFile() may run on several threads.
+	const lcuint8* mData;
+	lcuint64 mDataSize;
+	QFile* mMapFile;
+	QMutex mFileMutex;
+	QHash<QByteArray, int> mFileIndex;
+
 	bool mModified;
 	bool mZip64;
 	lcuint64 mNumEntries;
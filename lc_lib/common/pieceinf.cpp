@@ -60,8 +60,15 @@ void PieceInfo::SetModel(lcModel* Model, bool UpdateMesh)
 		mModel = Model;
 	}
 
+	char OldName[LC_PIECE_NAME_LEN];
+	strcpy(OldName, m_strName);
+
 	strncpy(m_strName, Model->GetProperties().mName.toUpper().toLatin1().data(), sizeof(m_strName));
 	m_strName[sizeof(m_strName)-1] = 0;
+
+	if (strcmp(OldName, m_strName))
+		lcGetPiecesLibrary()->RenamePiece(this, OldName);
+
 	strncpy(m_strDescription, Model->GetProperties().mName.toLatin1().data(), sizeof(m_strDescription));
 	m_strDescription[sizeof(m_strDescription)-1] = 0;
 
@@ -21,6 +21,7 @@
 #include "lpub.h"
 #include "resolution.h"
 #include "updatecheck.h"
+#include "imageanalysis.h"
 
 #include "QsLogDest.h"
 
@@ -107,6 +108,7 @@ Application::Application(int &argc, char **argv)
   : m_application(argc, argv)
 {
   m_instance = this;
+  splash = NULL;
 
 #if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
   m_application.setAttribute(Qt::AA_UseDesktopOpenGL);
@@ -131,6 +133,11 @@ Application* Application::instance()
 
 void Application::initialize(int &argc, char **argv)
 {
+  // command line export options, see batchexport.h
+  bool batchOk = m_batchExport.parse(argc, argv);
+  if (batchMode() && (! batchOk || m_batchExport.helpRequested()))
+    throw InitException{};
+
   // initialize directories
   Preferences::lpubPreferences();
 
@@ -213,6 +220,15 @@ void Application::initialize(int &argc, char **argv)
 
   logInfo() << QString("Initializing application.");
 
+#ifdef QT_DEBUG
+  // image scan kernels against their pixel at a time reference
+  QString imageAnalysisReport;
+  if (ImageAnalysis::selfCheck(imageAnalysisReport))
+    logInfo() << imageAnalysisReport;
+  else
+    logError() << imageAnalysisReport;
+#endif
+
   // splash
   QPixmap pixmap(":/resources/LPub512Splash.png");
   splash = new QSplashScreen(pixmap);
@@ -223,7 +239,8 @@ void Application::initialize(int &argc, char **argv)
   splashFont.setStretch(130);
 
   splash->setFont(splashFont);
-  splash->show();
+  if (! batchMode())
+    splash->show();
 
   emit splashMsgSig("5% - Initializing application...");
 
@@ -313,6 +330,7 @@ void Application::initialize(int &argc, char **argv)
     } else {
 
       logError() << QString("Unable to initialize 3D Viewer.");
+      m_batchExport.setExitCode(BatchExport::ExitLoad);
       throw InitException{};
 
     }
@@ -326,6 +344,9 @@ void Application::main()
 
   splash->finish(gui);
 
+  if (batchMode())
+    return;
+
   GetAvailableVersions();
 
   gui->show();
@@ -349,11 +370,19 @@ int Application::run()
     // Call the main function
     logInfo() << QString("Run: Starting application...");
 
-    main();
+    if (batchMode() && (m_batchExport.exitCode() != BatchExport::ExitOk ||
+                        m_batchExport.helpRequested())) {
+      returnCode = m_batchExport.exitCode();
+    } else {
+      main();
 
-    logInfo() << QString("Run: Application started.");
+      logInfo() << QString("Run: Application started.");
 
-    returnCode = m_application.exec();
+      if (batchMode())
+        returnCode = m_batchExport.run();
+      else
+        returnCode = m_application.exec();
+    }
   }
   catch(const std::exception& ex)
   {
@@ -29,6 +29,7 @@
 
 #include "QsLog.h"
 #include "lc_global.h"
+#include "batchexport.h"
 
 class InitException: public QException
 {
@@ -64,11 +65,16 @@ public:
     /// Initialize the splash screen
     QSplashScreen *splash;
 
+    /// True when exporting from the command line, nothing is shown
+    bool batchMode() { return m_batchExport.active(); }
+
 public slots:
     /// Splash message function to display message updates during startup
     void splashMsg(QString message){
-      splash->showMessage(QSplashScreen::tr(message.toLatin1().constData()),Qt::AlignBottom | Qt::AlignLeft, Qt::white);
-	  m_application.processEvents();
+      if (! batchMode()) {
+        splash->showMessage(QSplashScreen::tr(message.toLatin1().constData()),Qt::AlignBottom | Qt::AlignLeft, Qt::white);
+        m_application.processEvents();
+      }
       logStatus() << message;
     }
 
@@ -83,6 +89,9 @@ private:
     /// Current application instance
     static Application* m_instance;
 
+    /// Command line export
+    BatchExport m_batchExport;
+
 };
 
 /// ENTRY_POINT is a macro that implements the main function.
@@ -12,11 +12,20 @@
 **
 ****************************************************************************/
 
+#include <QHash>
+#include <QSet>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <string.h>
+
 #include "archiveparts.h"
 #include "lpub_preferences.h"
 #include "lc_application.h"
 #include "lpub.h"
 #include "paths.h"
+#include "version.h"
 
 ArchiveParts::ArchiveParts(QObject *parent) : QObject(parent)
 {
@@ -24,341 +33,501 @@ ArchiveParts::ArchiveParts(QObject *parent) : QObject(parent)
 }
 
 /*
- * Insert static coloured fade parts into unofficial ldraw library
- *
+ * The manifest next to an archive records, for each entry added from
+ * disk, the file it came from, the file's size and modification time and
+ * the CRC-32 of its content.  A file whose size and time still match the
+ * manifest is known to be archived without reading it.
  */
-bool ArchiveParts::Archive(const QString &zipArchive, const QDir &dir, QString &result, const QString &comment = QString("")) {
 
-  //qDebug() << QString("\nProcessing %1 with comment: %2").arg(dir.absolutePath()).arg(comment);
+class ArchiveManifestEntry
+{
+public:
+  QString  name;         // entry name in the archive
+  QString  source;       // absolute path of the file it was made from
+  qint64   size;
+  qint64   modified;     // msecs since epoch
+  quint32  crc;
+
+  ArchiveManifestEntry()
+  {
+    size     = 0;
+    modified = 0;
+    crc      = 0;
+  }
+};
+
+static QHash<QString, ArchiveManifestEntry> loadManifest(const QString &zipArchive)
+{
+  QHash<QString, ArchiveManifestEntry> manifest;
 
-  // Initialize the zip file
-  QuaZip zip(zipArchive);
-  zip.setFileNameCodec("IBM866");
+  QFile file(zipArchive + ".manifest");
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    return manifest;
 
-  // Check if directory exists
-  if (!dir.exists()) {
-      result = QString("! Archive directory does not exist: %1").arg(dir.absolutePath());
-      logError() << result;
-      return false;
+  QTextStream in(&file);
+  in.setCodec("UTF-8");
+  while (!in.atEnd()) {
+      QStringList fields = in.readLine().split("\t");
+      if (fields.size() != 5)
+        continue;
+      ArchiveManifestEntry entry;
+      entry.name     = fields[0];
+      entry.source   = fields[1];
+      entry.size     = fields[2].toLongLong();
+      entry.modified = fields[3].toLongLong();
+      entry.crc      = fields[4].toUInt(0,16);
+      manifest.insert(entry.name.toLower(), entry);
     }
+  return manifest;
+}
 
-  // We get the list of directory files and folders recursively
-  QStringList dirFileList;
-  RecurseAddDir(dir, dirFileList);
-
-  // Check if file list is empty
-  if (dirFileList.isEmpty()) {
-      result = QString("! File directory is empty: %1").arg(dir.absolutePath());
-      return false;
+static void saveManifest(const QString &zipArchive, const QHash<QString, ArchiveManifestEntry> &manifest)
+{
+  QFile file(zipArchive + ".manifest");
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+      logError() << QString("Cannot write archive manifest %1: %2").arg(file.fileName()).arg(file.errorString());
+      return;
     }
 
-  // Create an array of file objects consisting of QFileInfo
-  QFileInfoList files;
-  foreach (QString fileName, dirFileList) files << QFileInfo(fileName);
-
-  // Initialize some variables
-  QString parts           = "parts";
-  QString primitives      = "p";
-  QString fileNameWithRelativePath;
-  bool setPartsDir        = false;
-  bool setPrimDir         = false;
-
-  // If input directory is 'p' use 'p' (primitive) else use 'parts'
-  if (dir.dirName().toLower() == primitives){
-      setPrimDir = true;
-    } else if (dir.dirName().toLower() == parts){
-      setPartsDir = true;
+  QTextStream out(&file);
+  out.setCodec("UTF-8");
+  foreach (const ArchiveManifestEntry &entry, manifest) {
+      out << entry.name << "\t" << entry.source << "\t" << entry.size << "\t"
+          << entry.modified << "\t" << QString::number(entry.crc,16) << "\n";
     }
+}
 
-  // Check if the zip file exist; if yes, set to add content, and if no create
-  QFileInfo zipFileInfo(zipArchive);
-  QFileInfoList zipFiles;
-  if (zipFileInfo.exists()){
-      if (!zip.open(QuaZip::mdAdd)) {
-          result = QString("! Cannot add to zip archive: %1").arg(zip.getZipError());
-          return false;
-        }
-
-      // We get the list of files already in the archive.
-      QStringList zipDirPaths;
-      QStringList zipFileList;
-      QStringList subDirs = dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs, QDir::SortByMask);
-      if (subDirs.count() > 0 && (!setPartsDir && !setPrimDir)){
-          //qDebug() << "---FIRST LEVEL SUBDIR LIST:        " << subDirs;
-
-          foreach(QString subDirName, subDirs){
-
-              QDir subDir(QString("%1/%2").arg(dir.absolutePath()).arg(subDirName));
-              //qDebug() << "---PROCESSING FIRST LEVEL SUBDIR:  " << subDir.absolutePath();
-
-              QDir excludeUnoffPartsDir(QString("%1/%2").arg(Preferences::ldrawPath).arg("unofficial/parts"));
-              QDir excludeUnoffPrimDir(QString("%1/%2").arg(Preferences::ldrawPath).arg("unofficial/p"));
-              QDir excludeOffPartsDir(QString("%1/%2").arg(Preferences::ldrawPath).arg("parts"));
-              QDir excludeOffPrimDir(QString("%1/%2").arg(Preferences::ldrawPath).arg("p"));
-
-              if ((subDir == excludeUnoffPartsDir) || (subDir == excludeUnoffPrimDir) ||
-                  (subDir == excludeOffPartsDir) || (subDir == excludeOffPrimDir)) {
-                  //qDebug() << "SKIPPING " << subDir.absolutePath();
-                  continue;
-                }
-
-              QStringList subSubDirs = subDir.entryList(QDir::NoDotAndDotDot | QDir::Dirs, QDir::SortByMask);
-              if (subSubDirs.count() > 0) {
-                  //qDebug() << "---SECOND LEVEL SUBDIR LIST:       " << subSubDirs;
-
-                  foreach(QString subSubDirName, subSubDirs) {
-                      // reset prtsInDir flags
-                      setPartsDir  = false;
-                      setPrimDir   = false;
-
-                      QDir subSubDir(QString("%1/%2").arg(subDir.absolutePath()).arg(subSubDirName));
-                      //qDebug() << "---PROCESSING SECOND LEVEL SUBDIR: " << subSubDir.absolutePath();
-
-                      setPartsDir = subSubDir.dirName().toLower() == parts;
-                      setPrimDir  = subSubDir.dirName().toLower() == primitives;
+/*
+ * The 3D Viewer library keeps the unofficial archive open and mapped, so
+ * it lets go of it while the archive is written.  PartWorker reloads it
+ * once the parts are archived.
+ */
 
-                      if (setPrimDir)
-                        zipDirPaths << primitives;
-                      else if (setPartsDir)
-                        zipDirPaths << parts;
-                      else
-                        zipDirPaths << parts;
+static bool releaseLibraryArchive(const QString &zipArchive)
+{
+  QFileInfo unofficialLib(QString("%1/%2").arg(QFileInfo(Preferences::lpub3dLibFile).absolutePath(),VER_LPUB3D_UNOFFICIAL_ARCHIVE));
+  if (!Preferences::lpub3dLoaded || !g_App || !g_App->mLibrary ||
+      QFileInfo(zipArchive).absoluteFilePath() != unofficialLib.absoluteFilePath())
+    return false;
 
-//                      qDebug() << "\nCHECK IF ARCHIVE EXIST (SECOND LEVEL DIR - SUBS (P/PART DIRS)): "
-//                                 << "\npartsInDir:               " << setPartsDir
-//                                 << "\nprimInDir:                " << setPrimDir
-//                                 << "\nsubSubDir.absolutePath(): " << subSubDir.absolutePath()
-//                                 << "\nzipDirPaths:              " << zipDirPaths
-//                                    ;
+  g_App->mLibrary->ReleaseUnoffLib();
+  return true;
+}
 
-                      foreach (QString zipDirPath, zipDirPaths){
-                          RecurseZipArchive(zipFileList, zipDirPath, zipArchive, subSubDir/*dirRelativePath*/);
-                        }
+/*
+ * Put newArchive in the place of zipArchive.  The old archive is kept
+ * as a backup until the new one is in place and restored on failure.
+ */
 
-                      //Create an array of archive file objects consisting of QFileInfo
-                      foreach (QString zipFile, zipFileList) zipFiles << QFileInfo(zipFile);
+static bool replaceArchive(const QString &zipArchive, const QString &newArchive)
+{
+  QString backupArchive = zipArchive + ".bak";
+  QFile::remove(backupArchive);
 
-                      zipDirPaths.clear();
-                    }
-                }
-              // No second level sub directories detected - default to zipDir 'parts'
-              zipDirPaths << parts;
-
-//              qDebug() << "\nCHECK IF ARCHIVE EXIST (FIRST LEVEL DIR - SUB (W/O P/PART DIR)): "
-//                         << "\nsetPartsDir:           " << (setPartsDir?"True":"False")
-//                         << "\nsetPrimDir:            " << (setPrimDir?"True":"False")
-//                         << "\nsubDir.absolutePath(): " << subDir.absolutePath()
-//                         << "\nzipDirPaths:           " << zipDirPaths
-//                            ;
-
-              foreach (QString zipDirPath, zipDirPaths){
-                  RecurseZipArchive(zipFileList, zipDirPath, zipArchive, subDir/*dirRelativePath*/);
-                }
-              //Create an array of archive file objects consisting of QFileInfo
-              foreach (QString zipFile, zipFileList) zipFiles << QFileInfo(zipFile);
+  if (!QFile::rename(zipArchive, backupArchive))
+    return false;
 
-              zipDirPaths.clear();
-            }
-        }
+  if (!QFile::rename(newArchive, zipArchive)) {
+      QFile::rename(backupArchive, zipArchive);
+      return false;
+    }
 
-      // No sub directories detected
-      if (setPrimDir)
-        zipDirPaths << primitives;
-      else if (setPartsDir)
-        zipDirPaths << parts;
-      else
-        zipDirPaths << parts;
-
-//      qDebug() << "\nCHECK IF ARCHIVE EXIST (ROOT LEVEL DIR - NO SUBS): "
-//                 << "\nsetPartsDir:   " << setPartsDir
-//                 << "\nsetPrimDir:    " << setPrimDir
-//                 << "\ndir:           " << dir.absolutePath()
-//                 << "\nzipDirPaths:   " << zipDirPaths
-//                    ;
-
-      foreach (QString zipDirPath, zipDirPaths){
-          RecurseZipArchive(zipFileList, zipDirPath, zipArchive, dir);
-        }
+  QFile::remove(backupArchive);
+  return true;
+}
 
-      //Create an array of archive file objects consisting of QFileInfo
-      foreach (QString zipFile, zipFileList) zipFiles << QFileInfo(zipFile);
+/*
+ * The name a disk file gets in the archive: its path from the parts or p
+ * folder it is in, or parts/<name> for files outside those.
+ */
 
-      zipDirPaths.clear();
+static QString archiveEntryName(const QFileInfo &fileInfo)
+{
+  QString path         = fileInfo.absoluteFilePath();
+  int partsDirIndex    = path.indexOf("/parts/",0,Qt::CaseInsensitive);
+  int primDirIndex     = path.indexOf("/p/",0,Qt::CaseInsensitive);
+
+  if (partsDirIndex != -1)
+    return path.remove(0, partsDirIndex + 1);
+  else if (primDirIndex != -1)
+    return path.remove(0, primDirIndex + 1);
+  else
+    return QString("parts/%1").arg(fileInfo.fileName());
+}
 
-    } else {
+/*
+ * Reads one disk file, works out its CRC and, when the archive needs it,
+ * deflates it.  Jobs only touch their own members, so they all run at
+ * the same time; the archive is then written in one go with the data
+ * already compressed.
+ */
 
-      if (!zip.open(QuaZip::mdCreate)) {
-          result = QString("! Cannot create zip archive: %1").arg(zip.getZipError());
-          return false;
-        }
+class ArchiveEntryJob : public QRunnable
+{
+public:
+  QString    filePath;
+  QString    entryName;
+  bool       inArchive;     // the archive has an entry of this name
+  quint32    archiveCrc;    // and this is its CRC
+  bool       replaceable;   // that entry was made from this file
+  qint64     size;
+  qint64     modified;
+  quint32    crc;
+  bool       unchanged;     // the entry has this content already
+  QByteArray compressed;    // raw deflate data, when it is to be written
+  QString    error;
+
+  ArchiveEntryJob()
+  {
+    inArchive   = false;
+    archiveCrc  = 0;
+    replaceable = false;
+    size        = 0;
+    modified    = 0;
+    crc         = 0;
+    unchanged   = false;
+    setAutoDelete(false);
+  }
+
+  bool toWrite()
+  {
+    return !compressed.isNull();
+  }
+
+  void run();
+};
+
+void ArchiveEntryJob::run()
+{
+  QFile file(filePath);
+  if (!file.open(QIODevice::ReadOnly)) {
+      error = QString("inFile open error: %1").arg(file.errorString());
+      return;
     }
+  QByteArray data = file.readAll();
+  file.close();
 
-  // Archive each disk file as necessary
-//  qDebug() << "PROCESSING DISK FILES FOR ARCHIVE";
-  QFile inFile;
-  QuaZipFile outFile(&zip);
-  int archivedPartCount = 0;
-
-  char c;
-  foreach(QFileInfo fileInfo, files) {
+  size = data.size();
+  crc  = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data.constData()), data.size());
 
-      //qDebug() << "Processing Disk File Name: " << fileInfo.absoluteFilePath();
-      if (!fileInfo.isFile())
-        continue;
+  if (inArchive && crc == archiveCrc) {
+      unchanged = true;
+      return;
+    }
+  if (inArchive && !replaceable) {
+      return;                      // first come, first served
+    }
 
-      bool alreadyArchived = false;
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                   DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+      error = QString("deflate init error: %1").arg(filePath);
+      return;
+    }
+  QByteArray out(int(deflateBound(&stream, data.size())), 0);
+  stream.next_in   = reinterpret_cast<Bytef *>(data.data());
+  stream.avail_in  = data.size();
+  stream.next_out  = reinterpret_cast<Bytef *>(out.data());
+  stream.avail_out = out.size();
+  int rc = deflate(&stream, Z_FINISH);
+  out.resize(int(stream.total_out));
+  deflateEnd(&stream);
+
+  if (rc != Z_STREAM_END) {
+      error = QString("deflate error %1: %2").arg(rc).arg(filePath);
+      return;
+    }
+  compressed = out;
+}
 
-      foreach (QFileInfo zipFileInfo, zipFiles) {        
-          if (fileInfo == zipFileInfo) {
-              alreadyArchived = true;
-//              qDebug() << "FileMatch - Skipping !! " << fileInfo.absoluteFilePath();
-              break;
-            }
-        }
+/* Add an entry compressed by ArchiveEntryJob */
+static bool writeEntry(QuaZip &zip, ArchiveEntryJob *job, QString &result)
+{
+  QuaZipNewInfo info(job->entryName, job->filePath);
+  info.uncompressedSize = ulong(job->size);
 
-      if (alreadyArchived)
-        continue;
-      else
-         archivedPartCount++;
+  QuaZipFile outFile(&zip);
+  if (!outFile.open(QIODevice::WriteOnly, info, NULL, job->crc, Z_DEFLATED, Z_DEFAULT_COMPRESSION, true)) {
+      result = QString("outFile open error: %1").arg(outFile.getZipError());
+      return false;
+    }
 
-      logInfo() << QString("  %1 Archive part: %2").arg(archivedPartCount).arg(fileInfo.fileName());
+  outFile.write(job->compressed);
 
-      int partsDirIndex    = fileInfo.absoluteFilePath().indexOf("/parts/",0,Qt::CaseInsensitive);
-      int primDirIndex     = fileInfo.absoluteFilePath().indexOf("/p/",0,Qt::CaseInsensitive);
+  if (outFile.getZipError() != UNZ_OK) {
+      result = QString("outFile error: %1").arg(outFile.getZipError());
+      return false;
+    }
 
-      setPartsDir    = partsDirIndex != -1;
-      setPrimDir     = primDirIndex != -1;
+  outFile.close();
 
-      if (setPartsDir){
-          fileNameWithRelativePath = fileInfo.absoluteFilePath().remove(0, partsDirIndex + 1);
-          //qDebug() << "Adjusted Parts fileNameWithRelativePath: " << fileNameWithRelativePath;
-        } else if (setPrimDir){
-          fileNameWithRelativePath = fileInfo.absoluteFilePath().remove(0, primDirIndex + 1);
-          //qDebug() << "Adjusted Primitive fileNameWithRelativePath: " << fileNameWithRelativePath;
-        } else {
-          fileNameWithRelativePath = fileInfo.fileName();
-          //qDebug() << "Adjusted Root fileNameWithRelativePath: " << fileNameWithRelativePath;
-        }
+  if (outFile.getZipError() != UNZ_OK) {
+      result = QString("outFile close error: %1").arg(outFile.getZipError());
+      return false;
+    }
+  return true;
+}
 
-      QString fileNameWithCompletePath;
+/*
+ * Insert static coloured fade parts into unofficial ldraw library
+ *
+ * Files already in the archive with the same content are skipped, new
+ * files are compressed on all cores and appended in one batch.  A file
+ * that changed since it was archived replaces its entry, which means
+ * copying the other entries, still compressed, into a new archive.
+ */
+bool ArchiveParts::Archive(const QString &zipArchive, const QDir &dir, QString &result, const QString &comment = QString("")) {
 
-      if (setPartsDir || setPrimDir){
-          fileNameWithCompletePath = fileNameWithRelativePath;
-//          qDebug() << "fileNameWithCompletePath (ROOT PART/PRIMITIVE) " << fileNameWithCompletePath;
-        } else {
-          fileNameWithCompletePath = QString("%1/%2").arg(parts).arg(fileNameWithRelativePath);
-//            qDebug() << "fileNameWithCompletePath (PART - DEFAULT)" << fileNameWithCompletePath;
-        }
+  //qDebug() << QString("\nProcessing %1 with comment: %2").arg(dir.absolutePath()).arg(comment);
 
-      inFile.setFileName(fileInfo.filePath());
+  QElapsedTimer timer;
+  timer.start();
 
-      if (!inFile.open(QIODevice::ReadOnly)) {
-          result = QString("inFile open error: %1").arg(inFile.errorString().toLocal8Bit().constData());
-          return false;
-      }
+  // Check if directory exists
+  if (!dir.exists()) {
+      result = QString("! Archive directory does not exist: %1").arg(dir.absolutePath());
+      logError() << result;
+      return false;
+    }
 
-      if (!outFile.open(QIODevice::WriteOnly, QuaZipNewInfo(fileNameWithCompletePath, fileInfo.filePath()))) {
-          result = QString("outFile open error: %1").arg(outFile.getZipError());
-          return false;
-        }
+  // We get the list of directory files and folders recursively
+  QStringList dirFileList;
+  RecurseAddDir(dir, dirFileList);
 
-      while (inFile.getChar(&c) && outFile.putChar(c));
+  // Check if file list is empty
+  if (dirFileList.isEmpty()) {
+      result = QString("! File directory is empty: %1").arg(dir.absolutePath());
+      return false;
+    }
 
-      if (outFile.getZipError() != UNZ_OK) {
-          result = QString("outFile error: %1").arg(outFile.getZipError());
+  // We get the list of files already in the archive, once, from its directory
+  QHash<QString, QuaZipFileInfo> archived;           // by lower case name
+  QFileInfo zipFileInfo(zipArchive);
+  if (zipFileInfo.exists()){
+      QuaZip zip(zipArchive);
+      zip.setFileNameCodec("IBM866");
+      if (!zip.open(QuaZip::mdUnzip)) {
+          result = QString("! Cannot read zip archive: %1").arg(zip.getZipError());
           return false;
         }
-
-      outFile.close();
-
-      if (outFile.getZipError() != UNZ_OK) {
-          result = QString("outFile close error: %1").arg(outFile.getZipError());
-          return false;
+      QuaZipFileInfo info;
+      for (bool f = zip.goToFirstFile(); f; f = zip.goToNextFile()) {
+          zip.getCurrentFileInfo(&info);
+          archived.insert(info.name.toLower(), info);
         }
-
-      inFile.close();
+      zip.close();
     }
 
-  if (!comment.isEmpty())
-    zip.setComment(comment);
+  QHash<QString, ArchiveManifestEntry> manifest = loadManifest(zipArchive);
 
-  zip.close();
+  // Files the manifest has with the same size and time are not read again
+  QList<ArchiveEntryJob *> jobs;
+  int unchangedCount = 0;
 
-  if (zip.getZipError() != 0) {
-      result = QString("zip error: %1").arg(zip.getZipError());
-      return false;
-    }
+  foreach (QString fileName, dirFileList) {
 
-  result = QString::number(archivedPartCount);
-  return true;
-}
-
-/* Recursively searches files in the archive for a given directory \ a, and adds to the list of \ b */
-bool ArchiveParts::RecurseZipArchive(QStringList &zipDirFileList, QString &zipDirPath, const QString &zipArchive, const QDir &dir) {
+      QFileInfo fileInfo(fileName);
+      if (!fileInfo.isFile())
+        continue;
 
-  QuaZip zip(zipArchive);
-  QuaZip *ptrZip = &zip;
+      QString entryName = archiveEntryName(fileInfo);
+      QString key       = entryName.toLower();
+      qint64  modified  = fileInfo.lastModified().toMSecsSinceEpoch();
+
+      QHash<QString, QuaZipFileInfo>::const_iterator a = archived.constFind(key);
+      QHash<QString, ArchiveManifestEntry>::const_iterator m = manifest.constFind(key);
+      bool inArchive = a != archived.constEnd();
+      bool ours      = m != manifest.constEnd() && m.value().source == fileInfo.absoluteFilePath();
+
+      if (inArchive && ours &&
+          m.value().size     == fileInfo.size() &&
+          m.value().modified == modified &&
+          m.value().crc      == a.value().crc) {
+          unchangedCount++;
+          continue;
+        }
 
-  if (!zip.open(QuaZip::mdUnzip)) {
-      logError() << QString("zip open error: %1 @ %2").arg(zip.getZipError()).arg(zipArchive);
-      return false;
+      ArchiveEntryJob *job = new ArchiveEntryJob;
+      job->filePath    = fileInfo.absoluteFilePath();
+      job->entryName   = entryName;
+      job->inArchive   = inArchive;
+      job->archiveCrc  = inArchive ? a.value().crc : 0;
+      job->replaceable = ours;
+      job->modified    = modified;
+      jobs << job;
     }
 
-  zip.setFileNameCodec("IBM866");
-
-//  logInfo() << QString("%1 Total Zip Archive Entries: ").arg(zip.getEntriesCount());
-//  logInfo() << QString("Global Comment: %1").arg(zip.getComment().toLocal8Bit().constData());
-//  logInfo() << QString("Disk File Absolute Path: %1").arg(dir.absolutePath());
+  QThreadPool pool;
+  for (int i = 0; i < jobs.size(); i++)
+    pool.start(jobs[i]);
+  pool.waitForDone();
+
+  // Sort out what is to be written
+  QList<ArchiveEntryJob *> additions;
+  QSet<QString> replaced;
+  QSet<QString> written;
+  int keptCount = 0;
+  bool ok = true;
+
+  for (int i = 0; i < jobs.size() && ok; i++) {
+      ArchiveEntryJob *job = jobs[i];
+      QString key = job->entryName.toLower();
+
+      if (!job->error.isEmpty()) {
+          result = job->error;
+          ok = false;
+        } else if (job->unchanged) {
+          unchangedCount++;
+          if (!manifest.contains(key) || job->replaceable) {
+              ArchiveManifestEntry entry;
+              entry.name     = job->entryName;
+              entry.source   = job->filePath;
+              entry.size     = job->size;
+              entry.modified = job->modified;
+              entry.crc      = job->crc;
+              manifest.insert(key, entry);
+            }
+        } else if (!job->toWrite() || written.contains(key)) {
+          keptCount++;             // the archive keeps what came from another file
+        } else {
+          if (job->inArchive)
+            replaced << key;
+          written << key;
+          additions << job;
+          logInfo() << QString("  %1 Archive part: %2").arg(additions.size()).arg(QFileInfo(job->filePath).fileName());
+        }
+    }
 
-  QuaZipDir zipDir(ptrZip,zipDirPath);
+  // Write the archive
+  bool released = false;
+  if (ok && !additions.isEmpty()) {
 
-  if (zipDir.exists()) {
+      released = releaseLibraryArchive(zipArchive);
 
-      zipDir.cd(zipDirPath);
+      if (replaced.isEmpty()) {
 
-//      logInfo() << QString("%1 Zip Directory Entries in '%2'").arg(zipDir.count()).arg(zipDirPath);
+          // append the new entries in one batch
+          QuaZip zip(zipArchive);
+          zip.setFileNameCodec("IBM866");
+          if (!zip.open(zipFileInfo.exists() ? QuaZip::mdAdd : QuaZip::mdCreate)) {
+              result = QString("! Cannot %1 zip archive: %2")
+                       .arg(zipFileInfo.exists() ? "add to" : "create").arg(zip.getZipError());
+              ok = false;
+            }
+          for (int i = 0; i < additions.size() && ok; i++)
+            ok = writeEntry(zip, additions[i], result);
 
-      QStringList qsl = zipDir.entryList(QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files, QDir::SortByMask);
+          if (ok && !comment.isEmpty())
+            zip.setComment(comment);
 
-      foreach (QString zipFile, qsl) {
+          zip.close();
 
-          if (!dir.exists())
-            continue;
+          if (ok && zip.getZipError() != 0) {
+              result = QString("zip error: %1").arg(zip.getZipError());
+              ok = false;
+            }
 
-          QFileInfo zipFileInfo(QString("%1/%2").arg(dir.absolutePath()).arg(zipFile));
+        } else {
 
-          if (!zipFileInfo.exists())
-            continue;
+          // copy the entries that stay, without recompressing, then add the rest
+          QString newArchive = zipArchive + ".new";
+          QuaZip zip(zipArchive);
+          QuaZip newZip(newArchive);
+          zip.setFileNameCodec("IBM866");
+          newZip.setFileNameCodec("IBM866");
+          if (!zip.open(QuaZip::mdUnzip) || !newZip.open(QuaZip::mdCreate)) {
+              result = QString("! Cannot rewrite zip archive: %1 %2").arg(zip.getZipError()).arg(newZip.getZipError());
+              ok = false;
+            }
 
-          if (zipFileInfo.isSymLink()) {
-            logError() << QString("zip directory entrylist returned a symbolic link.");
-            return false;
-          }
+          QuaZipFileInfo info;
+          for (bool f = ok && zip.goToFirstFile(); f && ok; f = zip.goToNextFile()) {
+              zip.getCurrentFileInfo(&info);
+              if (replaced.contains(info.name.toLower()))
+                continue;
+
+              int method, level;
+              QuaZipFile inFile(&zip);
+              QuaZipFile outFile(&newZip);
+              if (!inFile.open(QIODevice::ReadOnly, &method, &level, true)) {
+                  result = QString("inFile open error: %1").arg(inFile.getZipError());
+                  ok = false;
+                  break;
+                }
+              QByteArray data = inFile.readAll();
+              inFile.close();
 
-          if(zipFileInfo.isDir()){
+              if (!outFile.open(QIODevice::WriteOnly, QuaZipNewInfo(info), NULL, info.crc, method, level, true)) {
+                  result = QString("outFile open error: %1").arg(outFile.getZipError());
+                  ok = false;
+                  break;
+                }
+              outFile.write(data);
+              outFile.close();
+              if (outFile.getZipError() != UNZ_OK) {
+                  result = QString("outFile close error: %1").arg(outFile.getZipError());
+                  ok = false;
+                }
+            }
 
-              QString subDirPath = QString("%1/%2").arg(zipDirPath).arg(zipFile);
+          for (int i = 0; i < additions.size() && ok; i++)
+            ok = writeEntry(newZip, additions[i], result);
 
-              QDir subDir(zipFileInfo.filePath());
+          if (ok)
+            newZip.setComment(comment.isEmpty() ? zip.getComment() : comment);
 
-              RecurseZipArchive(zipDirFileList, subDirPath, zipArchive, subDir);
+          zip.close();
+          newZip.close();
 
-            } else {
+          if (ok && newZip.getZipError() != 0) {
+              result = QString("zip error: %1").arg(newZip.getZipError());
+              ok = false;
+            }
 
-              zipDirFileList << zipFileInfo.filePath();
-              //logNotice() << "VALID FILE zipDirFileList: " << zipFileInfo.filePath();
+          if (ok && !replaceArchive(zipArchive, newArchive)) {
+              result = QString("! Cannot replace zip archive: %1").arg(zipArchive);
+              ok = false;
+            }
+          if (!ok)
+            QFile::remove(newArchive);
+        }
 
+      if (ok) {
+          foreach (ArchiveEntryJob *job, additions) {
+              ArchiveManifestEntry entry;
+              entry.name     = job->entryName;
+              entry.source   = job->filePath;
+              entry.size     = job->size;
+              entry.modified = job->modified;
+              entry.crc      = job->crc;
+              manifest.insert(job->entryName.toLower(), entry);
             }
         }
     }
 
-  zip.close();
+  if (ok)
+    saveManifest(zipArchive, manifest);
+  else if (released)
+    g_App->mLibrary->ReloadUnoffLib();
 
-  if (zip.getZipError() != UNZ_OK) {
-      logError() << QString("zip close error: %1").arg(zip.getZipError());
-      return false;
-    }
+  int archivedPartCount = additions.size() - replaced.size();
+
+  foreach (ArchiveEntryJob *job, jobs)
+    delete job;
+
+  if (!ok)
+    return false;
+
+  logInfo() << QString("Archive %1: %2 parts added, %3 replaced, %4 unchanged, %5 left from other files (%6 ms).")
+               .arg(dir.absolutePath())
+               .arg(archivedPartCount)
+               .arg(replaced.size())
+               .arg(unchangedCount)
+               .arg(keptCount)
+               .arg(timer.elapsed());
 
+  result = QString::number(additions.size());
   return true;
 }
 
@@ -40,12 +40,6 @@ public:
       const QDir &dir,
       QStringList &list);
 
-    static bool RecurseZipArchive(
-            QStringList &zipDirFileList,
-            QString &zipDirPath,
-      const QString &zipArchive,
-      const QDir &dir);
-
 public slots:
 
 signals:
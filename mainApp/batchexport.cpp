@@ -0,0 +1,354 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 - 2017 Trevor SANDY. All rights reserved.
+**
+** This file may be used under the terms of the
+** GNU General Public Liceense (GPL) version 3.0
+** which accompanies this distribution, and is
+** available at http://www.gnu.org/licenses/gpl.html
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include "batchexport.h"
+
+#include <QApplication>
+#include <QMessageBox>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegExp>
+#include <QStringList>
+#include <cstdio>
+#include <cstring>
+
+#include "lpub.h"
+#include "lpub_preferences.h"
+#include "render.h"
+#include "version.h"
+#include "QsLog.h"
+
+BatchExport::BatchExport()
+{
+  m_active    = false;
+  m_help      = false;
+  m_failed    = false;
+  m_exitCode  = ExitOk;
+  m_processes = 0;
+  m_exportThreads  = 0;
+  m_pngCompression = -1;
+  m_pdfImageDpi    = 0;
+
+  m_modalTimer.setInterval(250);
+  connect(&m_modalTimer, SIGNAL(timeout()), this, SLOT(dismissModal()));
+}
+
+void BatchExport::usage()
+{
+  fprintf(stdout,
+    "Usage: %s [options] <model file>\n"
+    "  Command line export, nothing is shown.  Run with QT_QPA_PLATFORM=offscreen\n"
+    "  where there is no display.\n"
+    "  -x, --export <pdf|png|jpg|bmp>: Exports the model and exits.\n"
+    "  -o, --output <path>: The pdf file, or the folder for images.\n"
+    "                       Defaults to next to the model file.\n"
+    "  -p, --pages <range>: Pages to export, e.g. 1-5,8. Defaults to all pages.\n"
+    "  -r, --renderer <LDGLite|LDView|POVRay>: Overrides the preferred renderer.\n"
+    "  -j, --processes <count>: Concurrent renderer processes.\n"
+    "  -c, --cache <dir>: Folder for the LPub3D tmp, assem and parts files.\n"
+    "                     Defaults to the model folder.\n"
+    "  --export-threads <count>: Threads writing png, jpg and bmp pages.\n"
+    "  --png-compression <0-9>: Compression of png pages, 9 is smallest.\n"
+    "  --pdf-image-dpi <dpi>: Scales pdf images down to this resolution.\n"
+    "  Exit codes: 0 exported, 1 bad command line, 2 load failed, 3 export failed.\n",
+    VER_PRODUCTNAME_STR);
+  fflush(stdout);
+}
+
+bool BatchExport::parse(int &argc, char **argv)
+{
+  m_timer.start();
+
+  QStringList formats;
+  formats << "pdf" << "png" << "jpg" << "bmp";
+
+  QStringList renderers;
+  renderers << "LDGLite" << "LDView" << "POVRay";
+
+  // 3D Viewer options that take a value, see lcApplication::Initialize
+  QStringList viewerOptions;
+  viewerOptions << "-l" << "--libpath" << "-i" << "--image"
+                << "-w" << "--width" << "-h" << "--height"
+                << "-f" << "--from" << "-t" << "--to"
+                << "-wf" << "--export-wavefront" << "-3ds" << "--export-3ds";
+
+  for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-x") == 0 || strcmp(argv[i], "--export") == 0)
+        m_active = true;
+      else if (strcmp(argv[i], "-?") == 0 || strcmp(argv[i], "--help") == 0)
+        m_help = true;
+    }
+
+  // without -x everything is left for the 3D Viewer, --help included
+  if (m_help)
+    usage();
+  if (! m_active || m_help)
+    return true;
+
+  int kept = 1;
+  bool ok  = true;
+
+  for (int i = 1; i < argc; i++) {
+      const char *arg = argv[i];
+      bool hasValue   = i + 1 < argc;
+
+      if (strcmp(arg, "-x") == 0 || strcmp(arg, "--export") == 0) {
+          if (hasValue)
+            m_format = QString(argv[++i]).toLower();
+          if (! formats.contains(m_format)) {
+              fprintf(stderr, "Invalid value specified for the %s argument.\n", arg);
+              ok = false;
+            }
+        } else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+          if (hasValue)
+            m_output = QString::fromLocal8Bit(argv[++i]);
+          else
+            ok = false;
+        } else if (strcmp(arg, "-p") == 0 || strcmp(arg, "--pages") == 0) {
+          QRegExp rx("^\\d+(-\\d+)?(,\\d+(-\\d+)?)*$");
+          if (hasValue)
+            m_pageRange = QString(argv[++i]).remove(' ');
+          if (! rx.exactMatch(m_pageRange)) {
+              fprintf(stderr, "Invalid value specified for the %s argument.\n", arg);
+              ok = false;
+            } else {
+              foreach (QString range, m_pageRange.split(",")) {
+                  QStringList pages = range.split("-");
+                  if (pages.first().toInt() < 1 ||
+                      pages.first().toInt() > pages.last().toInt()) {
+                      fprintf(stderr, "Invalid page range %s.\n", qPrintable(range));
+                      ok = false;
+                    }
+                }
+            }
+        } else if (strcmp(arg, "-r") == 0 || strcmp(arg, "--renderer") == 0) {
+          if (hasValue) {
+              QString name = argv[++i];
+              foreach (QString renderer, renderers) {
+                  if (renderer.compare(name, Qt::CaseInsensitive) == 0)
+                    m_renderer = renderer;
+                }
+            }
+          if (m_renderer.isEmpty()) {
+              fprintf(stderr, "Invalid value specified for the %s argument.\n", arg);
+              ok = false;
+            }
+        } else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--processes") == 0) {
+          if (hasValue)
+            m_processes = QString(argv[++i]).toInt();
+          if (m_processes < 1) {
+              fprintf(stderr, "Invalid value specified for the %s argument.\n", arg);
+              ok = false;
+            }
+        } else if (strcmp(arg, "--export-threads") == 0) {
+          if (hasValue)
+            m_exportThreads = QString(argv[++i]).toInt();
+          if (m_exportThreads < 1) {
+              fprintf(stderr, "Invalid value specified for the %s argument.\n", arg);
+              ok = false;
+            }
+        } else if (strcmp(arg, "--png-compression") == 0) {
+          bool isNumber = false;
+          if (hasValue)
+            m_pngCompression = QString(argv[++i]).toInt(&isNumber);
+          if (! isNumber || m_pngCompression < 0 || m_pngCompression > 9) {
+              fprintf(stderr, "Invalid value specified for the %s argument.\n", arg);
+              ok = false;
+            }
+        } else if (strcmp(arg, "--pdf-image-dpi") == 0) {
+          if (hasValue)
+            m_pdfImageDpi = QString(argv[++i]).toInt();
+          if (m_pdfImageDpi < 1) {
+              fprintf(stderr, "Invalid value specified for the %s argument.\n", arg);
+              ok = false;
+            }
+        } else if (strcmp(arg, "-c") == 0 || strcmp(arg, "--cache") == 0) {
+          if (hasValue)
+            m_cacheDir = QString::fromLocal8Bit(argv[++i]);
+          else
+            ok = false;
+        } else if (arg[0] != '-' && m_modelFile.isEmpty()) {
+          m_modelFile = QString::fromLocal8Bit(arg);
+        } else {
+          argv[kept++] = argv[i];        // leave it for the 3D Viewer
+          if (viewerOptions.contains(arg) && hasValue)
+            argv[kept++] = argv[++i];
+        }
+    }
+
+  argc = kept;
+  argv[argc] = NULL;
+
+  if (m_modelFile.isEmpty()) {
+      fprintf(stderr, "No model file specified.\n");
+      ok = false;
+    }
+
+  if (! ok)
+    m_exitCode = ExitUsage;
+  else
+    m_modalTimer.start();        // startup can ask for things too
+
+  return ok;
+}
+
+int BatchExport::run()
+{
+  qint64 startupTime = m_timer.elapsed();
+  QElapsedTimer phase;
+
+  if (! gui || ! gMainWindow) {
+      fprintf(stderr, "%s did not initialize.\n", VER_PRODUCTNAME_STR);
+      m_modalTimer.stop();
+      return m_exitCode = ExitLoad;
+    }
+
+  gui->m_batchExporting = true;
+  connect(gui, SIGNAL(messageSig(bool,QString)), this, SLOT(message(bool,QString)));
+
+  // renderer overrides, for this run only - the settings are not saved
+  if (! m_renderer.isEmpty() && m_renderer != Preferences::preferredRenderer) {
+      Preferences::preferredRenderer = m_renderer;
+      Preferences::useLDViewSingleCall =
+          m_renderer == "LDView" && Preferences::enableLDViewSingleCall;
+      Render::setRenderer(m_renderer);
+      if (m_renderer == "LDGLite")
+        gui->partWorkerLdgLiteSearchDirs.populateLdgLiteSearchDirs();
+    }
+  if (m_processes > 0)
+    Preferences::rendererProcesses = m_processes;
+  if (m_exportThreads > 0)
+    Preferences::exportThreads = m_exportThreads;
+  if (m_pngCompression >= 0)
+    Preferences::exportCompression = m_pngCompression;
+  if (m_pdfImageDpi > 0)
+    Preferences::pdfImageDpi = m_pdfImageDpi;
+
+  // load the model
+  phase.start();
+  QFileInfo modelInfo(m_modelFile);
+  if (! modelInfo.exists()) {
+      fprintf(stderr, "Unable to load file %s.\n", qPrintable(m_modelFile));
+      m_modalTimer.stop();
+      return m_exitCode = ExitLoad;
+    }
+
+  // openFile makes the cache folders and the fade parts in the cache dir
+  if (! m_cacheDir.isEmpty()) {
+      QDir cache(m_cacheDir);
+      if (! cache.exists() && ! cache.mkpath(".")) {
+          fprintf(stderr, "Unable to create cache folder %s.\n", qPrintable(m_cacheDir));
+          m_modalTimer.stop();
+          return m_exitCode = ExitUsage;
+        }
+      gui->m_batchCacheDir = cache.absolutePath();
+    }
+
+  QString modelFile = modelInfo.absoluteFilePath();
+  gui->openFile(modelFile);
+  gui->countPages();
+  qint64 loadTime = phase.elapsed();
+
+  if (gui->maxPages < 1 || m_failed) {
+      fprintf(stderr, "Unable to load file %s.\n", qPrintable(m_modelFile));
+      m_modalTimer.stop();
+      return m_exitCode = ExitLoad;
+    }
+
+  fprintf(stdout, "Loaded %s, %d pages.\n", qPrintable(m_modelFile), gui->maxPages);
+  fflush(stdout);
+
+  // pick the pages
+  if (m_pageRange.isEmpty()) {
+      gui->exportOption  = EXPORT_ALL_PAGES;
+    } else {
+      foreach (QString range, m_pageRange.split(",")) {
+          if (range.split("-").last().toInt() > gui->maxPages) {
+              fprintf(stderr, "Page range %s is beyond the last page %d.\n",
+                      qPrintable(range), gui->maxPages);
+              m_modalTimer.stop();
+              return m_exitCode = ExitUsage;
+            }
+        }
+      gui->exportOption  = EXPORT_PAGE_RANGE;
+      gui->pageRangeText = m_pageRange;
+    }
+
+  // export
+  phase.start();
+  bool exported;
+  gui->setExporting(true);
+  if (m_format == "pdf") {
+      QString fileName = m_output.isEmpty() ?
+            modelInfo.absolutePath() + "/" + modelInfo.baseName() + ".pdf" :
+            QFileInfo(m_output).absoluteFilePath();
+      gui->exportType = EXPORT_PDF;
+      exported = gui->exportPdfFile(fileName);
+    } else {
+      QString directoryName = m_output.isEmpty() ?
+            modelInfo.absolutePath() : QFileInfo(m_output).absoluteFilePath();
+      QDir().mkpath(directoryName);
+      gui->exportType = m_format == "png" ? EXPORT_PNG :
+                        m_format == "jpg" ? EXPORT_JPG : EXPORT_BMP;
+      exported = gui->exportImageFiles("." + m_format, directoryName);
+    }
+  gui->setExporting(false);
+  qint64 exportTime = phase.elapsed();
+
+  m_modalTimer.stop();
+
+  if (! exported || m_failed)
+    m_exitCode = ExitExport;
+
+  fprintf(stdout, "Startup:    %s\n", qPrintable(gui->elapsedTime(startupTime)));
+  fprintf(stdout, "Load model: %s\n", qPrintable(gui->elapsedTime(loadTime)));
+  fprintf(stdout, "Export:     %s\n", qPrintable(gui->elapsedTime(exportTime)));
+  fprintf(stdout, "Total:      %s\n", qPrintable(gui->elapsedTime(m_timer.elapsed())));
+  fprintf(stdout, "Export %s %s.\n", qPrintable(m_format),
+          m_exitCode == ExitOk ? "completed" : "failed");
+  fflush(stdout);
+
+  return m_exitCode;
+}
+
+/*
+ * Nothing answers a message box here, so log what it says, count it as a
+ * failure and close it.
+ */
+
+void BatchExport::dismissModal()
+{
+  QWidget *modal = QApplication::activeModalWidget();
+  if (! modal)
+    return;
+
+  QMessageBox *box = qobject_cast<QMessageBox *>(modal);
+  QString text = box ? box->text() + " " + box->informativeText() : modal->windowTitle();
+  text.remove(QRegExp("<[^>]*>"));
+
+  fprintf(stderr, "%s\n", qPrintable(text.simplified()));
+  logError() << "Batch export closed dialog:" << text.simplified();
+
+  m_failed = true;
+  modal->close();
+}
+
+void BatchExport::message(bool status, QString message)
+{
+  if (status)
+    return;
+
+  fprintf(stderr, "%s\n", qPrintable(message));
+  m_failed = true;
+}
@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 - 2017 Trevor SANDY. All rights reserved.
+**
+** This file may be used under the terms of the
+** GNU General Public Liceense (GPL) version 3.0
+** which accompanies this distribution, and is
+** available at http://www.gnu.org/licenses/gpl.html
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+/****************************************************************************
+ *
+ * Command line export.  With -x/--export on the command line LPub3D loads
+ * the model, exports it to pdf or images and exits without showing any
+ * window, e.g.
+ *
+ *   QT_QPA_PLATFORM=offscreen lpub3d -x pdf -o model.pdf -p 1-10 model.mpd
+ *
+ * Progress goes to stdout, errors to stderr, and the exit code tells how
+ * the export went (see ExitCode).  Message boxes raised on the way are
+ * logged and closed so nothing waits on a user.
+ *
+ ***************************************************************************/
+
+#ifndef BATCHEXPORT_H
+#define BATCHEXPORT_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+
+class BatchExport : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum ExitCode {
+    ExitOk     = 0,   // all pages exported
+    ExitUsage  = 1,   // bad command line
+    ExitLoad   = 2,   // the model or the application did not load
+    ExitExport = 3    // the export failed or reported errors
+  };
+
+  BatchExport();
+
+  /* Takes the export options and the model file out of argv so the 3D
+     Viewer does not see them.  Returns false on a bad command line. */
+  bool parse(int &argc, char **argv);
+
+  bool active()        { return m_active; }      // -x was given
+  bool helpRequested() { return m_help; }        // -?/--help was given
+  int  exitCode()      { return m_exitCode; }
+  void setExitCode(int code) { m_exitCode = code; }
+
+  int run();                                     // load, export, report
+
+  static void usage();
+
+private slots:
+  void dismissModal();                           // close any message box
+  void message(bool status, QString message);    // Gui messageSig
+
+private:
+  bool           m_active;
+  bool           m_help;
+  bool           m_failed;
+  int            m_exitCode;
+
+  QString        m_modelFile;
+  QString        m_format;          // pdf, png, jpg or bmp
+  QString        m_output;          // pdf file or image folder
+  QString        m_pageRange;       // e.g. 1-5,8 - all pages when empty
+  QString        m_renderer;        // LDGLite, LDView or POVRay
+  int            m_processes;       // concurrent renderer processes, 0 keeps the preference
+  int            m_exportThreads;   // image writer threads, 0 keeps the preference
+  int            m_pngCompression;  // 0 to 9, -1 keeps the preference
+  int            m_pdfImageDpi;     // most pdf image resolution, 0 keeps the preference
+  QString        m_cacheDir;        // where LPub3D/tmp, assem and parts go
+
+  QTimer         m_modalTimer;
+  QElapsedTimer  m_timer;           // started when the command line is parsed
+};
+
+#endif // BATCHEXPORT_H
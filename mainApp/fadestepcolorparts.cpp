@@ -52,15 +52,10 @@ FadeStepColorParts::FadeStepColorParts()
     }
 }
 
-const bool &FadeStepColorParts::isStaticColorPart(QString part)
+bool FadeStepColorParts::isStaticColorPart(const QString &part)
 {
-    if (fadeStepStaticColorParts.contains(part.toLower().trimmed())) {
-        result = true;
-        return result;
-    } else {
-        result = false;
-        return result;
-    }
+    // no shared result here, writeToTmp calls this from several threads
+    return fadeStepStaticColorParts.contains(part.toLower().trimmed());
 }
 
 const bool &FadeStepColorParts::getStaticColorPartInfo(QString &part){
@@ -27,7 +27,7 @@ class FadeStepColorParts
     static QMap<QString, QString>   fadeStepStaticColorParts;
   public:
     FadeStepColorParts();
-    static const bool &isStaticColorPart(QString part);
+    static bool isStaticColorPart(const QString &part);
     static const bool &getStaticColorPartInfo(QString &part);
     static const QString &staticColorPartPath(QString part);
 };
@@ -48,6 +48,7 @@
 #include "textitem.h"
 #include "rotateiconitem.h"
 #include "paths.h"
+#include "rendercache.h"
 
 /*
  * We need to draw page every time there is change to the LDraw file.
@@ -556,9 +557,9 @@ int Gui::addGraphicsPageItems(
               Step *step = dynamic_cast<Step *>(range->list[0]);
               if (step && step->relativeType == StepType) {
 
-                  // populate page pixmaps - when using LDView Single Call
+                  // populate page pixmaps - when using LDView Single Call or the render queue
 
-                  if (renderer->useLDViewSCall()){
+                  if (renderer->useLDViewSCall() || renderer->useRenderQueue()){
                       addStepImageGraphics(step);
                     }
 
@@ -723,8 +724,8 @@ int Gui::addGraphicsPageItems(
       // qDebug() << "List relative type: " << RelNames[range->relativeType];
       // We've got a page that contains step groups, so add it
 
-      // LDView generate multistep pixamps
-      if (renderer->useLDViewSCall() &&
+      // LDView or render queue generate multistep pixamps
+      if ((renderer->useLDViewSCall() || renderer->useRenderQueue()) &&
           page->list.size()) {
           for (int i = 0; i < page->list.size(); i++){
               Range *range = dynamic_cast<Range *>(page->list[i]);
@@ -818,13 +819,17 @@ int Gui::addGraphicsPageItems(
 /*
  * Add step image graphics
  * This function recurses the step's model to add images.
- * Call only if using LDView Single Call (useLDViewsCall=true)
+ * Call only if using LDView Single Call (useLDViewsCall=true) or the
+ * render queue (useRenderQueue=true)
  */
 int Gui::addStepImageGraphics(Step *step) {
   int retVal = 0;
-  step->csiPixmap.load(step->pngName);
-  step->csiPlacement.size[0] = step->csiPixmap.width();
-  step->csiPlacement.size[1] = step->csiPixmap.height();
+  imageCache.load(step->pngName,&step->csiPixmap);
+  // size from the full resolution image, the pixmap may be scaled
+  QImage image;
+  imageCache.image(step->pngName,image);
+  step->csiPlacement.size[0] = image.width();
+  step->csiPlacement.size[1] = image.height();
   // process callout's step(s) image(s)
   for (int k = 0; k < step->list.size(); k++) {
       if (step->list[k]->relativeType == CalloutType) {
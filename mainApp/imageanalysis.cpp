@@ -0,0 +1,292 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 - 2017 Trevor SANDY. All rights reserved.
+**
+** This file may be used under the terms of the
+** GNU General Public Liceense (GPL) version 3.0
+** which accompanies this distribution, and is
+** available at http://www.gnu.org/licenses/gpl.html
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include "imageanalysis.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define IMAGEANALYSIS_SSE2
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define IMAGEANALYSIS_NEON
+#  include <arm_neon.h>
+#endif
+
+/* 32 bit pixels with alpha, in the layout qAlpha expects */
+static QImage argb32(const QImage &image)
+{
+  switch (image.format()) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+      return image;
+    default:
+      return image.convertToFormat(QImage::Format_ARGB32);
+    }
+}
+
+/* true if any of the four pixels at line has (pixel & mask) set */
+static inline bool anySet4(const quint32 *line, quint32 mask)
+{
+#if defined(IMAGEANALYSIS_SSE2)
+  __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(line));
+  __m128i masked = _mm_and_si128(pixels, _mm_set1_epi32(int(mask)));
+  return _mm_movemask_epi8(_mm_cmpeq_epi32(masked, _mm_setzero_si128())) != 0xffff;
+#elif defined(IMAGEANALYSIS_NEON)
+  uint32x4_t set  = vtstq_u32(vld1q_u32(line), vdupq_n_u32(mask));
+  uint32x2_t half = vorr_u32(vget_low_u32(set), vget_high_u32(set));
+  return (vget_lane_u32(half, 0) | vget_lane_u32(half, 1)) != 0;
+#else
+  return ((line[0] | line[1] | line[2] | line[3]) & mask) != 0;
+#endif
+}
+
+int ImageAnalysis::firstSet(const quint32 *line, int width, quint32 mask)
+{
+  int x = 0;
+  for ( ; x + 4 <= width; x += 4) {
+      if (anySet4(line + x, mask))
+        break;
+    }
+  for ( ; x < width; x++) {
+      if (line[x] & mask)
+        return x;
+    }
+  return -1;
+}
+
+int ImageAnalysis::lastSet(const quint32 *line, int width, quint32 mask)
+{
+  int x = width;
+  for ( ; x >= 4; x -= 4) {
+      if (anySet4(line + x - 4, mask))
+        break;
+    }
+  for (x--; x >= 0; x--) {
+      if (line[x] & mask)
+        return x;
+    }
+  return -1;
+}
+
+QRect ImageAnalysis::contentBounds(const QImage &source)
+{
+  QImage image = argb32(source);
+  int width    = image.width();
+  int top, bottom;
+
+  for (top = 0; top < image.height(); top++) {
+      const quint32 *line = reinterpret_cast<const quint32 *>(image.constScanLine(top));
+      if (firstSet(line, width, 0xffffffff) != -1)
+        break;
+    }
+  if (top == image.height())
+    return QRect();
+
+  for (bottom = image.height() - 1; bottom > top; bottom--) {
+      const quint32 *line = reinterpret_cast<const quint32 *>(image.constScanLine(bottom));
+      if (lastSet(line, width, 0xffffffff) != -1)
+        break;
+    }
+
+  // a row only needs scanning outside the columns already taken
+  int left  = width;
+  int right = -1;
+  for (int y = top; y <= bottom; y++) {
+      const quint32 *line = reinterpret_cast<const quint32 *>(image.constScanLine(y));
+      int first = firstSet(line, left, 0xffffffff);
+      if (first != -1)
+        left = first;
+      int last = lastSet(line + right + 1, width - right - 1, 0xffffffff);
+      if (last != -1)
+        right += last + 1;
+    }
+
+  return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+void ImageAnalysis::edgeProfiles(const QImage &source, QList<int> &left, QList<int> &right)
+{
+  int width  = source.width();
+  int height = source.height();
+
+  left.reserve(left.size() + height);
+  right.reserve(right.size() + height);
+
+  if (! source.hasAlphaChannel()) {
+      for (int y = 0; y < height; y++) {
+          left  << 0;
+          right << width - 1;
+        }
+      return;
+    }
+
+  QImage image = argb32(source);
+
+  for (int y = 0; y < height; y++) {
+      const quint32 *line = reinterpret_cast<const quint32 *>(image.constScanLine(y));
+      int first = firstSet(line, width, 0xff000000);
+      if (first == -1) {
+          left  << width - 1;
+          right << 0;
+        } else {
+          left  << first;
+          right << first + lastSet(line + first, width - first, 0xff000000);
+        }
+    }
+}
+
+/* The pixel at a time versions selfCheck compares against */
+static QRect referenceBounds(const QImage &source)
+{
+  QImage image = argb32(source);
+  QRect bounds;
+  for (int y = 0; y < image.height(); y++) {
+      const quint32 *line = reinterpret_cast<const quint32 *>(image.constScanLine(y));
+      for (int x = 0; x < image.width(); x++) {
+          if (line[x] != 0)
+            bounds |= QRect(x, y, 1, 1);
+        }
+    }
+  return bounds;
+}
+
+static void referenceEdges(const QImage &source, QList<int> &left, QList<int> &right)
+{
+  QImage image = argb32(source);
+  int width = image.width();
+  for (int y = 0; y < image.height(); y++) {
+      const quint32 *line = reinterpret_cast<const quint32 *>(image.constScanLine(y));
+      int first = -1, last = -1;
+      for (int x = 0; x < width; x++) {
+          if (! source.hasAlphaChannel() || qAlpha(line[x]) != 0) {
+              if (first == -1)
+                first = x;
+              last = x;
+            }
+        }
+      left  << (first == -1 ? width - 1 : first);
+      right << (last  == -1 ? 0 : last);
+    }
+}
+
+/* A transparent image with a few opaque blobs, and some pixels that are
+   transparent but not 0, from a fixed seed so runs repeat */
+static QImage syntheticImage(int width, int height, int blobs, quint32 &seed)
+{
+  QImage image(width, height, QImage::Format_ARGB32);
+  image.fill(0);
+  for (int i = 0; i < blobs; i++) {
+      seed = seed * 1103515245 + 12345;
+      int x = int((seed >> 8) % quint32(width));
+      seed = seed * 1103515245 + 12345;
+      int y = int((seed >> 8) % quint32(height));
+      seed = seed * 1103515245 + 12345;
+      int w = 1 + int((seed >> 8) % quint32(qMax(1, width / 8)));
+      seed = seed * 1103515245 + 12345;
+      int h = 1 + int((seed >> 8) % quint32(qMax(1, height / 8)));
+      QRgb colour = (i % 3 == 0) ? qRgba(0, 0, 255, 0) : qRgba(255, 0, 0, 255);
+      for (int row = y; row < qMin(height, y + h); row++) {
+          QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(row));
+          for (int col = x; col < qMin(width, x + w); col++)
+            line[col] = colour;
+        }
+    }
+  return image;
+}
+
+bool ImageAnalysis::selfCheck(QString &report)
+{
+  QList<QImage> images;
+  quint32 seed = 1;
+
+  // widths either side of the four pixel kernel, edges and empty images
+  for (int width = 1; width <= 13; width++) {
+      images << syntheticImage(width, 7, 2, seed);
+      QImage empty(width, 3, QImage::Format_ARGB32);
+      empty.fill(0);
+      images << empty;
+      QImage corners(width, 5, QImage::Format_ARGB32);
+      corners.fill(0);
+      corners.setPixel(width - 1, 4, qRgba(0, 255, 0, 255));
+      corners.setPixel(0, 0, qRgba(0, 255, 0, 255));
+      images << corners;
+    }
+  for (int i = 0; i < 40; i++)
+    images << syntheticImage(17 + i * 7, 9 + i * 3, 1 + i % 6, seed);
+  images << syntheticImage(64, 48, 5, seed).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+  images << syntheticImage(61, 33, 5, seed).convertToFormat(QImage::Format_RGB32);
+  images << syntheticImage(37, 29, 4, seed).convertToFormat(QImage::Format_Indexed8);
+
+  QStringList failures;
+  for (int i = 0; i < images.size(); i++) {
+      const QImage &image = images[i];
+      QRect expected = referenceBounds(image);
+      QRect bounds   = contentBounds(image);
+      if (bounds != expected) {
+          failures << QString("image %1 (%2 x %3) bounds %4,%5 %6 x %7, expected %8,%9 %10 x %11")
+                      .arg(i).arg(image.width()).arg(image.height())
+                      .arg(bounds.x()).arg(bounds.y()).arg(bounds.width()).arg(bounds.height())
+                      .arg(expected.x()).arg(expected.y()).arg(expected.width()).arg(expected.height());
+        }
+      QList<int> left, right, expectedLeft, expectedRight;
+      edgeProfiles(image, left, right);
+      referenceEdges(image, expectedLeft, expectedRight);
+      if (left != expectedLeft || right != expectedRight) {
+          failures << QString("image %1 (%2 x %3) edge profiles differ")
+                      .arg(i).arg(image.width()).arg(image.height());
+        }
+    }
+
+  // timing, a render sized image with little in it
+  QImage large = syntheticImage(2000, 2000, 12, seed);
+  const int runs = 5;
+  QElapsedTimer timer;
+  QRect bounds;
+  QList<int> left, right;
+
+  timer.start();
+  for (int i = 0; i < runs; i++) {
+      bounds = contentBounds(large);
+      left.clear(); right.clear();
+      edgeProfiles(large, left, right);
+    }
+  qint64 scanTime = timer.elapsed();
+
+  timer.start();
+  for (int i = 0; i < runs; i++) {
+      bounds = referenceBounds(large);
+      left.clear(); right.clear();
+      referenceEdges(large, left, right);
+    }
+  qint64 referenceTime = timer.elapsed();
+
+#if defined(IMAGEANALYSIS_SSE2)
+  QString kernel("SSE2");
+#elif defined(IMAGEANALYSIS_NEON)
+  QString kernel("NEON");
+#else
+  QString kernel("scalar");
+#endif
+
+  report = QString("Image analysis (%1) checked %2 images, %3 failed. "
+                   "%4 x 2000 x 2000 bounds and edges took %5 ms, %6 ms a pixel at a time.")
+                   .arg(kernel).arg(images.size()).arg(failures.size())
+                   .arg(runs).arg(scanTime).arg(referenceTime);
+  if (! failures.isEmpty())
+    report += "\n" + failures.join("\n");
+
+  return failures.isEmpty();
+}
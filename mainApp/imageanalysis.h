@@ -0,0 +1,54 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 - 2017 Trevor SANDY. All rights reserved.
+**
+** This file may be used under the terms of the
+** GNU General Public Liceense (GPL) version 3.0
+** which accompanies this distribution, and is
+** available at http://www.gnu.org/licenses/gpl.html
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+/****************************************************************************
+ *
+ * Pixel scans over rendered CSI and PLI images.  The images are read a
+ * scan line at a time as 32 bit pixels, four pixels per compare where
+ * SSE2 or NEON is there, rather than through QImage::pixel and QColor.
+ *
+ ***************************************************************************/
+
+#ifndef IMAGEANALYSIS_H
+#define IMAGEANALYSIS_H
+
+#include <QImage>
+#include <QRect>
+#include <QList>
+#include <QString>
+
+class ImageAnalysis
+{
+public:
+  /* The smallest rectangle holding every pixel that is not 0 (transparent
+     black), or a null rect if there are none. */
+  static QRect contentBounds(const QImage &image);
+
+  /* For each row, the first and the last x with alpha other than 0,
+     appended to left and right.  Rows with nothing in them get
+     width - 1 on the left and 0 on the right. */
+  static void edgeProfiles(const QImage &image, QList<int> &left, QList<int> &right);
+
+  /* The first and the last index in line[0..width) with (pixel & mask)
+     not 0, or -1. */
+  static int firstSet(const quint32 *line, int width, quint32 mask);
+  static int lastSet (const quint32 *line, int width, quint32 mask);
+
+  /* Compares contentBounds and edgeProfiles with a pixel at a time
+     reference on synthetic images, then times both on a large one.
+     Returns false on any difference; report gets the details. */
+  static bool selfCheck(QString &report);
+};
+
+#endif // IMAGEANALYSIS_H
@@ -38,6 +38,8 @@
 #include <QFile>
 #include <QList>
 #include <QRegExp>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 #include "paths.h"
 
 #include "lc_application.h"
@@ -73,6 +75,12 @@ LDrawSubFile::LDrawSubFile(
   _generated = generated;
   _fadePosition = 0;
   _startPageNumber = 0;
+  _parsedValid = false;
+  _steps = 0;
+  _parts = 0;
+  _referencesValid = false;
+  _partCount = 0;
+  _partCountValid = false;
 }
 
 void LDrawFile::empty()
@@ -81,6 +89,9 @@ void LDrawFile::empty()
   _subFileOrder.clear();
   _mpd = false;
   _pieces = 0;
+  _partTypes.clear();
+  _contentVersion++;
+  _referencesVersion++;
 }
 
 /* Add a new subFile */
@@ -93,13 +104,36 @@ void LDrawFile::insert(const QString &mcFileName,
 {
   QString    fileName = mcFileName.toLower();
   QMap<QString, LDrawSubFile>::iterator i = _subFiles.find(fileName);
+  bool       added = i == _subFiles.end();
 
-  if (i != _subFiles.end()) {
+  if ( ! added) {
+
+    /* callouts insert their generated models each time they are drawn,
+       mostly with the same parts, which changes nothing */
+
+    if (i.value()._contents       == contents &&
+        i.value()._unofficialPart == unofficialPart &&
+        i.value()._generated      == generated) {
+      i.value()._datetime = datetime;
+      return;
+    }
     _subFiles.erase(i);
   }
   LDrawSubFile subFile(contents,datetime,unofficialPart,generated);
   _subFiles.insert(fileName,subFile);
   _subFileOrder << fileName;
+  _contentVersion++;
+
+  // lines referring to a new file now resolve differently, and the
+  // counts of the files using this one change either way
+  for (i = _subFiles.begin(); i != _subFiles.end(); ++i) {
+    if (added) {
+      i.value()._parsedValid = false;
+    }
+    i.value()._referencesValid = false;
+    i.value()._partCountValid = false;
+  }
+  _referencesVersion++;
 }
 
 /* return the number of lines in the file */
@@ -200,6 +234,151 @@ bool LDrawFile::isSubmodel(const QString &file)
   return false;
 }
 
+/*
+ * A hash of a file's lines and of every submodel it uses, so two uses of
+ * the same content hash the same no matter when the files were saved.
+ * Hashes are kept until the content version changes.
+ */
+
+QByteArray LDrawFile::contentHash(const QString &mcFileName)
+{
+  QString fileName = mcFileName.toLower();
+
+  if (_contentHashVersion != _contentVersion) {
+    _contentHashes.clear();
+    _contentHashVersion = _contentVersion;
+  }
+
+  QHash<QString, QByteArray>::const_iterator h = _contentHashes.constFind(fileName);
+  if (h != _contentHashes.constEnd()) {
+    return h.value();
+  }
+
+  QMap<QString, LDrawSubFile>::iterator i = _subFiles.find(fileName);
+  if (i == _subFiles.end()) {
+    return QByteArray();
+  }
+
+  _contentHashes.insert(fileName,QByteArray());  // stop self reference recursion
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  LDrawPartLine part;
+  const QStringList &contents = i.value()._contents;
+  for (int j = 0; j < contents.size(); j++) {
+    hash.addData(contents[j].toUtf8());
+    hash.addData("\n",1);
+    if (splitPartLine(contents[j],part)) {
+      hash.addData(contentHash(part.type.toString()));
+    }
+  }
+
+  QByteArray result = hash.result();
+  _contentHashes.insert(fileName,result);
+  return result;
+}
+
+/*
+ * Parse one line the way the traversals see it: trimmed, with any
+ * 0 GHOST prefix set aside.
+ */
+
+void LDrawFile::parseLine(const QString &text, LDrawLine &parsed)
+{
+  QString line = text.trimmed();
+
+  if (line.startsWith("0 GHOST ")) {
+    line = line.mid(8).trimmed();
+    parsed.ghost = true;
+  }
+
+  if (line.isEmpty()) {
+    return;
+  }
+
+  LDrawPartLine part;
+  char kind = line.at(0).toLatin1();
+
+  if (kind == '1') {
+    bool isPart = splitPartLine(line,part);
+
+    // split() drops a WRITE after the 1, the traversals take what is left
+    if ( ! isPart) {
+      QVector<QStringRef> tokens;
+      split(line,tokens);
+      if (tokens.size() == 15) {
+        part.color = tokens[1];
+        for (int j = 0; j < 12; j++) {
+          part.values[j] = tokenToFloat(tokens[j+2]);
+        }
+        part.type = tokens[14];
+        isPart    = true;
+      }
+    }
+
+    if (isPart) {
+      parsed.kind     = 1;
+      parsed.color    = part.color.toString();
+      parsed.type     = part.type.toString();
+      parsed.mirrored = part.mirrored();
+      parsed.subFile  = _subFiles.contains(parsed.type.toLower());
+      for (int j = 0; j < 12; j++) {
+        parsed.matrix[j] = part.values[j];
+      }
+    }
+  } else if (kind >= '2' && kind <= '5') {
+    QVector<QStringRef> tokens;
+    split(line,tokens);
+    parsed.kind  = kind - '0';
+    parsed.color = tokens.size() > 1 ? tokens[1].toString() : QString();
+  } else if (kind == '0') {
+    parsed.kind = 0;
+    split(line,parsed.tokens);
+  }
+}
+
+const QVector<LDrawLine> &LDrawFile::parsedLines(const QString &mcFileName)
+{
+  QString fileName = mcFileName.toLower();
+  QMap<QString, LDrawSubFile>::iterator i = _subFiles.find(fileName);
+
+  if (i == _subFiles.end()) {
+    return _emptyParsed;
+  }
+
+  LDrawSubFile &subFile = i.value();
+  if ( ! subFile._parsedValid) {
+    QElapsedTimer timer;
+    timer.start();
+    qint64 characters = 0;
+
+    subFile._parsed.clear();
+    subFile._parsed.resize(subFile._contents.size());
+    for (int j = 0; j < subFile._contents.size(); j++) {
+      parseLine(subFile._contents[j],subFile._parsed[j]);
+      characters += subFile._contents[j].size();
+    }
+    subFile._parsedValid = true;
+
+    // tokenizer throughput, in lines and characters a millisecond
+    qint64 microseconds = qMax(timer.nsecsElapsed() / 1000, qint64(1));
+    logTrace() << "Parsed" << subFile._contents.size() << "lines of" << fileName
+               << "in" << microseconds << "microseconds,"
+               << qint64(subFile._contents.size()) * 1000 / microseconds << "lines and"
+               << characters * 1000 / microseconds << "characters a millisecond.";
+  }
+  return subFile._parsed;
+}
+
+LDrawLine LDrawFile::parsedLine(const QString &fileName, int lineNumber)
+{
+  const QVector<LDrawLine> &parsed = parsedLines(fileName);
+
+  if (lineNumber >= 0 && lineNumber < parsed.size()) {
+    return parsed[lineNumber];
+  }
+  return LDrawLine();
+}
+
 bool LDrawFile::modified()
 {
   QString key;
@@ -243,7 +422,10 @@ void LDrawFile::setContents(const QString     &mcFileName,
     i.value()._modified = true;
     //i.value()._datetime = QDateTime::currentDateTime();
     i.value()._contents = contents;
+    i.value()._parsedValid = false;
     i.value()._changedSinceLastWrite = true;
+    _contentVersion++;
+    staleReferences(fileName);
   }
 }
 
@@ -336,9 +518,16 @@ void LDrawFile::insertLine(const QString &mcFileName, int lineNumber, const QStr
 
   if (i != _subFiles.end()) {
     i.value()._contents.insert(lineNumber,line);
+    if (i.value()._parsedValid) {
+      LDrawLine parsed;
+      parseLine(line,parsed);
+      i.value()._parsed.insert(lineNumber,parsed);
+    }
     i.value()._modified = true;
  //   i.value()._datetime = QDateTime::currentDateTime();
     i.value()._changedSinceLastWrite = true;
+    _contentVersion++;
+    staleReferences(fileName);
   }
 }
   
@@ -349,9 +538,15 @@ void LDrawFile::replaceLine(const QString &mcFileName, int lineNumber, const QSt
 
   if (i != _subFiles.end()) {
     i.value()._contents[lineNumber] = line;
+    if (i.value()._parsedValid) {
+      i.value()._parsed[lineNumber] = LDrawLine();
+      parseLine(line,i.value()._parsed[lineNumber]);
+    }
     i.value()._modified = true;
 //    i.value()._datetime = QDateTime::currentDateTime();
     i.value()._changedSinceLastWrite = true;
+    _contentVersion++;
+    staleReferences(fileName);
   }
 }
 
@@ -362,9 +557,14 @@ void LDrawFile::deleteLine(const QString &mcFileName, int lineNumber)
 
   if (i != _subFiles.end()) {
     i.value()._contents.removeAt(lineNumber);
+    if (i.value()._parsedValid) {
+      i.value()._parsed.remove(lineNumber);
+    }
     i.value()._modified = true;
 //    i.value()._datetime = QDateTime::currentDateTime();
     i.value()._changedSinceLastWrite = true;
+    _contentVersion++;
+    staleReferences(fileName);
   }
 }
 
@@ -489,7 +689,12 @@ void LDrawFile::loadFile(const QString &fileName)
     
     QApplication::restoreOverrideCursor();
 
-    countParts(topLevelFile());
+    QElapsedTimer timer;
+    timer.start();
+
+    _pieces = countParts(topLevelFile());
+
+    logTrace() << "Count parts took" << timer.elapsed() << "milliseconds.";
 
     emit gui->messageSig(true, QString("%1 model file %2 loaded. Count %3 parts")
                                        .arg(mpd ? "MPD" : "LDR")
@@ -802,131 +1007,236 @@ bool LDrawFile::mirrored(
   //return a*(e*i - f*h) - b*(d*i - f*g) + c*(d*h - e*g) < 0;
 }
 
-void LDrawFile::countInstances(const QString &mcFileName, bool isMirrored, bool callout)
+static bool lpubMeta(
+  const QStringList &tokens,
+  const char        *command,
+  const char        *action,
+  const char        *option = NULL)
 {
-  //logTrace() << QString("countInstances, File: %1, Mirrored: %2, Callout: %3").arg(mcFileName,(isMirrored?"Yes":"No"),(callout?"Yes":"No"));
+  return tokens.size() == (option ? 5 : 4) &&
+         tokens[0] == "0" &&
+         (tokens[1] == "LPUB" || tokens[1] == "!LPUB") &&
+         tokens[2] == command &&
+         tokens[3] == action &&
+         (! option || tokens[4] == option);
+}
 
+/*
+ * Work out what a file uses and adds up to by itself from its parsed
+ * lines: the submodels it references, its steps and the parts that are
+ * not in submodels.  This is kept until the file is edited, so only files
+ * that changed are read again when the counts are asked for.
+ */
+
+void LDrawFile::buildReferences(const QString &mcFileName)
+{
   QString fileName = mcFileName.toLower();
-  bool partsAdded = false;
-  bool noStep = false;
-  bool stepIgnore = false;
-  
   QMap<QString, LDrawSubFile>::iterator f = _subFiles.find(fileName);
-  if (f != _subFiles.end()) {
-    // count mirrored instance automatically
-    if (f->_beenCounted) {
-      if (isMirrored) {
-        ++f->_mirrorInstances;
-      } else {
-        ++f->_instances;
+  if (f == _subFiles.end()) {
+    return;
+  }
+
+  const QVector<LDrawLine> &parsed = parsedLines(fileName);
+
+  QVector<LDrawReference> references;
+  int  steps      = 0;
+  int  parts      = 0;
+  bool partsAdded = false;
+  bool noStep     = false;
+  bool callout    = false;
+  bool ignore     = false;
+
+  for (int i = 0; i < parsed.size(); i++) {
+    const LDrawLine &line = parsed[i];
+
+    // parts, ghosted parts and submodels
+    if (line.kind == 1) {
+      if (line.subFile) {
+        LDrawReference reference;
+        reference.name     = line.type.toLower();
+        reference.mirrored = line.mirrored;
+        reference.callout  = callout;
+        reference.ignore   = ignore;
+        reference.ghost    = line.ghost;
+        references.append(reference);
+      } else if ( ! ignore && isPartType(line.type)) {
+        parts++;
       }
-      return;
+      partsAdded = true;
+      continue;
     }
-    // get content size and reset numSteps
-    int j = f->_contents.size();
-    f->_numSteps = 0;
-
-    // process submodel content...
-    for (int i = 0; i < j; i++) {
-      QStringList tokens;
-      QString line = f->_contents[i];
-      split(line,tokens);
-      
-      /* Sorry, but models that are callouts are not counted as instances */
-          // called out
-      if (tokens.size() == 4 && 
-          tokens[0] == "0" && 
-          (tokens[1] == "LPUB" || tokens[1] == "!LPUB") && 
-          tokens[2] == "CALLOUT" && 
-          tokens[3] == "BEGIN") {
-        partsAdded = true;
-           //process callout content
-        for (++i; i < j; i++) {
-          split(f->_contents[i],tokens);
-          if (tokens.size() == 15 && tokens[0] == "1") {
-            if (contains(tokens[14]) && ! stepIgnore) {
-              countInstances(tokens[14],mirrored(tokens),true);
-            }
-          } else if (tokens.size() == 4 &&
-              tokens[0] == "0" && 
-              (tokens[1] == "LPUB" || tokens[1] == "!LPUB") && 
-              tokens[2] == "CALLOUT" && 
-              tokens[3] == "END") {
-            
+
+    if (line.kind != 0) {
+      continue;
+    }
+
+    const QStringList &tokens = line.tokens;
+
+    /* Sorry, but models that are callouts are not counted as instances,
+       and the steps of a callout are not steps of this file */
+    if (lpubMeta(tokens,"CALLOUT","BEGIN")) {
+      callout    = true;
+      partsAdded = true;
+    } else if (lpubMeta(tokens,"CALLOUT","END")) {
+      callout    = false;
+    } else if (lpubMeta(tokens,"PART","BEGIN","IGN")) {
+      ignore     = true;
+    } else if (lpubMeta(tokens,"PART","END")) {
+      ignore     = false;
+    } else if (callout) {
+      continue;
+    } else if (tokens.size() == 3 && tokens[0] == "0" &&
+              (tokens[1] == "LPUB" || tokens[1] == "!LPUB") &&
+               tokens[2] == "NOSTEP") {
+      noStep = true;
+    } else if (tokens.size() >= 2 && tokens[0] == "0" &&
+              (tokens[1] == "STEP" || tokens[1] == "ROTSTEP")) {
+      // parts added - increment step
+      steps     += partsAdded && ! noStep;
+      partsAdded = false;
+      noStep     = false;
+    }
+  }
+  //add step if parts added
+  steps += partsAdded && ! noStep;
+
+  LDrawSubFile &subFile = f.value();
+  if (subFile._references != references || subFile._steps != steps) {
+    _referencesVersion++;
+  }
+  subFile._references      = references;
+  subFile._steps           = steps;
+  subFile._parts           = parts;
+  subFile._referencesValid = true;
+}
+
+/*
+ * A file was edited: its references have to be read again, and its part
+ * count and that of every file using it, directly or not, are stale.
+ * Files further up whose counts are already stale are left alone, their
+ * users were marked with them.
+ */
+
+void LDrawFile::staleReferences(const QString &mcFileName)
+{
+  QString fileName = mcFileName.toLower();
+  QMap<QString, LDrawSubFile>::iterator f = _subFiles.find(fileName);
+  if (f == _subFiles.end()) {
+    return;
+  }
+  f.value()._referencesValid = false;
+
+  QStringList stale;
+  stale << fileName;
+  while ( ! stale.isEmpty()) {
+    QString name = stale.takeLast();
+    QMap<QString, LDrawSubFile>::iterator s = _subFiles.find(name);
+    if (s == _subFiles.end() || ! s.value()._partCountValid) {
+      continue;
+    }
+    s.value()._partCountValid = false;
+
+    for (QMap<QString, LDrawSubFile>::iterator u = _subFiles.begin(); u != _subFiles.end(); ++u) {
+      if (u.value()._partCountValid) {
+        const QVector<LDrawReference> &references = u.value()._references;
+        for (int i = 0; i < references.size(); i++) {
+          if (references[i].name == name) {
+            stale << u.key();
             break;
           }
         }
-        //lpub3d ignore part - so set ignore step
-      } else if (tokens.size() == 5 &&
-                 tokens[0] == "0" &&
-                 (tokens[1] == "LPUB" || tokens[1] == "!LPUB") &&
-                 tokens[2] == "PART" &&
-                 tokens[3] == "BEGIN"  &&
-                 tokens[4] == "IGN") {
-        stepIgnore = true;
-        // lpub3d part - so set include step
-      } else if (tokens.size() == 4 &&
-                 tokens[0] == "0" &&
-                 (tokens[1] == "LPUB" || tokens[1] == "!LPUB") &&
-                 tokens[2] == "PART"&&
-                 tokens[3] == "END") {
-        stepIgnore = false;
-        // no step
-      } else if (tokens.size() == 3 && tokens[0] == "0" &&
-                (tokens[1] == "LPUB" || tokens[1] == "!LPUB") &&
-                 tokens[2] == "NOSTEP") {
-        noStep = true;
-        // LDraw step or rotstep - so check if parts added
-      } else if (tokens.size() >= 2 && tokens[0] == "0" &&
-                (tokens[1] == "STEP" || tokens[1] == "ROTSTEP")) {
-        // parts added - increment step
-        if (partsAdded && ! noStep) {
-          int incr = (isMirrored && f->_mirrorInstances == 0) ||
-                     (!isMirrored && f->_instances == 0);
-          f->_numSteps += incr;
-        }
-        // reset partsAdded
-        partsAdded = false;
-        noStep = false;
-        // buffer exchange - do nothing
-      } else if (tokens.size() == 4 && tokens[0] == "0"
-                                     && tokens[1] == "BUFEXCHG") {
-        // check if subfile and process...
-      } else if (tokens.size() == 15 && tokens[0] == "1") {
-        bool containsSubFile = contains(tokens[14]);
-        if (containsSubFile && ! stepIgnore) {
-          countInstances(tokens[14],mirrored(tokens),false);
-        }
-        partsAdded = true;
-      }
-    }
-    //add step if parts added
-    f->_numSteps += partsAdded && ! noStep &&
-                       ( (isMirrored && f->_mirrorInstances == 0) ||
-                       (!isMirrored && f->_instances == 0) );
-    //
-    if ( ! callout) {
-      if (isMirrored) {
-        ++f->_mirrorInstances;
-      } else {
-        ++f->_instances;
       }
     }
+  }
+}
+
+/*
+ * Walk the submodel graph from the top.  The first use of a file sets its
+ * steps and goes on to the files it uses, every later use only adds an
+ * instance.
+ */
+
+void LDrawFile::countInstances(const QString &mcFileName, bool isMirrored, bool callout)
+{
+  //logTrace() << QString("countInstances, File: %1, Mirrored: %2, Callout: %3").arg(mcFileName,(isMirrored?"Yes":"No"),(callout?"Yes":"No"));
+
+  QString fileName = mcFileName.toLower();
+
+  QMap<QString, LDrawSubFile>::iterator f = _subFiles.find(fileName);
+  if (f == _subFiles.end()) {
+    return;
+  }
 
-  } // file end
+  // count mirrored instance automatically
+  if (f->_beenCounted) {
+    if (isMirrored) {
+      ++f->_mirrorInstances;
+    } else {
+      ++f->_instances;
+    }
+    return;
+  }
   f->_beenCounted = true;
+
+  if ( ! f->_referencesValid) {
+    buildReferences(fileName);
+  }
+  f->_numSteps = f->_steps;
+
+  const QVector<LDrawReference> references = f->_references;
+  for (int i = 0; i < references.size(); i++) {
+    const LDrawReference &reference = references[i];
+    if ( ! reference.ignore) {
+      countInstances(reference.name,reference.mirrored,reference.callout);
+    }
+  }
+
+  if ( ! callout) {
+    if (isMirrored) {
+      ++f->_mirrorInstances;
+    } else {
+      ++f->_instances;
+    }
+  }
 }
 
+/*
+ * Bring the instance and step counts up to date.  Only the files edited
+ * since the last count are read again, and when none of their references
+ * or step counts changed the counts stand as they are.
+ */
+
 void LDrawFile::countInstances()
 {
-  for (int i = 0; i < _subFileOrder.size(); i++) {
-    QString fileName = _subFileOrder[i].toLower();
-    QMap<QString, LDrawSubFile>::iterator it = _subFiles.find(fileName);
+  QElapsedTimer timer;
+  timer.start();
+
+  int rescanned = 0;
+  for (QMap<QString, LDrawSubFile>::iterator it = _subFiles.begin(); it != _subFiles.end(); ++it) {
+    if ( ! it->_referencesValid) {
+      buildReferences(it.key());
+      rescanned++;
+    }
+  }
+
+  if (_instancesVersion == _referencesVersion) {
+    logTrace() << "Count instances unchanged," << rescanned << "files rescanned, took"
+               << timer.elapsed() << "milliseconds.";
+    return;
+  }
+
+  for (QMap<QString, LDrawSubFile>::iterator it = _subFiles.begin(); it != _subFiles.end(); ++it) {
     it->_instances = 0;
     it->_mirrorInstances = 0;
     it->_beenCounted = false;
   }
   countInstances(topLevelFile(),false);
+  _instancesVersion = _referencesVersion;
+
+  logTrace() << "Count instances took"
+             << timer.elapsed() << "milliseconds"
+             << "for" << _subFileOrder.size() << "files,"
+             << rescanned << "rescanned.";
 }
 
 bool LDrawFile::saveMPDFile(const QString &fileName)
@@ -957,71 +1267,78 @@ bool LDrawFile::saveMPDFile(const QString &fileName)
     return true;
 }
 
-void LDrawFile::countParts(const QString &fileName){
+/*
+ * The number of parts in a file, its submodels' parts included once per
+ * use.  Each file's count is kept until it or a file it uses is edited.
+ */
 
-  //logDebug() << QString("  Subfile: %1, Subfile Parts Count: %2").arg(fileName).arg(count);
-  logStatus() << QString("Processing subfile '%1'").arg(fileName);
+int LDrawFile::countParts(const QString &mcFileName)
+{
+  QString fileName = mcFileName.toLower();
+  QMap<QString, LDrawSubFile>::iterator f = _subFiles.find(fileName);
+  if (f == _subFiles.end()) {
+    return 0;
+  }
+  if (f->_partCountValid) {
+    return f->_partCount;
+  }
 
-  int sfCount = 0;
-  bool doCountParts = true;
+  if ( ! f->_referencesValid) {
+    buildReferences(fileName);
+  }
+
+  // a file that uses itself counts its own parts once
+  f->_partCount      = f->_parts;
+  f->_partCountValid = true;
 
   QRegExp validEXT("\\.dat|\\.DAT|\\.ldr|\\.LDR|\\.mpd|\\.MPD$");
 
-  QMap<QString, LDrawSubFile>::iterator f = _subFiles.find(fileName.toLower());
-  if (f != _subFiles.end()) {
-      // get content size and reset numSteps
-      int j = f->_contents.size();
+  int count = f->_parts;
+  const QVector<LDrawReference> references = f->_references;
+  for (int i = 0; i < references.size(); i++) {
+    const LDrawReference &reference = references[i];
+    if ( ! reference.ignore && reference.name.contains(validEXT)) {
+      count += countParts(reference.name);
+    }
+  }
 
-      // process submodel content...
-      for (int i = 0; i < j; i++) {
-          QStringList tokens;
-          QString line = f->_contents[i];
+  f->_partCount = count;
+  return count;
+}
 
-          split(line,tokens);
+/*
+ * Whether a type 1 line that is not a submodel names a countable part.
+ * Library lookups are kept by name until the next model is loaded.
+ */
 
-          // interrogate each line
-//          if (tokens[0] != "1") {
-//              logNotice() << QString("     Line: [%1] %2").arg(fileName).arg(line);
-//            }
+bool LDrawFile::isPartType(const QString &type)
+{
+  QString name = type.toLower();
+  QHash<QString, bool>::const_iterator t = _partTypes.constFind(name);
+  if (t != _partTypes.constEnd()) {
+    return t.value();
+  }
 
-          if (tokens.size() == 5 &&
-              tokens[0] == "0" &&
-              (tokens[1] == "LPUB" || tokens[1] == "!LPUB") &&
-              tokens[2] == "PART" &&
-              tokens[3] == "BEGIN"  &&
-              tokens[4] == "IGN") {
-              doCountParts = false;
-            } else if (tokens.size() == 4 &&
-                       tokens[0] == "0" &&
-                       (tokens[1] == "LPUB" || tokens[1] == "!LPUB") &&
-                       tokens[2] == "PART"&&
-                       tokens[3] == "END") {
-              doCountParts = true;
-            }
+  bool isPart = false;
+  QRegExp validEXT("\\.dat|\\.DAT|\\.ldr|\\.LDR|\\.mpd|\\.MPD$");
 
-          if (doCountParts && tokens.size() == 15 && tokens[0] == "1" && (tokens[14].contains(validEXT))){
-              bool containsSubFile = contains(tokens[14].toLower());
-              if (containsSubFile) {
-                  countParts(tokens[14]);
-                } else if (! ExcludedParts::hasExcludedPart(tokens[14])){
-                  QFileInfo info(tokens[14]);
-                  PieceInfo* pieceInfo = lcGetPiecesLibrary()->FindPiece(info.baseName().toUpper().toLatin1().constData(), NULL, false);
-                  if (pieceInfo && pieceInfo->IsPartType()) {
-                      _pieces++; sfCount++;
-                      //logTrace() << QString(" Part Line: [%2] %3 ItemNo %1").arg(_pieces).arg(fileName).arg(line);
-                      logStatus() << QString("ItemNo %1 [%2]").arg(_pieces).arg(tokens[14]);
-                    } else if (lcGetPiecesLibrary()->IsPrimitive(info.baseName().toUpper().toLatin1().constData())) {
-                      logNotice() << QString("Item [%1] is a primitive type").arg(tokens[14]);
-                    } else {
-                      logNotice() << QString("Item [%1] not found in LPub3D archives. %2 %3")
-                          .arg(tokens[14])
-                          .arg(QString("%1/%2/%3").arg(Preferences::lpubDataPath, "libraries", VER_LPUB3D_UNOFFICIAL_ARCHIVE))
-                          .arg(QString("%1/%2/%3").arg(Preferences::lpubDataPath, "libraries", VER_LDRAW_OFFICIAL_ARCHIVE));
-                    }
-                }
-            }
-        }
+  if (type.contains(validEXT) && ! ExcludedParts::hasExcludedPart(type)) {
+    QFileInfo info(type);
+    PieceInfo* pieceInfo = lcGetPiecesLibrary()->FindPiece(info.baseName().toUpper().toLatin1().constData(), NULL, false);
+    if (pieceInfo && pieceInfo->IsPartType()) {
+      isPart = true;
+    } else if (lcGetPiecesLibrary()->IsPrimitive(info.baseName().toUpper().toLatin1().constData())) {
+      logNotice() << QString("Item [%1] is a primitive type").arg(type);
+    } else {
+      logNotice() << QString("Item [%1] not found in LPub3D archives. %2 %3")
+          .arg(type)
+          .arg(QString("%1/%2/%3").arg(Preferences::lpubDataPath, "libraries", VER_LPUB3D_UNOFFICIAL_ARCHIVE))
+          .arg(QString("%1/%2/%3").arg(Preferences::lpubDataPath, "libraries", VER_LDRAW_OFFICIAL_ARCHIVE));
     }
+  }
+
+  _partTypes.insert(name,isPart);
+  return isPart;
 }
 
 bool LDrawFile::saveLDRFile(const QString &fileName)
@@ -1082,11 +1399,77 @@ void LDrawFile::tempCacheCleared()
 }
 
 
-int split(const QString &line, QStringList &argv)
+/*
+ * split a line into the tokens of its LDraw line type, without copying:
+ * each token is a view into line, so line must outlive argv.
+ *
+ * type 1 lines are always 15 tokens with the part/submodel name (which
+ * may contain spaces) as the last token, type 2-5 lines are split on
+ * spaces, and type 0 lines are split on spaces except for double quoted
+ * strings, which become one token without their quotes.
+ */
+
+static void splitWords(
+  const QString       &line,
+  int                  from,
+  int                  to,
+  bool                 trim,
+  QVector<QStringRef> &argv)
+{
+  const QChar *c = line.unicode();
+
+  if (trim) {
+      while (from < to && c[from].isSpace()) {
+          from++;
+        }
+      while (to > from && c[to-1].isSpace()) {
+          to--;
+        }
+    }
+
+  while (from < to) {
+      while (from < to && c[from] == ' ') {
+          from++;
+        }
+      int start = from;
+      while (from < to && c[from] != ' ') {
+          from++;
+        }
+      if (from > start) {
+          argv << line.midRef(start,from - start);
+        }
+    }
+}
+
+static QStringRef trimmedRef(const QString &line, int from, int to)
+{
+  const QChar *c = line.unicode();
+  while (from < to && c[from].isSpace()) {
+      from++;
+    }
+  while (to > from && c[to-1].isSpace()) {
+      to--;
+    }
+  return line.midRef(from,to - from);
+}
+
+// find the next double quote at or after from that is not escaped
+static int nextSoQ(const QString &line, int from)
+{
+  int soq = line.indexOf('"',from);
+  while (soq > from && line.at(soq-1) == '\\') {
+      soq = line.indexOf('"',soq+1);
+    }
+  return soq;
+}
+
+int split(const QString &line, QVector<QStringRef> &argv)
 {
-  QString     chopped = line;
-  int         p = 0;
-  int         length = chopped.length();
+  const QChar *chopped = line.unicode();
+  int          p = 0;
+  int          length = line.length();
+
+  argv.clear();
 
   // line length check
   if (p == length) {
@@ -1099,13 +1482,11 @@ int split(const QString &line, QStringList &argv)
         }
     }
 
-  argv.clear();
-
   // if line starts with 1 (part line)
   if (chopped[p] == '1') {
 
       // line length check
-      argv << "1";
+      argv << line.midRef(p,1);
       p += 2;
       if (p >= length) {
           return -1;
@@ -1121,15 +1502,14 @@ int split(const QString &line, QStringList &argv)
 
       // populate argv with part line tokens
       for (int i = 0; i < 13; i++) {
-          QString token;
+          int start = p;
 
           while (chopped[p] != ' ') {
-              token += chopped[p];
               if (++p >= length) {
                   return -1;
                 }
             }
-          argv << token;
+          argv << line.midRef(start,p - start);
           while (chopped[p] == ' ') {
               if (++p >= length) {
                   return -1;
@@ -1137,56 +1517,155 @@ int split(const QString &line, QStringList &argv)
             }
         }
 
-      argv << chopped.mid(p);
+      argv << line.midRef(p);
 
       if (argv.size() > 1 && argv[1] == "WRITE") {
-          argv.removeAt(1);
+          argv.remove(1);
         }
 
     } else if (chopped[p] >= '2' && chopped[p] <= '5') {
-      chopped = chopped.mid(p);
-      argv << chopped.split(" ",QString::SkipEmptyParts);
+      splitWords(line,p,length,false,argv);
     } else if (chopped[p] == '0') {
 
       /* Parse the input line into argv[] */
 
-      int soq = validSoQ(chopped,chopped.indexOf("\""));
+      int soq = nextSoQ(line,0);
       if (soq == -1) {
-          argv << chopped.split(" ",QString::SkipEmptyParts);
+          splitWords(line,0,length,false,argv);
         } else {
           // quotes found
-          while (chopped.size()) {
-              soq = validSoQ(chopped,chopped.indexOf("\""));
+          int from = 0;
+          while (from < length) {
+              soq = nextSoQ(line,from);
               if (soq == -1) {
-                  argv << chopped.split(" ",QString::SkipEmptyParts);
-                  chopped.clear();
+                  splitWords(line,from,length,false,argv);
+                  from = length;
                 } else {
-                  QString left = chopped.left(soq);
-                  left = left.trimmed();
-                  argv << left.split(" ",QString::SkipEmptyParts);
-                  chopped = chopped.mid(soq+1);
-                  soq = validSoQ(chopped,chopped.indexOf("\""));
-                  if (soq == -1) {
-                      argv << left;
+                  int left = from;
+                  splitWords(line,left,soq,true,argv);
+                  from = soq+1;
+                  int eoq = nextSoQ(line,from);
+                  if (eoq == -1) {
+                      argv << trimmedRef(line,left,soq);
                       return -1;
                     }
-                  argv << chopped.left(soq);
-                  chopped = chopped.mid(soq+1);
-                  if (chopped == "\"") {
-                    }
+                  argv << line.midRef(from,eoq - from);
+                  from = eoq+1;
                 }
             }
         }
 
       if (argv.size() > 1 && argv[0] == "0" && argv[1] == "GHOST") {
-          argv.removeFirst();
-          argv.removeFirst();
+          argv.remove(0,2);
         }
     }
 
   return 0;
 }
 
+int split(const QString &line, QStringList &argv)
+{
+  QVector<QStringRef> tokens;
+  int rc = split(line,tokens);
+
+  // blank lines leave argv as it was
+  if (tokens.isEmpty() && line.count(QLatin1Char(' ')) == line.size()) {
+      return rc;
+    }
+
+  argv.clear();
+  for (int i = 0; i < tokens.size(); i++) {
+      argv << tokens[i].toString();
+    }
+
+  return rc;
+}
+
+float tokenToFloat(const QStringRef &token)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,1,0)
+  return token.toFloat();
+#else
+  return token.toString().toFloat();
+#endif
+}
+
+double tokenToDouble(const QStringRef &token)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,1,0)
+  return token.toDouble();
+#else
+  return token.toString().toDouble();
+#endif
+}
+
+/*
+ * Fast path for type 1 lines, which make up most of a model: picks out the
+ * colour, the 12 numbers and the name in one pass without building a token
+ * list.  Returns false for anything split() would not turn into the 15
+ * tokens of a type 1 line, so callers can fall back to split().
+ */
+
+bool splitPartLine(const QString &line, LDrawPartLine &part)
+{
+  const QChar *c = line.unicode();
+  int          p = 0;
+  int          length = line.length();
+
+  while (p < length && c[p] == ' ') {
+      p++;
+    }
+  if (p + 1 >= length || c[p] != '1' || c[p+1] != ' ') {
+      return false;
+    }
+  p += 2;
+
+  for (int i = 0; i < 13; i++) {
+      while (p < length && c[p] == ' ') {
+          p++;
+        }
+      int start = p;
+      while (p < length && c[p] != ' ') {
+          p++;
+        }
+      if (p >= length) {
+          return false;
+        }
+      QStringRef token = line.midRef(start,p - start);
+      if (i == 0) {
+          if (token == "WRITE") {
+              return false;
+            }
+          part.color = token;
+        } else {
+          part.values[i-1] = tokenToFloat(token);
+        }
+    }
+
+  while (p < length && c[p] == ' ') {
+      p++;
+    }
+  if (p >= length) {
+      return false;
+    }
+  part.type = line.midRef(p);
+
+  return true;
+}
+
+bool LDrawPartLine::mirrored() const
+{
+  /* 3  4  5
+     6  7  8
+     9 10 11 */
+
+  float a = values[3], b = values[4],  c = values[5];
+  float d = values[6], e = values[7],  f = values[8];
+  float g = values[9], h = values[10], i = values[11];
+
+  return a*(e*i - f*h) - b*(d*i - f*g) + c*(d*h - e*g) < 0;
+}
+
 // check for escaped quotes
 int validSoQ(const QString &line, int soq){
 
@@ -1209,6 +1688,12 @@ QList<QRegExp> LDrawUnofficialFileTypeRegExp;
 
 LDrawFile::LDrawFile()
 {
+  _mpd                = false;
+  _contentVersion     = 0;
+  _contentHashVersion = -1;
+  _referencesVersion  = 0;
+  _instancesVersion   = -1;
+
   {
     LDrawHeaderRegExp
         << QRegExp("^\\s*0\\s+Author[^\n]*")
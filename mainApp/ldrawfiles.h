@@ -38,12 +38,72 @@
 #include <QList>
 #include <QRegExp>
 #include <QHash>
+#include <QByteArray>
+#include <QVector>
 
 #include "excludedparts.h"
 #include "QsLog.h"
 
 extern QList<QRegExp> LDrawHeaderRegExp;
 
+/*
+ * One model line parsed once, kept alongside the text so traversals can
+ * skip trimming and splitting the same lines on every page draw.
+ */
+
+class LDrawLine {
+  public:
+    int         kind;           // LDraw line type 0-5, -1 for blank or unknown
+    bool        ghost;          // 0 GHOST prefix (line is still kind 1-5)
+    QString     color;          // kind 1-5
+    float       matrix[12];     // kind 1: x y z a b c d e f g h i
+    QString     type;           // kind 1: part or submodel name
+    bool        mirrored;       // kind 1
+    bool        subFile;        // kind 1: type is a file in this model
+    QStringList tokens;         // kind 0: the split meta command
+
+    LDrawLine()
+    {
+      kind     = -1;
+      ghost    = false;
+      mirrored = false;
+      subFile  = false;
+    }
+};
+
+/*
+ * A use of one file of the model by another: a type 1 line naming a
+ * submodel, with the context the line sits in.  The references of all the
+ * files make up the submodel graph the instance, step and part counts are
+ * worked out from.
+ */
+
+class LDrawReference {
+  public:
+    QString     name;           // lower case submodel name
+    bool        mirrored;
+    bool        callout;        // between 0 LPUB CALLOUT BEGIN and END
+    bool        ignore;         // between 0 LPUB PART BEGIN IGN and END
+    bool        ghost;          // 0 GHOST line
+
+    LDrawReference()
+    {
+      mirrored = false;
+      callout  = false;
+      ignore   = false;
+      ghost    = false;
+    }
+
+    bool operator==(const LDrawReference &rhs) const
+    {
+      return name     == rhs.name     &&
+             mirrored == rhs.mirrored &&
+             callout  == rhs.callout  &&
+             ignore   == rhs.ignore   &&
+             ghost    == rhs.ghost;
+    }
+};
+
 class LDrawSubFile {
   public:
     QStringList _contents;
@@ -60,10 +120,21 @@ class LDrawSubFile {
     bool        _generated;
     int         _fadePosition;
     int         _startPageNumber;
+    QVector<LDrawLine> _parsed; // _contents parsed, when _parsedValid
+    bool        _parsedValid;
+    QVector<LDrawReference> _references; // submodels used, when _referencesValid
+    int         _steps;                  // steps, when _referencesValid
+    int         _parts;                  // parts not in submodels, when _referencesValid
+    bool        _referencesValid;
+    int         _partCount;              // parts including submodels
+    bool        _partCountValid;
 
     LDrawSubFile()
     {
       _unofficialPart = false;
+      _parsedValid = false;
+      _referencesValid = false;
+      _partCountValid = false;
     }
     LDrawSubFile(
             const QStringList &contents,
@@ -80,9 +151,16 @@ class LDrawFile {
   private:
     QMap<QString, LDrawSubFile> _subFiles;
     QStringList                 _emptyList;
+    QVector<LDrawLine>          _emptyParsed;
     QString                     _emptyString;
     bool                        _mpd;
+    int                         _contentVersion;
+    QHash<QString, QByteArray>  _contentHashes;    // valid for _contentHashVersion
+    int                         _contentHashVersion;
     static int                  _emptyInt;
+    int                         _referencesVersion; // bumped when the submodel graph changes
+    int                         _instancesVersion;  // _referencesVersion instances were counted for
+    QHash<QString, bool>        _partTypes;         // isPartType results
 
     ExcludedParts               excludedParts; // internal list of part count excluded parts
   public:
@@ -104,6 +182,12 @@ class LDrawFile {
       return _pieces;
     }
 
+    /* bumped on every change to the model lines so callers can tell
+       when anything they derived from the contents has gone stale */
+    int contentVersion(){
+      return _contentVersion;
+    }
+
     bool saveFile(const QString &fileName);
     bool saveMPDFile(const QString &filename);
     bool saveLDRFile(const QString &filename);
@@ -142,6 +226,10 @@ class LDrawFile {
                               int      charsRemoved, 
                         const QString &charsAdded);
 
+    QByteArray contentHash(const QString &fileName);
+    const QVector<LDrawLine> &parsedLines(const QString &fileName);
+    LDrawLine parsedLine(const QString &fileName, int lineNumber);
+    void parseLine(const QString &line, LDrawLine &parsed);
     bool isMpd();
     QString topLevelFile();
     bool isUnofficialPart(const QString &name);
@@ -158,14 +246,35 @@ class LDrawFile {
     void setRendered(const QString &fileName, bool mirrored);
     bool rendered(const QString &fileName, bool mirrored);
     int instances(const QString &fileName, bool mirrored);
-    void countParts(const QString &fileName);
+    int  countParts(const QString &fileName);
     void countInstances();
     void countInstances(const QString &fileName, bool mirrored, const bool callout = false);
+    void buildReferences(const QString &fileName);
+    void staleReferences(const QString &fileName);
+    bool isPartType(const QString &type);
     bool changedSinceLastWrite(const QString &fileName);
     void tempCacheCleared();
 };
 
+/*
+ * A type 1 line: 1 colour x y z a b c d e f g h i name, with the numbers
+ * converted.  colour and type are views into the line that was split.
+ */
+
+class LDrawPartLine {
+  public:
+    QStringRef color;
+    float      values[12];          // x y z a b c d e f g h i
+    QStringRef type;
+
+    bool mirrored() const;
+};
+
 int split(const QString &line, QStringList &argv);
+int split(const QString &line, QVector<QStringRef> &argv);
+bool splitPartLine(const QString &line, LDrawPartLine &part);
+float tokenToFloat(const QStringRef &token);
+double tokenToDouble(const QStringRef &token);
 int validSoQ(const QString &line, int soq);
 bool isHeader(QString &line);
 bool isUnofficialFileType(QString &line);
@@ -44,6 +44,7 @@
 #include "lpub_preferences.h"
 #include "preferencesdialog.h"
 #include "render.h"
+#include "rendercache.h"
 #include "metaitem.h"
 #include "ranges_element.h"
 #include "updatecheck.h"
@@ -678,6 +679,7 @@ void Gui::clearAndRedrawPage()
        clearPLICache();
        clearCSICache();
        clearTempCache();
+       clearPageIndex();
 
        if (Preferences::enableFadeStep)
          ldrawFile.clearFadePositions();
@@ -730,6 +732,7 @@ void Gui::clearPLICache()
 
     QString dirName = QDir::currentPath() + "/" + Paths::partsDir;
     QDir dir(dirName);
+    renderCache.clear(dirName);
 
     dir.setFilter(QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot | QDir::NoSymLinks);
 
@@ -760,6 +763,7 @@ void Gui::clearCSICache()
 
     QString dirName = QDir::currentPath() + "/" + Paths::assemDir;
     QDir dir(dirName);
+    renderCache.clear(dirName);
 
     dir.setFilter(QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot | QDir::NoSymLinks);
 
@@ -1321,6 +1325,8 @@ Gui::Gui()
     pageRangeText = displayPageNum;
     m_previewDialog    = false;
     m_exportingContent = false;
+    m_batchExporting   = false;
+    fadeSubmodelsVersion = -1;
 
 
     editWindow    = new EditWindow(this);  // remove inheritance 'this' to independently manage window
@@ -1369,6 +1375,10 @@ Gui::Gui()
     undoStack = new QUndoStack();
     macroNesting = 0;
 
+    pageIndexBuilding  = false;
+    pageIndexExporting = false;
+    pageIndexVersion   = -1;
+
     connect(this,           SIGNAL(setExportingSig(bool)),
             this,           SLOT(  setExporting(   bool)));
 
@@ -349,6 +349,7 @@
 #include <QFile>
 #include <QProgressBar>
 #include <QElapsedTimer>
+#include <QSet>
 #include <QPdfWriter>
 #include "color.h"
 #include "ranges.h"
@@ -406,6 +407,7 @@ class UpdateCheck;
 
 class LGraphicsView;
 class PageBackgroundItem;
+class BatchExport;
 
 enum traverseRc { HitEndOfPage = 1 };
 enum Dimensions {Pixels = 0, Inches};
@@ -418,10 +420,57 @@ void clearCsiCache();
 void clearCsi3dCache();
 void clearAndRedrawPage();
 
+/*
+ * The parse state findPage hands to drawPage at the top of a page.
+ * One of these is recorded for every page during a full traversal so
+ * later page draws (next/previous page, export) can go straight to the
+ * page of interest instead of walking the model from line 0 again.
+ */
+
+class PageState
+{
+public:
+  Meta                        meta;
+  Where                       current;
+  QString                     addLine;
+  QStringList                 csiParts;
+  QStringList                 bfxParts;
+  QHash<QString, QStringList> bfx;
+  int                         stepNumber;
+  int                         stepPageNum;
+  int                         fadePosition;
+  bool                        isMirrored;
+  bool                        bfxStore2;
+
+  PageState()
+  {
+    stepNumber   = 1;
+    stepPageNum  = 1;
+    fadePosition = 0;
+    isMirrored   = false;
+    bfxStore2    = false;
+  }
+};
+
+/*
+ * What fadeStep faded last for one submodel: the leading csiParts lines
+ * and their faded form.  The next step of the submodel starts with the
+ * same lines, so only the lines added since then are faded.
+ */
+
+class FadePrefix
+{
+public:
+  QStringList source;
+  QStringList faded;
+};
+
 class Gui : public QMainWindow
 {
   Q_OBJECT
 
+  friend class BatchExport;        // drives openFile and the export cores
+
 public:
   Gui();
   ~Gui();
@@ -433,6 +482,7 @@ public:
   int             lastStepPageNum;
   int             saveFadePosition; // indicate the fade step position.
   QList<Where>    topOfPages;
+  QMap<int, PageState> pageIndex;  // parse state at the top of each page
 
   int             boms;            // the number of pli BOMs in the document
   int             bomOccurrence;   // the acutal occurenc of each pli BOM
@@ -462,6 +512,12 @@ public:
   }
   void    displayPage();
 
+  void    clearPageIndex()
+  {
+    pageIndex.clear();
+    pageIndexVersion = -1;
+  }
+
   /* We need to send ourselved these, to eliminate resursion and the model
    * changing under foot */
   void drawPage(                   // this is the workhorse for preparing a
@@ -512,6 +568,10 @@ public:
   {
     return ldrawFile.isUnofficialPart(name);
   }
+  QByteArray contentHash(const QString &name)
+  {
+    return ldrawFile.contentHash(name);
+  }
 
   void insertGeneratedModel(const QString &name,
                                   QStringList &csiParts) {
@@ -624,6 +684,8 @@ public slots:
       if (status){
           statusBarMsg(message);
           logStatus() << message;
+      }else if (m_batchExporting){
+          logError() << message;        // BatchExport reports it on stderr
       }else{
           QMessageBox::warning(this,tr("LPub3D"),tr(message.toLatin1()));
           logError() << message;
@@ -791,6 +853,16 @@ private:
   FadeStepColorParts     fadeStepColorParts; // internal list of color parts to be processed for fade step.
   PliSubstituteParts     pliSubstituteParts; // internal list of PLI/BOM substitute parts
   bool                   m_exportingContent; // indicate export/pring underway
+  bool                   m_batchExporting;   // command line export, report progress on stdout
+  QString                m_batchCacheDir;    // command line export, where LPub3D/tmp, assem and parts go
+  QString                tmpFadeColor;       // colour of the -fade files in the temp directory, empty if none
+
+  /* faded lines kept between steps and writeToTmp calls, see checkFadeCache */
+  QHash<QString, FadePrefix>               fadePrefixes;   // per submodel, for fadeStep
+  QHash<QString, QHash<QString, QString> > tmpFadeLines;   // per -fade file, line -> faded line
+  QString                                  fadeCacheColor; // colour the kept lines were faded with
+  QSet<QString>                            fadeSubmodels;  // lower case submodel names they were faded with
+  int                                      fadeSubmodelsVersion; // ldrawFile contentVersion of fadeSubmodels
 
 #ifdef WATCHER
   QFileSystemWatcher watcher;        // watch the file system for external
@@ -805,10 +877,34 @@ private:
   int             macroNesting;
   int             renderStepNum;    // at what step in the model is a submodel detected and rendered
 
+  bool            pageIndexBuilding;  // findPage is recording the top of every page
+  bool            pageIndexExporting; // pageIndex was recorded while exporting (page sizes known)
+  int             pageIndexVersion;   // ldrawFile content version pageIndex was recorded from
+
   void countPages();
 
   void skipHeader(Where &current);
 
+  bool pageIndexValid();
+
+  void recordPageState(            // save the top of page parse state
+    int            pageNum,        // for the page index
+    const Meta    &meta,
+    const Where   &current,
+    const QString &addLine,
+    const QStringList &csiParts,
+    const QStringList &bfxParts,
+    const QHash<QString, QStringList> &bfx,
+    int            stepNumber,
+    int            stepPageNum,
+    bool           isMirrored,
+    bool           bfxStore2);
+
+  void drawIndexedPage(            // draw a page from its page index entry
+    LGraphicsView  *view,
+    QGraphicsScene *scene,
+    bool            printing);
+
   int findPage(// traverse the hierarchy until we get to the
     LGraphicsView  *view,          // page of interest, let traverse process the
     QGraphicsScene *scene,         // page, and then finish by counting the rest
@@ -882,26 +978,33 @@ private:
   int getBOMOccurrence(
           Where  current);
 
-  void writeToTmp(
-    const QString &fileName,
-    const QStringList &);
-
-  void writeToTmp();
-
-  QStringList fadeSubFile(
-     const QStringList &,
-     const QString &color);      // fade all parts in subfile
+  void writeToTmp();               // write changed submodels to the temp directory
 
   QStringList fadeStep(
      const QStringList &csiParts,
      const int &stepNum,
      Where        &current);      // fade parts in a step that are not current
 
+  void checkFadeCache(const QString &fadeColor);
+
   static bool installExportBanner(
     const int &type,
     const QString &printFile,
     const QString &imageFile);
 
+  bool exportPdfFile(              // export the pages picked by exportOption
+    const QString &fileName);      // without any dialogs
+
+  bool exportImageFiles(
+    const QString &suffix,
+    const QString &directoryName);
+
+  void exportProgressStart(const QString &title);   // the progress dialog, or
+  void exportProgress(const QString &text, int value = -1); // stdout in batch
+  void exportProgressRange(int max);
+  void exportProgressValue(int value);
+  void exportProgressStop();
+
 private slots:
     void open();
     void save();
@@ -24,6 +24,7 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QDate>
+#include <QThread>
 #include <JlCompress.h>
 #include "lpub_preferences.h"
 #include "ui_preferences.h"
@@ -140,6 +141,11 @@ int     Preferences::checkUpdateFrequency       = 0;        //0=Never,1=Daily,2=
 int     Preferences::pageHeight                 = 800;
 int     Preferences::pageWidth                  = 600;
 int     Preferences::rendererTimeout            = 6;        // measured in seconds
+int     Preferences::rendererProcesses          = 1;        // concurrent renderer processes
+int     Preferences::exportThreads              = 1;        // threads encoding and writing exported images
+int     Preferences::exportCompression          = 6;        // png compression level, 0 (none) to 9
+int     Preferences::pdfImageDpi                = 0;        // most image dpi in exported pdf, 0 keeps the render resolution
+bool    Preferences::pdfLosslessImages          = false;    // embed pdf images without jpeg compression, Qt 5.13 and later
 
 Preferences::Preferences()
 {
@@ -1158,6 +1164,43 @@ void Preferences::renderPreferences()
         rendererTimeout = Settings.value(QString("%1/%2").arg(SETTINGS,"RendererTimeout")).toInt();
     }
 
+    //Renderer Processes
+    if ( ! Settings.contains(QString("%1/%2").arg(SETTINGS,"RendererProcesses"))) {
+        rendererProcesses = QThread::idealThreadCount() > 0 ? QThread::idealThreadCount() : 1;
+        Settings.setValue(QString("%1/%2").arg(SETTINGS,"RendererProcesses"),rendererProcesses);
+    } else {
+        rendererProcesses = Settings.value(QString("%1/%2").arg(SETTINGS,"RendererProcesses")).toInt();
+    }
+
+    //Export Threads
+    if ( ! Settings.contains(QString("%1/%2").arg(SETTINGS,"ExportThreads"))) {
+        exportThreads = QThread::idealThreadCount() > 0 ? QThread::idealThreadCount() : 1;
+        Settings.setValue(QString("%1/%2").arg(SETTINGS,"ExportThreads"),exportThreads);
+    } else {
+        exportThreads = Settings.value(QString("%1/%2").arg(SETTINGS,"ExportThreads")).toInt();
+    }
+
+    //Export Compression
+    if ( ! Settings.contains(QString("%1/%2").arg(SETTINGS,"ExportCompression"))) {
+        Settings.setValue(QString("%1/%2").arg(SETTINGS,"ExportCompression"),exportCompression);
+    } else {
+        exportCompression = Settings.value(QString("%1/%2").arg(SETTINGS,"ExportCompression")).toInt();
+    }
+
+    //PDF Image DPI
+    if ( ! Settings.contains(QString("%1/%2").arg(SETTINGS,"PdfImageDpi"))) {
+        Settings.setValue(QString("%1/%2").arg(SETTINGS,"PdfImageDpi"),pdfImageDpi);
+    } else {
+        pdfImageDpi = Settings.value(QString("%1/%2").arg(SETTINGS,"PdfImageDpi")).toInt();
+    }
+
+    //PDF Lossless Images
+    if ( ! Settings.contains(QString("%1/%2").arg(SETTINGS,"PdfLosslessImages"))) {
+        Settings.setValue(QString("%1/%2").arg(SETTINGS,"PdfLosslessImages"),pdfLosslessImages);
+    } else {
+        pdfLosslessImages = Settings.value(QString("%1/%2").arg(SETTINGS,"PdfLosslessImages")).toBool();
+    }
+
     // display povray image during rendering
     QString const povrayDisplayKey("PovRayDisplay");
     if ( ! Settings.contains(QString("%1/%2").arg(SETTINGS,povrayDisplayKey))) {
@@ -1547,6 +1590,31 @@ bool Preferences::getPreferences()
             Settings.setValue(QString("%1/%2").arg(SETTINGS,"RendererTimeout"),rendererTimeout);
         }
 
+        if (rendererProcesses != dialog->rendererProcesses()) {
+            rendererProcesses = dialog->rendererProcesses();
+            Settings.setValue(QString("%1/%2").arg(SETTINGS,"RendererProcesses"),rendererProcesses);
+        }
+
+        if (exportThreads != dialog->exportThreads()) {
+            exportThreads = dialog->exportThreads();
+            Settings.setValue(QString("%1/%2").arg(SETTINGS,"ExportThreads"),exportThreads);
+        }
+
+        if (exportCompression != dialog->exportCompression()) {
+            exportCompression = dialog->exportCompression();
+            Settings.setValue(QString("%1/%2").arg(SETTINGS,"ExportCompression"),exportCompression);
+        }
+
+        if (pdfImageDpi != dialog->pdfImageDpi()) {
+            pdfImageDpi = dialog->pdfImageDpi();
+            Settings.setValue(QString("%1/%2").arg(SETTINGS,"PdfImageDpi"),pdfImageDpi);
+        }
+
+        if (pdfLosslessImages != dialog->pdfLosslessImages()) {
+            pdfLosslessImages = dialog->pdfLosslessImages();
+            Settings.setValue(QString("%1/%2").arg(SETTINGS,"PdfLosslessImages"),pdfLosslessImages);
+        }
+
         if (documentLogoFile != dialog->documentLogoFile()) {
             documentLogoFile = dialog->documentLogoFile();
             if (documentLogoFile == "") {
@@ -131,6 +131,11 @@ class Preferences
     static int     pageWidth;
     static int     pageHeight;
     static int     rendererTimeout;
+    static int     rendererProcesses;
+    static int     exportThreads;
+    static int     exportCompression;
+    static int     pdfImageDpi;
+    static bool    pdfLosslessImages;
     static bool    povrayDisplay;
 
     virtual ~Preferences() {}
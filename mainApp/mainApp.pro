@@ -209,6 +209,7 @@ HEADERS += \
     archiveparts.h \
     backgrounddialog.h \
     backgrounditem.h \
+    batchexport.h \
     borderdialog.h \
     callout.h \
     calloutbackgrounditem.h \
@@ -226,6 +227,7 @@ HEADERS += \
     gradients.h \
     highlighter.h \
     hoverpoints.h \
+    imageanalysis.h \
     ldrawfiles.h \
     ldsearchdirs.h \
     lpub.h \
@@ -261,6 +263,7 @@ HEADERS += \
     ranges_element.h \
     ranges_item.h \
     render.h \
+    rendercache.h \
     reserve.h \
     resize.h \
     resolution.h \
@@ -283,6 +286,7 @@ SOURCES += \
     assemglobals.cpp \
     backgrounddialog.cpp \
     backgrounditem.cpp \
+    batchexport.cpp \
     borderdialog.cpp \
     callout.cpp \
     calloutbackgrounditem.cpp \
@@ -302,6 +306,7 @@ SOURCES += \
     gradients.cpp \
     highlighter.cpp \
     hoverpoints.cpp \
+    imageanalysis.cpp \
     ldrawfiles.cpp \
     ldsearchdirs.cpp \
     lpub.cpp \
@@ -340,6 +345,7 @@ SOURCES += \
     ranges_element.cpp \
     ranges_item.cpp \
     render.cpp \
+    rendercache.cpp \
     resize.cpp \
     resolution.cpp \
     rotateiconitem.cpp \
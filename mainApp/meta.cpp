@@ -52,12 +52,43 @@ QHash<QString, int> tokenMap;
 
 bool AbstractMeta::reportErrors = false;
 
+/*
+ * Each keyword is compiled once for the process.  The copies handed out
+ * share its compiled engine, but keep their own match state, so Metas on
+ * the writer threads can match them at the same time.
+ */
+
+static QRegExp keywordPattern(const QString &name)
+{
+  static QMutex                  mutex;
+  static QHash<QString, QRegExp> compiled;
+
+  QMutexLocker locker(&mutex);
+
+  QHash<QString, QRegExp>::iterator i = compiled.find(name);
+  if (i == compiled.end()) {
+      i = compiled.insert(name,QRegExp(name));
+      i.value().isValid();      // compiles it
+    }
+  return i.value();
+}
+
 void AbstractMeta::init(
     BranchMeta *parent,
     QString name)
 {
   preamble           = parent->preamble + name + " ";
+
+  AbstractMeta *replaced = parent->list.value(name);
   parent->list[name] = this;
+
+  int pattern = replaced ? parent->patternMetas.indexOf(replaced) : -1;
+  if (pattern < 0) {
+      parent->patterns     << keywordPattern(name);
+      parent->patternMetas << this;
+    } else {
+      parent->patternMetas[pattern] = this;
+    }
 }
 
 void AbstractMeta::doc(QStringList &out, QString preamble)
@@ -103,28 +134,28 @@ Rc BranchMeta::parse(QStringList &argv, int index, Where &here)
 
           /* We found a match */
 
+          AbstractMeta *meta = i.value();
+
           offset = 1;
           rc = OkRc;
 
           if (size - index > 1) {
-              if (i.value()) {
-                  if (argv[index+offset] == "LOCAL") {
-                      i.value()->pushed = true;
-                      offset++;
-                    } else if (argv[index+offset] == "GLOBAL") {
-                      i.value()->global = true;
-                      offset++;
-                    }
-                  if (index + offset >= size) {
-                      rc = FailureRc;
-                    }
+              if (argv[index+offset] == "LOCAL") {
+                  meta->pushed = true;
+                  offset++;
+                } else if (argv[index+offset] == "GLOBAL") {
+                  meta->global = true;
+                  offset++;
+                }
+              if (index + offset >= size) {
+                  rc = FailureRc;
                 }
             }
 
           /* Now parse the rest of the argvs */
 
           if (rc == OkRc) {
-              return i.value()->parse(argv,index+offset,here);
+              return meta->parse(argv,index+offset,here);
             }
         } else if (size - index > 1) {
 
@@ -139,15 +170,17 @@ Rc BranchMeta::parse(QStringList &argv, int index, Where &here)
           offset = local || global;
 
           if (index + offset < size) {
-              for (i = list.begin(); i != list.end(); i++) {
-                  QRegExp rx(i.key());
-                  if (argv[index + offset].contains(rx)) {
+              const QString &arg = argv[index + offset];
+              for (int j = 0; j < patterns.size(); j++) {
+                  QRegExp rx(patterns[j]);    // matching sets its captures
+                  if (arg.contains(rx)) {
 
                       /* Now parse the rest of the argvs */
 
-                      i.value()->pushed = local;
-                      i.value()->global = global;
-                      return i.value()->parse(argv,index+offset,here);
+                      AbstractMeta *meta = patternMetas[j];
+                      meta->pushed = local;
+                      meta->global = global;
+                      return meta->parse(argv,index+offset,here);
                     }
                 }
             }
@@ -3172,20 +3205,40 @@ Rc Meta::parse(
     QString  &line,
     Where    &here,
     bool           reportErrors)
+{
+  QStringList tokens;
+
+  split(line,tokens);
+
+  return parse(line,tokens,here,reportErrors);
+}
+
+/*
+ * Parse a line already split into tokens, as the model's parsed lines
+ * keep them.
+ */
+
+Rc Meta::parse(
+          QString     &line,
+    const QStringList &tokens,
+          Where       &here,
+          bool         reportErrors)
 {
   QStringList argv;
-  
-  QRegExp bgt("^\\s*0\\s+(MLCAD)\\s+(BTG)\\s+(.*)$");
 
   AbstractMeta::reportErrors = reportErrors;
 
-  if (line.contains(bgt)) {
+  // a QRegExp keeps its captures, so each parse has its own
+  QRegExp bgt;
+  if (line.contains("BTG")) {
+      bgt.setPattern("^\\s*0\\s+(MLCAD)\\s+(BTG)\\s+(.*)$");
+    }
+
+  if ( ! bgt.isEmpty() && line.contains(bgt)) {
       argv << "MLCAD" << "BTG" << bgt.cap(3);
     } else {
 
-      /* Parse the input line into argv[] */
-
-      split(line,argv);
+      argv = tokens;
 
       if (argv.size() > 0) {
           argv.removeFirst();
@@ -45,6 +45,7 @@
 #include <QRegExp>
 #include <QStringList>
 #include <QMessageBox>
+#include <QVector>
 #include "where.h"
 #include "metatypes.h"
 #include "resolution.h"
@@ -239,6 +240,15 @@ public:
    */
 
   QHash<QString, AbstractMeta *> list;
+
+  /*
+   * The same keywords as regular expressions, in the order init()
+   * registers them, for the values that match no keyword exactly
+   * (e.g. the placement values).  Parses only match copies of them.
+   */
+
+  QVector<QRegExp>        patterns;
+  QVector<AbstractMeta *> patternMetas;
   BranchMeta() : AbstractMeta() {}
   virtual ~BranchMeta();
   
@@ -246,21 +256,17 @@ public:
   virtual bool    preambleMatch(QStringList &argv, int index, QString &_preamble);
   virtual void    doc(QStringList &out, QString preamble);
   virtual void    pop();
+
+  /* the members themselves are copied by the derived class, and the
+     keyword list points at this object's own members */
+
   BranchMeta &operator= (const BranchMeta &rhs)
   {
-    QString key;
-    foreach(key, list.keys()) {
-      *list[key] = *rhs.list[key];
-    }
     preamble = rhs.preamble;
     return *this;
   }
   BranchMeta (const BranchMeta &rhs) : AbstractMeta(rhs)
   {
-    QString key;
-    foreach(key, list.keys()) {
-      *list[key] = *rhs.list[key];
-    }
   }
 };
 
@@ -2400,6 +2406,7 @@ public:
   Meta();
   virtual ~Meta();
   Rc    parse(QString &line, Where &here, bool reportErrors = 0);
+  Rc    parse(QString &line, const QStringList &tokens, Where &here, bool reportErrors = 0);
   bool  preambleMatch(QString &line, QString &preamble);
   virtual void  init(BranchMeta *parent, QString name);
   virtual void  pop();
@@ -2413,6 +2420,8 @@ public:
     step    = rhs.step;
     clear   = rhs.clear;
     rotStep = rhs.rotStep;
+    bfx     = rhs.bfx;
+    MLCad   = rhs.MLCad;
     LSynth  = rhs.LSynth;
     submodelStack = rhs.submodelStack;
   }
@@ -297,7 +297,7 @@ void Gui::openFile(QString &fileName)
   closeFile();
   displayPageNum = 1;
   QFileInfo info(fileName);
-  QDir::setCurrent(info.absolutePath());
+  QDir::setCurrent(m_batchCacheDir.isEmpty() ? info.absolutePath() : m_batchCacheDir);
   Paths::mkdirs();
   emit messageSig(true, "Loading LDraw model file...");
   ldrawFile.loadFile(fileName);
@@ -381,7 +381,8 @@ void Gui::setCurrentFile(const QString &fileName)
   
   setWindowTitle(tr("%1[*] - %2").arg(shownName).arg(tr(VER_PRODUCTNAME_STR)));
 
-  if (fileName.size() > 0) {
+  // a command line export leaves the recent files alone
+  if (fileName.size() > 0 && ! m_batchExporting) {
     QSettings Settings;
     QStringList files = Settings.value(QString("%1/%2").arg(SETTINGS,"LPRecentFileList")).toStringList();
     files.removeAll("");
@@ -33,12 +33,15 @@
 #include <QFileInfo>
 #include <QFile>
 #include <QTextStream>
+#include <climits>
+#include <algorithm>
 #include "pli.h"
 #include "step.h"
 #include "ranges.h"
 #include "callout.h"
 #include "resolution.h"
 #include "render.h"
+#include "rendercache.h"
 #include "paths.h"
 #include "ldrawfiles.h"
 #include "placementdialog.h"
@@ -136,6 +139,71 @@ QString Pli::partLine(QString &line, Where &here, Meta & /*meta*/)
   return line + QString(";%1;%2").arg(here.modelName).arg(here.lineNumber);
 }
 
+/*
+ * The sort key of a part, taken from it once rather than looked up in
+ * the part hash and compared as strings on every compare.  group is the
+ * part's sortColour or sortCategory, or empty when sorting by size.
+ */
+
+class PliSortKey
+{
+public:
+  QString group;
+  int     width;
+  int     height;
+  QString key;
+};
+
+static bool pliSortBefore(const PliSortKey &a, const PliSortKey &b)
+{
+  if (a.group != b.group) {
+      return a.group > b.group;
+    }
+  if (a.width != b.width) {
+      return a.width > b.width;
+    }
+  if (a.height != b.height) {
+      return a.height > b.height;
+    }
+  return a.key < b.key;
+}
+
+/*
+ * Sort keys largest first, by the colour or category sortBy names and
+ * then, if bySize, by width and height.  Parts that tie are ordered by
+ * key so the order no longer depends on the hash.
+ */
+
+static void sortPliKeys(
+  QList<QString>           &keys,
+  QHash<QString, PliPart*> &list,
+  const QString            &sortBy,
+  bool                      bySize)
+{
+  QVector<PliSortKey> sortKeys;
+  sortKeys.reserve(keys.size());
+
+  foreach (const QString &key, keys) {
+      PliPart *part = list.value(key);
+      PliSortKey sortKey;
+      if (sortBy == SortOptionName[PartColour]) {
+          sortKey.group = part->sortColour;
+        } else if (sortBy == SortOptionName[PartCategory]) {
+          sortKey.group = part->sortCategory;
+        }
+      sortKey.width  = bySize ? part->width  : 0;
+      sortKey.height = bySize ? part->height : 0;
+      sortKey.key    = key;
+      sortKeys.append(sortKey);
+    }
+
+  std::stable_sort(sortKeys.begin(),sortKeys.end(),pliSortBefore);
+
+  for (int i = 0; i < sortKeys.size(); i++) {
+      keys[i] = sortKeys[i].key;
+    }
+}
+
 void Pli::setParts(
     QStringList &csiParts,
     Meta        &meta,
@@ -220,28 +288,10 @@ void Pli::setParts(
       //sort
       sortedKeys = tempParts.keys();
 
-      if (pliMeta.sortBy.value() == SortOptionName[PartColour]){
-          // Sort tempParts by colour
-          for (int i = 0; i < tempParts.size() - 1; i++) {
-              for (int j = i+1; j < tempParts.size(); j++) {
-                  if (tempParts[sortedKeys[i]]->sortColour < tempParts[sortedKeys[j]]->sortColour) {
-                      QString t = sortedKeys[i];
-                      sortedKeys[i] = sortedKeys[j];
-                      sortedKeys[j] = t;
-                    }
-                }
-            }
-        } else if (pliMeta.sortBy.value() == SortOptionName[PartCategory]){
-          // Sort tempParts by category
-          for (int i = 0; i < tempParts.size() - 1; i++) {
-              for (int j = i+1; j < tempParts.size(); j++) {
-                  if (tempParts[sortedKeys[i]]->sortCategory < tempParts[sortedKeys[j]]->sortCategory) {
-                      QString t = sortedKeys[i];
-                      sortedKeys[i] = sortedKeys[j];
-                      sortedKeys[j] = t;
-                    }
-                }
-            }
+      // Sort tempParts by colour or category
+      if (pliMeta.sortBy.value() == SortOptionName[PartColour] ||
+          pliMeta.sortBy.value() == SortOptionName[PartCategory]){
+          sortPliKeys(sortedKeys,tempParts,pliMeta.sortBy.value(),false);
         }
 
       int quotient    = tempParts.size() / gui->boms;
@@ -435,7 +485,8 @@ int Pli::createPartImage(
     QString  &partialKey,
     QString  &type,
     QString  &color,
-    QPixmap  *pixmap)
+    QPixmap  *pixmap,
+    QString  *imageFile)
 {
   emit gui->messageSig(true, "Render PLI image...");
 
@@ -453,9 +504,21 @@ int Pli::createPartImage(
       Paths::partsDir + "/" + key + ".png";
   QString ldrName = QDir::currentPath() + "/" +
       Paths::tmpDir + "/pli.ldr";
+  if (renderer->useRenderQueue()) {   // queued jobs each need their own input file
+      ldrName = QDir::currentPath() + "/" +
+          Paths::tmpDir + "/" + key + ".ldr";
+    }
   QFile part(imageName);
+
+  if (imageFile) {
+      *imageFile = imageName;
+    }
+
+  QString partLine = orient(color, type);
+  QString imageHash = RenderCache::imageHash(QStringList() << partLine,
+                                             RenderCache::pliSettings(*meta, bom));
   
-  if ( ! part.exists()) {
+  if ( ! part.exists() || ! renderCache.upToDate(imageName,imageHash)) {
 
       QElapsedTimer timer;
       timer.start();
@@ -473,7 +536,7 @@ int Pli::createPartImage(
         }
 
       QTextStream out(&part);
-      out << orient(color, type);
+      out << partLine;
       part.close();
       
       // feed DAT to renderer
@@ -487,6 +550,7 @@ int Pli::createPartImage(
                                .arg(Paths::tmpDir+"/part.dat"));
           return -1;
         }
+      renderCache.update(imageName,imageHash);
 
       //  qDebug() << Render::getRenderer()
         logTrace() << "\n" << Render::getRenderer()
@@ -496,7 +560,10 @@ int Pli::createPartImage(
                    << "for " << (bom ? "BOM part list" : "Step parts list.");
     }
 
-  pixmap->load(imageName);
+  // no pixmap when the image is only being queued for rendering
+  if (pixmap) {
+      imageCache.load(imageName,pixmap);
+    }
 
   return 0;
 }
@@ -538,7 +605,7 @@ int Pli::createPartImagesLDViewSCall(QStringList &ldrNames) {
           return -1;
         }
 
-      if (! pixmap->load(part->imageName)) {
+      if (! imageCache.load(part->imageName,pixmap)) {
               QMessageBox::critical(NULL,QMessageBox::tr(VER_PRODUCTNAME_STR),
                                     QMessageBox::tr("Cannot load pixmap. Image %1 is not a file.")
                                     .arg(part->imageName));
@@ -546,7 +613,8 @@ int Pli::createPartImagesLDViewSCall(QStringList &ldrNames) {
             }
 
       // transfer image info to part
-      QImage image = pixmap->toImage();
+      QImage image;
+      imageCache.image(part->imageName,image);
 
       part->pixmap = new PGraphicsPixmapItem(this,part,*pixmap,parentRelativeType,part->type, part->color);
 
@@ -614,8 +682,7 @@ int Pli::createPartImagesLDViewSCall(QStringList &ldrNames) {
           part->partTopMargin = 0;
         }
       part->topMargin = part->csiMargin.valuePixels(YY);
-      getLeftEdge(image,part->leftEdge);
-      getRightEdge(image,part->rightEdge);
+      imageCache.edgeProfiles(part->imageName,part->leftEdge,part->rightEdge);
 
       part->partBotMargin = part->instanceMeta.margin.valuePixels(YY);
 
@@ -699,8 +766,17 @@ int Pli::placePli(
   pliWidth = 0;
   pliHeight = 0;
 
+  placements++;
+  placedMinHeight = yConstraint;
+  placedMaxHeight = yConstraint;
+
+  int minFit = 0;             // yConstraint only changes the layout through
+  int maxFit = INT_MAX;       // the fits in a column; these are their limits
+  int tallestHeight = 0;
+
   for (int i = 0; i < keys.size(); i++) {
       parts[keys[i]]->placed = false;
+      tallestHeight = qMax(tallestHeight,parts[keys[i]]->height);
       if (parts[keys[i]]->height > yConstraint) {
           yConstraint = parts[keys[i]]->height;
           // return -2;
@@ -848,10 +924,13 @@ int Pli::placePli(
 
                   // overlap = 0;
 
-                  if (bot + part->height + splitMargin - overlap <= yConstraint) {
+                  int fit = bot + part->height + splitMargin - overlap;
+                  if (fit <= yConstraint) {
+                      minFit = qMax(minFit,fit);
                       bot += splitMargin;
                       break;
                     } else {
+                      maxFit = qMin(maxFit,fit - 1);
                       overlapped = false;
                     }
                 }
@@ -1002,9 +1081,28 @@ int Pli::placePli(
 
   pliHeight += botMargin + topMargin;
 
+  // heights below the tallest part are raised to it, so when minFit is
+  // no more than that every smaller height gives this layout too
+  placedMinHeight = minFit > tallestHeight ? minFit : 0;
+  placedMaxHeight = maxFit;
+
   return 0;
 }
 
+/*
+ * The sweeps in resizePli try heights going down by step.  Those down to
+ * placedMinHeight give the layout the last placePli just made, so only
+ * the lowest of them needs looking at.
+ */
+
+static int lowestSameLayout(int height, int step, int placedMinHeight)
+{
+  if (step < 1 || placedMinHeight > height) {
+      return height;
+    }
+  return height - (height - qMax(placedMinHeight,1)) / step * step;
+}
+
 void Pli::placeCols(
     QList<QString> &keys)
 {
@@ -1052,48 +1150,6 @@ void Pli::placeCols(
   size[1] = int(topMargin + height + botMargin);
 }
 
-void Pli::getLeftEdge(
-    QImage     &image,
-    QList<int> &edge)
-{
-  QImage alpha = image.alphaChannel();
-
-  for (int y = 0; y < alpha.height(); y++) {
-      int x;
-      for (x = 0; x < alpha.width(); x++) {
-          QColor c = alpha.pixel(x,y);
-          if (c.blue()) {
-              edge << x;
-              break;
-            }
-        }
-      if (x == alpha.width()) {
-          edge << x - 1;
-        }
-    }
-}
-
-void Pli::getRightEdge(
-    QImage     &image,
-    QList<int> &edge)
-{
-  QImage alpha = image.alphaChannel();
-
-  for (int y = 0; y < alpha.height(); y++) {
-      int x;
-      for (x = alpha.width() - 1; x >= 0; x--) {
-          QColor c = alpha.pixel(x,y);
-          if (c.blue()) {
-              edge << x;
-              break;
-            }
-        }
-      if (x < 0) {
-          edge << 0;
-        }
-    }
-}
-
 int Pli::sortPli()
 {
   // populate part size
@@ -1101,77 +1157,15 @@ int Pli::sortPli()
 
   sortedKeys = parts.keys();
 
-  if (pliMeta.sortBy.value() == SortOptionName[PartColour]){
-
+  // Sort parts by colour or category, if asked for, then by size
+  if (pliMeta.sortBy.value() == SortOptionName[PartColour] ||
+      pliMeta.sortBy.value() == SortOptionName[PartCategory]){
       if (! bom)
         pliMeta.sort.setValue(true);
+    }
 
-      // Sort parts by colour
-      for (int i = 0; i < parts.size() - 1; i++) {
-          for (int j = i+1; j < parts.size(); j++) {
-              if (parts[sortedKeys[i]]->sortColour < parts[sortedKeys[j]]->sortColour) {
-                  QString t = sortedKeys[i];
-                  sortedKeys[i] = sortedKeys[j];
-                  sortedKeys[j] = t;
-                }
-            }
-        }
-
-      // Sort colour-sorted parts by size
-      for (int i = 0; i < parts.size() - 1; i++) {
-          for (int j = i+1; j < parts.size(); j++) {
-              if (parts[sortedKeys[i]]->sortColour == parts[sortedKeys[j]]->sortColour) {
-                  if (parts[sortedKeys[i]]->sortSize < parts[sortedKeys[j]]->sortSize) {
-                      QString t = sortedKeys[i];
-                      sortedKeys[i] = sortedKeys[j];
-                      sortedKeys[j] = t;
-                    }
-                }
-            }
-        }
-
-    } else if (pliMeta.sortBy.value() == SortOptionName[PartCategory]){
-
-      if (! bom)
-        pliMeta.sort.setValue(true);
-
-      // Sort parts by category
-      for (int i = 0; i < parts.size() - 1; i++) {
-          for (int j = i+1; j < parts.size(); j++) {
-              if (parts[sortedKeys[i]]->sortCategory < parts[sortedKeys[j]]->sortCategory) {
-                  QString t = sortedKeys[i];
-                  sortedKeys[i] = sortedKeys[j];
-                  sortedKeys[j] = t;
-                }
-            }
-        }
-
-      // Sort category-sorted parts by size
-      for (int i = 0; i < parts.size() - 1; i++) {
-          for (int j = i+1; j < parts.size(); j++) {
-              if (parts[sortedKeys[i]]->sortCategory == parts[sortedKeys[j]]->sortCategory) {
-                  if (parts[sortedKeys[i]]->sortSize < parts[sortedKeys[j]]->sortSize) {
-                      QString t = sortedKeys[i];
-                      sortedKeys[i] = sortedKeys[j];
-                      sortedKeys[j] = t;
-                    }
-                }
-            }
-        }
+  sortPliKeys(sortedKeys,parts,pliMeta.sortBy.value(),true);
 
-    } else {
-
-      // Sort parts by size
-      for (int i = 0; i < parts.size() - 1; i++) {
-          for (int j = i+1; j < parts.size(); j++) {
-              if (parts[sortedKeys[i]]->sortSize < parts[sortedKeys[j]]->sortSize) {
-                  QString t = sortedKeys[i];
-                  sortedKeys[i] = sortedKeys[j];
-                  sortedKeys[j] = t;
-                }
-            }
-        }
-    }
   return 0;
 }
 
@@ -1189,6 +1183,32 @@ int Pli::partSize()
       widestPart = 0;
       tallestPart = 0;
 
+      // queue all the missing part images first so they render side by
+      // side, then size the parts below once the images are all there
+
+      if (renderer->useRenderQueue()) {
+          foreach(key,parts.keys()) {
+              PliPart *part = parts[key];
+              QFileInfo info(part->type);
+              PieceInfo* pieceInfo = lcGetPiecesLibrary()->FindPiece(info.baseName().toUpper().toLatin1().constData(), NULL, false);
+
+              if (pieceInfo ||
+                  gui->isUnofficialPart(part->type) ||
+                  gui->isSubmodel(part->type)) {
+
+                  QString color = part->color == "16" ? "0" : part->color;
+                  if (createPartImage(key,part->type,color,NULL)) {
+                      return -1;
+                    }
+                }
+            }
+          if (renderQueue.waitForFinished()) {
+              QMessageBox::warning(NULL,QMessageBox::tr("LPub3D"),
+                                   QMessageBox::tr("Failed to create PLI part images"));
+              return -1;
+            }
+        }
+
       foreach(key,parts.keys()) {
           PliPart *part;
 
@@ -1210,7 +1230,8 @@ int Pli::partSize()
                   return -1;
                 }
 
-              if (createPartImage(key,part->type,part->color,pixmap)) {
+              QString imageFile;
+              if (createPartImage(key,part->type,part->color,pixmap,&imageFile)) {
                   QString imageName = Paths::partsDir + "/" + key + ".png";
                   QMessageBox::warning(NULL,QMessageBox::tr("LPub3D"),
                                        QMessageBox::tr("Failed to create PLI part %1")
@@ -1218,7 +1239,8 @@ int Pli::partSize()
                   return -1;
                 }
 
-              QImage image = pixmap->toImage();
+              QImage image;
+              imageCache.image(imageFile,image);
 
               part->pixmap = new PGraphicsPixmapItem(this,part,*pixmap,parentRelativeType,part->type, part->color);
 
@@ -1285,8 +1307,7 @@ int Pli::partSize()
                   part->partTopMargin = 0;
                 }
               part->topMargin = part->csiMargin.valuePixels(YY);
-              getLeftEdge(image,part->leftEdge);
-              getRightEdge(image,part->rightEdge);
+              imageCache.edgeProfiles(imageFile,part->leftEdge,part->rightEdge);
 
               part->partBotMargin = part->instanceMeta.margin.valuePixels(YY);
 
@@ -1338,6 +1359,7 @@ int Pli::partSizeLDViewSCall() {
   widestPart = 0;
   tallestPart = 0;
   QStringList ldrNames;
+  QHash<QString, QString> imageHashes;
 
   // 1. generate ldr files
   foreach(key,parts.keys()) {
@@ -1356,8 +1378,12 @@ int Pli::partSizeLDViewSCall() {
               pliPart->color = "0";
             }
 
+          QString partLine = orient(pliPart->color, pliPart->type);
+          QString imageHash = RenderCache::imageHash(QStringList() << partLine,
+                                                     RenderCache::pliSettings(*meta, bom));
+
           QFile part(pliPart->imageName);
-          if ( ! part.exists()) {
+          if ( ! part.exists() || ! renderCache.upToDate(pliPart->imageName,imageHash)) {
 
               // assemble ldr name
               QString ldrName = QDir::currentPath() + "/" +
@@ -1374,8 +1400,9 @@ int Pli::partSizeLDViewSCall() {
                 }
               // store ldrName
               ldrNames << ldrName;
+              imageHashes.insert(pliPart->imageName,imageHash);
               QTextStream out(&part);
-              out << orient(pliPart->color, pliPart->type);
+              out << partLine;
               part.close();
             }
 
@@ -1394,6 +1421,11 @@ int Pli::partSizeLDViewSCall() {
       return -1;
     }
 
+  QHash<QString, QString>::const_iterator h;
+  for (h = imageHashes.constBegin(); h != imageHashes.constEnd(); ++h) {
+      renderCache.update(h.key(),h.value());
+    }
+
   return 0;
 }
 
@@ -1465,6 +1497,14 @@ int Pli::resizePli(
   bool sortType = pliMeta.sort.value();
   int pliWidth,pliHeight;
 
+  QElapsedTimer timer;
+  timer.start();
+  placements = 0;
+
+#ifdef QT_DEBUG
+  ConstrainData fullSweepData = constrainData;
+#endif
+
   if (constrainData.type == ConstrainData::PliConstrainHeight) {
       int cols;
       int rc;
@@ -1507,6 +1547,10 @@ int Pli::resizePli(
                   if (rc == 0 && cols == bomCols) {
                       break;
                     }
+                  // heights up to placedMaxHeight give this same layout
+                  if (skipSameLayouts && rc == 0 && placedMaxHeight > height) {
+                      height = qMin(placedMaxHeight,maxHeight);
+                    }
                 }
             }
         }
@@ -1542,6 +1586,11 @@ int Pli::resizePli(
                   w = t;
                 }
             }
+          // the lowest height giving this layout is the one to keep
+          if (skipSameLayouts) {
+              height = lowestSameLayout(height,4,placedMinHeight);
+            }
+
           if (w < constrainData.constraint) {
               good_height = height;
             }
@@ -1600,6 +1649,11 @@ int Pli::resizePli(
               min_area = w*h;
               good_height = height;
             }
+
+          // the heights below giving this layout can't do better
+          if (skipSameLayouts) {
+              height = lowestSameLayout(height,step,placedMinHeight);
+            }
         }
       placePli(sortedKeys,10000000,
                good_height,
@@ -1647,6 +1701,11 @@ int Pli::resizePli(
               min_delta = delta;
               good_height = height;
             }
+
+          // the heights below giving this layout can't do better
+          if (skipSameLayouts) {
+              height = lowestSameLayout(height,step,placedMinHeight);
+            }
         }
       placePli(sortedKeys,10000000,
                good_height,
@@ -1660,6 +1719,43 @@ int Pli::resizePli(
   size[0] = pliWidth;
   size[1] = pliHeight;
 
+  logTrace() << "PLI resize of" << parts.size() << "parts took"
+             << placements << "placements in"
+             << timer.elapsed() << "milliseconds";
+
+#ifdef QT_DEBUG
+  // the sweep trying every height must pack the parts the same way;
+  // if it does not, its layout is the one kept
+  if (skipSameLayouts) {
+      QList<QPoint> placed;
+      for (int i = 0; i < sortedKeys.size(); i++) {
+          PliPart *part = parts[sortedKeys[i]];
+          placed << QPoint(part->left,part->bot);
+        }
+      QSize skippedSize(size[0],size[1]);
+      int skippedPlacements = placements;
+
+      skipSameLayouts = false;
+      resizePli(meta,fullSweepData);
+      skipSameLayouts = true;
+
+      bool same = skippedSize == QSize(size[0],size[1]);
+      for (int i = 0; same && i < sortedKeys.size(); i++) {
+          PliPart *part = parts[sortedKeys[i]];
+          same = placed[i] == QPoint(part->left,part->bot);
+        }
+      if (same) {
+          logTrace() << "PLI resize of" << parts.size() << "parts matches the full sweep,"
+                     << skippedPlacements << "placements against" << placements;
+        } else {
+          logError() << "PLI resize of" << parts.size() << "parts, constraint"
+                     << int(fullSweepData.type) << fullSweepData.constraint
+                     << "gave" << skippedSize.width() << "x" << skippedSize.height()
+                     << "but the full sweep gives" << size[0] << "x" << size[1];
+        }
+    }
+#endif
+
   return 0;
 }
 
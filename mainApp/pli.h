@@ -160,6 +160,10 @@ class Pli : public Placement {
                                 // bottomOfStep()
     int                widestPart;
     int                tallestPart;
+    int                placedMinHeight;   // placePli gives the same layout for
+    int                placedMaxHeight;   // heights in this range
+    int                placements;        // placePli calls for the last resize
+    bool               skipSameLayouts;   // resizePli skips heights repeating a layout
 
     Pli(bool _bom = false) : bom(_bom)
     {
@@ -170,6 +174,10 @@ class Pli : public Placement {
       meta = NULL;
       widestPart = 1;
       tallestPart = 1;
+      placedMinHeight = 0;
+      placedMaxHeight = 0;
+      placements = 0;
+      skipSameLayouts = true;
       background = NULL;
       splitBom = false;
     }
@@ -220,7 +228,7 @@ class Pli : public Placement {
     bool initAnnotationString();
     void getAnnotate(QString &, QString &);
     void partClass(QString &, QString &);
-    int  createPartImage(QString &, QString &, QString &, QPixmap*);
+    int  createPartImage(QString &, QString &, QString &, QPixmap*, QString *imageFile = NULL);
     int  createPartImagesLDViewSCall(QStringList &);      //LDView performance improvement
     QString orient(QString &color, QString part);
 
@@ -236,8 +244,6 @@ class Pli : public Placement {
       bom       = from.bom;
     }
 
-    void getLeftEdge(QImage &, QList<int> &);
-    void getRightEdge(QImage &, QList<int> &);
 
 };
 
@@ -82,6 +82,14 @@ PreferencesDialog::PreferencesDialog(QWidget *_parent) :
   ui.showAllNotificstions_Chk->setChecked(          Preferences::showAllNotifications);
   ui.checkUpdateFrequency_Combo->setCurrentIndex(   Preferences::checkUpdateFrequency);
   ui.rendererTimeout->setValue(                     Preferences::rendererTimeout);
+  ui.rendererProcesses->setValue(                   Preferences::rendererProcesses);
+  ui.exportThreads->setValue(                       Preferences::exportThreads);
+  ui.exportCompression->setValue(                   Preferences::exportCompression);
+  ui.pdfImageDpi->setValue(                         Preferences::pdfImageDpi);
+  ui.pdfLosslessImages_Chk->setChecked(             Preferences::pdfLosslessImages);
+#if QT_VERSION < QT_VERSION_CHECK(5,13,0)
+  ui.pdfLosslessImages_Chk->setEnabled(false);
+#endif
   ui.povrayDisplay_Chk->setChecked(                 Preferences::povrayDisplay);
 
   ui.loggingGrpBox->setChecked(                     Preferences::logging);
@@ -493,6 +501,31 @@ int PreferencesDialog::rendererTimeout()
   return ui.rendererTimeout->value();
 }
 
+int PreferencesDialog::rendererProcesses()
+{
+  return ui.rendererProcesses->value();
+}
+
+int PreferencesDialog::exportThreads()
+{
+  return ui.exportThreads->value();
+}
+
+int PreferencesDialog::exportCompression()
+{
+  return ui.exportCompression->value();
+}
+
+int PreferencesDialog::pdfImageDpi()
+{
+  return ui.pdfImageDpi->value();
+}
+
+bool PreferencesDialog::pdfLosslessImages()
+{
+  return ui.pdfLosslessImages_Chk->isChecked();
+}
+
 bool PreferencesDialog::includeLogLevel()
 {
   return ui.includeLogLevelBox->isChecked();
@@ -69,6 +69,11 @@ class PreferencesDialog : public QDialog
     bool          povrayDisplay();
     int           checkUpdateFrequency();
     int           rendererTimeout();   
+    int           rendererProcesses();
+    int           exportThreads();
+    int           exportCompression();
+    int           pdfImageDpi();
+    bool          pdfLosslessImages();
 
     bool          includeLogLevel();
     bool          includeTimestamp();
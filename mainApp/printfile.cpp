@@ -29,9 +29,17 @@
 #include <QUrl>
 #include <QProcess>
 #include <QErrorMessage>
+#include <QImageWriter>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
 #include <algorithm>
+#include <cstdio>
 
 #include "lpub.h"
+#include "rendercache.h"
+#include "resolution.h"
 
 // Compare two variants.
 bool lessThan(const int &v1, const int &v2)
@@ -413,10 +421,6 @@ bool Gui::exportAsDialog(ExportType t)
 
 void Gui::exportAsPdf()
 {
-
-  // store current display page number
-  int savePageNumber = displayPageNum;
-
   // send signal to halt 3DViewer
   setExportingSig(true);
 
@@ -476,36 +480,113 @@ void Gui::exportAsPdf()
         }
     }
 
+  if ( ! exportPdfFile(fileName)) {
+      drawPage(KpageView,KpageScene,false);
+      emit messageSig(true,QString("Export to pdf terminated before completion."));
+      return;
+    }
+
+  // release 3D Viewer
+  setExportingSig(false);
+
+  // return to whatever page we were viewing before output
+  drawPage(KpageView,KpageScene,false);
+
+  emit messageSig(true,QString("Export to pdf completed."));
+
+  box.setIcon (QMessageBox::Information);
+  box.setStandardButtons (QMessageBox::Yes | QMessageBox::No);
+  box.setDefaultButton   (QMessageBox::Yes);
+
+  //display completion message
+  QString title = "<b> Export to pdf completed. </b>";
+  QString text = tr ("Your instruction document has finished exporting.\n"
+                     "Do you want to open this document ?\n %1").arg(fileName);
+
+  box.setText (title);
+  box.setInformativeText (text);
+
+  if (box.exec() == QMessageBox::Yes) {
+      QString CommandPath = fileName;
+      QProcess *Process = new QProcess(this);
+      Process->setWorkingDirectory(QDir::currentPath() + "/");
+
+#ifdef Q_OS_WIN
+      Process->setNativeArguments(CommandPath);
+      QDesktopServices::openUrl((QUrl("file:///"+CommandPath, QUrl::TolerantMode)));
+#else
+      Process->execute(CommandPath);
+      Process->waitForFinished();
+
+      QProcess::ExitStatus Status = Process->exitStatus();
+
+      if (Status != 0) {  // look for error
+          QErrorMessage *m = new QErrorMessage(this);
+          m->showMessage(QString("%1\n%2").arg("Failed to launch PDF document!").arg(CommandPath));
+        }
+#endif
+      return;
+    } else {
+      return;
+    }
+}
+
+/*
+ * Write the pages picked by exportOption to the pdf fileName.  Nothing
+ * is asked here, so the command line export (batchexport.cpp) uses this
+ * too.  Returns false if the export was cancelled before completion.
+ */
+
+bool Gui::exportPdfFile(const QString &fileName)
+{
+  // store current display page number
+  int savePageNumber = displayPageNum;
+
   // determine size of output pages, in pixels
   float pageWidthPx, pageHeightPx;
 
   // create a PDF pdfWriter
   QPdfWriter pdfWriter(fileName);
 
+  QElapsedTimer exportTimer;
+  exportTimer.start();
+
+  // the image cache gives each page the same pixmap for the same image,
+  // so each is embedded once; images finer than Preferences::pdfImageDpi
+  // are scaled down to it
+  float imageDpi   = resolutionType() == DPI ? resolution() : resolution() * 2.54;
+  qreal imageScale = 1.0;
+  if (Preferences::pdfImageDpi > 0 && imageDpi > Preferences::pdfImageDpi) {
+      imageScale = Preferences::pdfImageDpi / imageDpi;
+    }
+  imageCache.setPixmapScale(imageScale);
+
   // instantiate the scene and view
   QGraphicsScene scene;
   LGraphicsView view(&scene);
 
   // initialize page sizes
   logStatus() << "INITIALIZE PAGE SIZES START ---->>>>";
+  QElapsedTimer pageSizesTimer;
+  pageSizesTimer.start();
   displayPageNum = 0;
   drawPage(&view,&scene,true);
   clearPage(&view,&scene);
   displayPageNum = savePageNumber;
   logStatus() << "INITIALIZE PAGE SIZES END  ----<<<<";
+  exportProgress(QString("Page sizes for %1 pages. %2").arg(maxPages).arg(elapsedTime(pageSizesTimer.elapsed())));
 
   int _displayPageNum = 0;
   int _maxPages       = 0;
 
   // initialize progress bar dialog
-  m_progressDialog->setWindowTitle("Export pdf");
-  m_progressDialog->show();
+  exportProgressStart("Export pdf");
 
   // reset page indicators
   _displayPageNum = 0;
   _maxPages       = 0;
 
-  m_progressDlgMessageLbl->setText("Exporting instructions to pdf...");
+  exportProgress("Exporting instructions to pdf...");
 
   if (exportOption != EXPORT_PAGE_RANGE){
 
@@ -519,7 +600,7 @@ void Gui::exportAsPdf()
           _maxPages       = displayPageNum;
         }
 
-      m_progressDlgProgressBar->setRange(1,_maxPages);
+      exportProgressRange(_maxPages);
       // set displayPageNum so we can send the correct index to retrieve page size data
       displayPageNum = _displayPageNum;
       // set initial page layout
@@ -528,21 +609,22 @@ void Gui::exportAsPdf()
       // paint to the pdfWriter the scene we view
       QPainter painter;
       painter.begin(&pdfWriter);
+#if QT_VERSION >= QT_VERSION_CHECK(5,13,0)
+      // the pdf engine writes images as JPEG at a fixed quality unless asked not to
+      painter.setRenderHint(QPainter::LosslessImageRendering, Preferences::pdfLosslessImages);
+#endif
 
       for (displayPageNum = _displayPageNum; displayPageNum <= _maxPages; displayPageNum++) {
 
           if (! exporting()) {
               painter.end();
-              m_progressDialog->hide();
+              imageCache.setPixmapScale(1.0);
+              exportProgressStop();
               displayPageNum = savePageNumber;
-              drawPage(KpageView,KpageScene,false);
-              emit messageSig(true,QString("Export to pdf terminated before completion."));
-              return;
+              return false;
             }
 
-          m_progressDlgMessageLbl->setText(QString("Exporting page %1 of %2").arg(displayPageNum).arg(_maxPages));
-          m_progressDlgProgressBar->setValue(displayPageNum);
-          QApplication::processEvents();
+          exportProgress(QString("Exporting page %1 of %2").arg(displayPageNum).arg(_maxPages),displayPageNum);
 
           getExportPageSize(pageWidthPx, pageHeightPx);
 
@@ -583,7 +665,7 @@ void Gui::exportAsPdf()
             }
         }
       painter.end();
-      m_progressDlgProgressBar->setValue(_maxPages);
+      exportProgressValue(_maxPages);
 
     } else {
 
@@ -604,7 +686,7 @@ void Gui::exportAsPdf()
 
       std::sort(printPages.begin(),printPages.end(),lessThan);
 
-       m_progressDlgProgressBar->setRange(1,printPages.count());
+      exportProgressRange(printPages.count());
 
       int _pageCount = 0;
 
@@ -616,23 +698,24 @@ void Gui::exportAsPdf()
       // paint to the pdfWriter the scene we view
       QPainter painter;
       painter.begin(&pdfWriter);
+#if QT_VERSION >= QT_VERSION_CHECK(5,13,0)
+      // the pdf engine writes images as JPEG at a fixed quality unless asked not to
+      painter.setRenderHint(QPainter::LosslessImageRendering, Preferences::pdfLosslessImages);
+#endif
 
       foreach(int printPage,printPages){
 
           if (! exporting()) {
               painter.end();
-              m_progressDialog->hide();
+              imageCache.setPixmapScale(1.0);
+              exportProgressStop();
               displayPageNum = savePageNumber;
-              drawPage(KpageView,KpageScene,false);
-              emit messageSig(true,QString("Export to pdf terminated before completion."));
-              return;
+              return false;
             }
 
           displayPageNum = printPage;
 
-          m_progressDlgMessageLbl->setText(QString("Exporting page %1 of %2 for range %3").arg(displayPageNum).arg(printPages.count()).arg(pageRanges.join(" ")));
-          m_progressDlgProgressBar->setValue(_pageCount++);
-          QApplication::processEvents();
+          exportProgress(QString("Exporting page %1 of %2 for range %3").arg(displayPageNum).arg(printPages.count()).arg(pageRanges.join(" ")),_pageCount++);
 
           // determine size of output image, in pixels
           getExportPageSize(pageWidthPx, pageHeightPx);
@@ -675,35 +758,95 @@ void Gui::exportAsPdf()
             }
         }
       painter.end();
-      m_progressDlgProgressBar->setValue(printPages.count());
+      exportProgressValue(printPages.count());
     }
 
-  // release 3D Viewer
-  setExportingSig(false);
+  imageCache.setPixmapScale(1.0);
+
+  logStatus() << QString("Exported pdf %1, %2 KB, images at %3 DPI. %4")
+                 .arg(fileName)
+                 .arg(QFileInfo(fileName).size() / 1024)
+                 .arg(int(imageDpi * imageScale))
+                 .arg(elapsedTime(exportTimer.elapsed()));
+  logStatus() << "Image cache:" << imageCache.statistics();
 
   // return to whatever page we were viewing before output
   displayPageNum = savePageNumber;
-  drawPage(KpageView,KpageScene,false);
 
   // hide progress bar
-  m_progressDialog->hide();
+  exportProgressStop();
 
-  emit messageSig(true,QString("Export to pdf completed."));
+  return true;
+}
 
+void Gui::exportAsPng()
+{
+  QString suffix(".png");
+  exportAs(suffix);
+}
+
+void Gui::exportAsJpg()
+{
+  QString suffix(".jpg");
+  exportAs(suffix);
+}
+
+void Gui::exportAsBmp()
+{
+  QString suffix(".bmp");
+  exportAs(suffix);
+}
+
+void Gui::exportAs(QString &suffix)
+{
+  // send signal to halt 3DViewer
+  setExportingSig(true);
+
+  // determine location to output images
+  QString directoryName = QFileDialog::getExistingDirectory(
+        this,
+        tr("Save images to folder"), // needs translation! also, include suffix in here
+        QDir::currentPath(),
+        QFileDialog::ShowDirsOnly);
+  if (directoryName == "") {
+      // release 3D Viewer
+      setExportingSig(false);
+      return;
+    }
+
+  if ( ! exportImageFiles(suffix,directoryName)) {
+      drawPage(KpageView,KpageScene,false);
+      emit messageSig(true,QString("Export terminated before completion."));
+      return;
+    }
+
+  // release 3D Viewer
+  setExportingSig(false);
+
+  // return to whatever page we were viewing before output
+  drawPage(KpageView,KpageScene,false);
+
+  emit messageSig(true,QString("Export as %1 completed.").arg(suffix.remove(".")));
+
+  //display completion message
+  QMessageBox box;
+  box.setTextFormat (Qt::RichText);
   box.setIcon (QMessageBox::Information);
-  box.setStandardButtons (QMessageBox::Yes | QMessageBox::No);
+  box.setStandardButtons (QMessageBox::Yes| QMessageBox::No);
   box.setDefaultButton   (QMessageBox::Yes);
+  box.setWindowFlags (Qt::Dialog | Qt::CustomizeWindowHint | Qt::WindowTitleHint);
+  box.setWindowTitle(tr ("Export %1").arg(suffix.remove(".")));
 
-  //display completion message
-  QString title = "<b> Export to pdf completed. </b>";
-  QString text = tr ("Your instruction document has finished exporting.\n"
-                     "Do you want to open this document ?\n %1").arg(fileName);
+  QString title = "<b> Export " + suffix.remove(".") + " completed. </b>";
+  QString text = tr ("Your instruction document images are finished exporting.\n"
+                     "Do you want to open the image folder ?\n %1")
+                     .arg(directoryName);
 
   box.setText (title);
   box.setInformativeText (text);
 
-  if (box.exec() == QMessageBox::Yes) {
-      QString CommandPath = fileName;
+  if (box.exec() == QMessageBox::Yes){
+      QString CommandPath = directoryName;
       QProcess *Process = new QProcess(this);
       Process->setWorkingDirectory(QDir::currentPath() + "/");
 
@@ -718,7 +861,7 @@ void Gui::exportAsPdf()
 
       if (Status != 0) {  // look for error
           QErrorMessage *m = new QErrorMessage(this);
-          m->showMessage(QString("%1\n%2").arg("Failed to launch PDF document!").arg(CommandPath));
+          m->showMessage(QString("%1\n%2").arg("Failed to open image folder!").arg(CommandPath));
         }
 #endif
       return;
@@ -727,151 +870,110 @@ void Gui::exportAsPdf()
     }
 }
 
-void Gui::exportAsPng()
-{
-  QString suffix(".png");
-  exportAs(suffix);
-}
-
-void Gui::exportAsJpg()
-{
-  QString suffix(".jpg");
-  exportAs(suffix);
-}
+/*
+ * Encodes and writes one exported page image, so the GUI thread can lay
+ * out and draw the next page meanwhile.  The slot is given back when the
+ * image is written, which bounds the page images held in memory.
+ */
 
-void Gui::exportAsBmp()
+class ImageWriteJob : public QRunnable
 {
-  QString suffix(".bmp");
-  exportAs(suffix);
-}
-
-void Gui::exportAs(QString &suffix)
+public:
+  ImageWriteJob(
+    const QImage  &_image,
+    const QString &_fileName,
+    QSemaphore    &_slots,
+    QAtomicInt    &_failed)
+    : image(_image),
+      fileName(_fileName),
+      freeSlots(_slots),
+      failed(_failed)
+  {
+  }
+
+  void run()
+  {
+    QImageWriter writer(fileName);
+    if (fileName.endsWith(".png",Qt::CaseInsensitive)) {
+        // Qt before 5.10 ignores the compression of png files, its png
+        // handler takes the level from the quality: (100 - quality) * 9 / 91
+        int level = Preferences::exportCompression;
+        if (writer.supportsOption(QImageIOHandler::CompressionRatio)) {
+            writer.setCompression(level);
+          } else {
+            writer.setQuality(100 - (level * 91 + 8) / 9);
+          }
+      }
+    if ( ! writer.write(image)) {
+        logError() << QString("Cannot write image %1: %2").arg(fileName).arg(writer.errorString());
+        failed.ref();
+      }
+    image = QImage();
+    freeSlots.release();
+  }
+
+private:
+  QImage      image;
+  QString     fileName;
+  QSemaphore &freeSlots;
+  QAtomicInt &failed;
+};
+
+/*
+ * Write the pages picked by exportOption as suffix images into
+ * directoryName, without asking anything.  Returns false if the export
+ * was cancelled before completion or an image could not be written.
+ *
+ * Pages are laid out and drawn into an image in order on the GUI thread,
+ * as the page scene can't be used anywhere else.  Encoding and writing
+ * the images, the larger part of the time, is handed to a pool of
+ * Preferences::exportThreads threads with at most one more image waiting
+ * than there are threads.
+ */
+
+bool Gui::exportImageFiles(const QString &suffix, const QString &directoryName)
 {
   // store current display page number
   int savePageNumber = displayPageNum;
 
-  // send signal to halt 3DViewer
-  setExportingSig(true);
-
-  // determine location to output images
   QFileInfo fileInfo(curFile);
-  //QDir initialDirectory = fileInfo.dir();
   QString baseName = fileInfo.baseName();
-  QString directoryName = QFileDialog::getExistingDirectory(
-        this,
-        tr("Save images to folder"), // needs translation! also, include suffix in here
-        QDir::currentPath(),
-        QFileDialog::ShowDirsOnly);
-  if (directoryName == "") {
-      // release 3D Viewer
-      setExportingSig(false);
-      return;
-    }
 
   QGraphicsScene scene;
   LGraphicsView view(&scene);
   float pageWidthPx, pageHeightPx;
-  int _displayPageNum = 0;
-  int _maxPages       = 0;
+
+  QElapsedTimer exportTimer;
+  exportTimer.start();
 
   // initialize page sizes
+  QElapsedTimer pageSizesTimer;
+  pageSizesTimer.start();
   displayPageNum = 0;
   drawPage(&view,&scene,true);
   clearPage(&view,&scene);
   displayPageNum = savePageNumber;
+  exportProgress(QString("Page sizes for %1 pages. %2").arg(maxPages).arg(elapsedTime(pageSizesTimer.elapsed())));
 
   // Support transparency for formats that can handle it, but use white for those that can't.
   //QColor fillClear = (suffix.compare(".png", Qt::CaseInsensitive) == 0) ? Qt::transparent :  Qt::white;
   QColor::Spec fillClear = QColor((suffix.compare(".png", Qt::CaseInsensitive) == 0) ? Qt::transparent :  Qt::white).Rgb;
 
-  // initialize progress bar
-  m_progressDialog->setWindowTitle(QString("Export as %1").arg(suffix));
-  m_progressDialog->show();
-  m_progressDlgMessageLbl->setText(QString("Exporting instructions to %1 format.").arg(suffix));
+  // the pages to export
+  QList<int> printPages;
+  QString rangeText;
 
   if (exportOption != EXPORT_PAGE_RANGE){
 
-      if(exportOption == EXPORT_ALL_PAGES){
-          _displayPageNum = 1;
-          _maxPages = maxPages;
+      int firstPage = exportOption == EXPORT_CURRENT_PAGE ? displayPageNum : 1;
+      int lastPage  = exportOption == EXPORT_CURRENT_PAGE ? displayPageNum : maxPages;
+      for (int i = firstPage; i <= lastPage; i++){
+          printPages.append(i);
         }
 
-      if (exportOption == EXPORT_CURRENT_PAGE){
-          _displayPageNum = displayPageNum;
-          _maxPages       = displayPageNum;
-        }
-
-      m_progressDlgProgressBar->setRange(1,_maxPages);
-
-      for (displayPageNum = _displayPageNum; displayPageNum <= _maxPages; displayPageNum++) {
-
-          if (! exporting()) {
-              m_progressDialog->hide();
-              displayPageNum = savePageNumber;
-              drawPage(KpageView,KpageScene,false);
-              emit messageSig(true,QString("Export terminated before completion."));
-              return;
-            }
-
-          m_progressDlgMessageLbl->setText(QString("Exporting image: %1 of %2").arg(displayPageNum).arg(_maxPages));
-          m_progressDlgProgressBar->setValue(displayPageNum);
-          QApplication::processEvents();
-
-          // determine size of output image, in pixels
-          getExportPageSize(pageWidthPx, pageHeightPx);
-
-          bool  ls = getPageOrientation() == Landscape;
-          logNotice() << QString("Exporting image %3 of %4, size(in pixels) W %1 x H %2, orientation %5")
-                         .arg(pageWidthPx)
-                         .arg(pageHeightPx)
-                         .arg(displayPageNum)
-                         .arg(_maxPages)
-                         .arg(ls ? "Landscape" : "Portrait");
-
-          // paint to the image the scene we view
-          QImage image(pageWidthPx, pageHeightPx, QImage::Format_ARGB32);
-          QPainter painter;
-          painter.begin(&image);
-
-          QRectF boundingRect(0.0,0.0,pageWidthPx,pageHeightPx);
-          QRect  bounding(0,0,pageWidthPx,pageHeightPx);
-          view.scale(1.0,1.0);
-          view.setMinimumSize(pageWidthPx, pageHeightPx);
-          view.setMaximumSize(pageWidthPx, pageHeightPx);
-          view.setGeometry(bounding);
-          view.setSceneRect(boundingRect);
-          view.setRenderHints(
-                QPainter::Antialiasing |
-                QPainter::TextAntialiasing |
-                QPainter::SmoothPixmapTransform);
-          view.centerOn(boundingRect.center());
-          clearPage(&view,&scene);
-
-          // clear the pixels of the image, just in case the background is
-          // transparent or uses a PNG image with transparency. This will
-          // prevent rendered pixels from each page layering on top of each
-          // other.
-          //image.fill(fillClear.Rgb);
-          image.fill(fillClear);
-          // render this page
-          // scene.render instead of view.render resolves "warm up" issue
-          drawPage(&view,&scene,false);
-          scene.setSceneRect(0.0,0.0,pageWidthPx,pageHeightPx);
-          scene.render(&painter);
-          clearPage(&view,&scene);
-          // save the image to the selected directory
-          // internationalization of "_page_"?
-          QString pn = QString("%1") .arg(displayPageNum);
-          image.save( QDir::toNativeSeparators(directoryName + "/" + baseName + "_page_" + pn + suffix));
-
-          painter.end();
-        }
-      m_progressDlgProgressBar->setValue(_maxPages);
-
     } else {
 
       QStringList pageRanges = pageRangeText.split(",");
-      QList<int> printPages;
       foreach(QString ranges,pageRanges){
           if (ranges.contains("-")){
               QStringList range = ranges.split("-");
@@ -886,130 +988,158 @@ void Gui::exportAs(QString &suffix)
         }
 
       std::sort(printPages.begin(),printPages.end(),lessThan);
+      rangeText = pageRanges.join(" ");
+    }
 
-      m_progressDlgProgressBar->setRange(1,printPages.count());
+  // initialize progress bar
+  exportProgressStart(QString("Export as %1").arg(suffix));
+  exportProgress(QString("Exporting instructions to %1 format.").arg(suffix));
+  exportProgressRange(printPages.count());
+
+  int threads = qMax(1,Preferences::exportThreads);
+  QThreadPool writers;
+  writers.setMaxThreadCount(threads);
+  QSemaphore freeSlots(threads + 1);
+  QAtomicInt failed(0);
+
+  for (int pageCount = 0; pageCount < printPages.count(); pageCount++) {
+
+      if (! exporting()) {
+          writers.waitForDone();
+          exportProgressStop();
+          displayPageNum = savePageNumber;
+          return false;
+        }
 
-      int _pageCount = 0;
+      displayPageNum = printPages[pageCount];
 
-      foreach(int printPage,printPages){
+      if (rangeText.isEmpty()) {
+          exportProgress(QString("Exporting image: %1 of %2").arg(displayPageNum).arg(printPages.last()),pageCount + 1);
+        } else {
+          exportProgress(QString("Exporting image %1 of range %2").arg(displayPageNum).arg(rangeText),pageCount + 1);
+        }
 
-          if (! exporting()) {
-              m_progressDialog->hide();
-              displayPageNum = savePageNumber;
-              drawPage(KpageView,KpageScene,false);
-              emit messageSig(true,QString("Export terminated before completion."));
-              return;
-            }
+      // determine size of output image, in pixels
+      getExportPageSize(pageWidthPx, pageHeightPx);
 
-          displayPageNum = printPage;
+      bool  ls = getPageOrientation() == Landscape;
+      logNotice() << QString("Exporting image %3 of %4, size(in pixels) W %1 x H %2, orientation %5")
+                     .arg(pageWidthPx)
+                     .arg(pageHeightPx)
+                     .arg(displayPageNum)
+                     .arg(rangeText.isEmpty() ? QString::number(printPages.last()) : "range " + rangeText)
+                     .arg(ls ? "Landscape" : "Portrait");
 
-          m_progressDlgMessageLbl->setText(QString("Exporting image %1 of range %2").arg(displayPageNum).arg(pageRanges.join(" ")));
-          m_progressDlgProgressBar->setValue(_pageCount++);
+      // wait for a free slot, so only so many page images are held
+      while ( ! freeSlots.tryAcquire(1,100)) {
           QApplication::processEvents();
+        }
 
-          // determine size of output image, in pixels
-          getExportPageSize(pageWidthPx, pageHeightPx);
+      // paint to the image the scene we view
+      QImage image(pageWidthPx, pageHeightPx, QImage::Format_ARGB32);
+      QPainter painter;
+      painter.begin(&image);
+
+      QRectF boundingRect(0.0,0.0,pageWidthPx,pageHeightPx);
+      QRect  bounding(0,0,pageWidthPx,pageHeightPx);
+      view.scale(1.0,1.0);
+      view.setMinimumSize(pageWidthPx, pageHeightPx);
+      view.setMaximumSize(pageWidthPx, pageHeightPx);
+      view.setGeometry(bounding);
+      view.setSceneRect(boundingRect);
+      view.setRenderHints(
+            QPainter::Antialiasing |
+            QPainter::TextAntialiasing |
+            QPainter::SmoothPixmapTransform);
+      view.centerOn(boundingRect.center());
+      clearPage(&view,&scene);
+
+      // clear the pixels of the image, just in case the background is
+      // transparent or uses a PNG image with transparency. This will
+      // prevent rendered pixels from each page layering on top of each
+      // other.
+      //image.fill(fillClear.Rgb);
+      image.fill(fillClear);
+      // render this page
+      // scene.render instead of view.render resolves "warm up" issue
+      drawPage(&view,&scene,false);
+      scene.setSceneRect(0.0,0.0,pageWidthPx,pageHeightPx);
+      scene.render(&painter);
+      clearPage(&view,&scene);
+      painter.end();
 
-          bool  ls = getPageOrientation() == Landscape;
-          logNotice() << QString("Exporting image %3 of range %4, size(in pixels) W %1 x H %2, orientation %5")
-                         .arg(pageWidthPx)
-                         .arg(pageHeightPx)
-                         .arg(displayPageNum)
-                         .arg(pageRanges.join(" "))
-                         .arg(ls ? "Landscape" : "Portrait");
-
-          // paint to the image the scene we view
-          QImage image(pageWidthPx, pageHeightPx, QImage::Format_ARGB32);
-          QPainter painter;
-          painter.begin(&image);
-
-          QRectF boundingRect(0.0,0.0,pageWidthPx,pageHeightPx);
-          QRect  bounding(0,0,pageWidthPx,pageHeightPx);
-          view.scale(1.0,1.0);
-          view.setMinimumSize(pageWidthPx, pageHeightPx);
-          view.setMaximumSize(pageWidthPx, pageHeightPx);
-          view.setGeometry(bounding);
-          view.setSceneRect(boundingRect);
-          view.setRenderHints(
-                QPainter::Antialiasing |
-                QPainter::TextAntialiasing |
-                QPainter::SmoothPixmapTransform);
-          view.centerOn(boundingRect.center());
-          clearPage(&view,&scene);
-          // clear the pixels of the image, just in case the background is
-          // transparent or uses a PNG image with transparency. This will
-          // prevent rendered pixels from each page layering on top of each
-          // other.
-          //image.fill(fillClear.Rgb);
-          image.fill(fillClear);
-          // render this page
-          // scene.render instead of view.render resolves "warm up" issue
-          drawPage(&view,&scene,false);
-          scene.setSceneRect(0.0,0.0,pageWidthPx,pageHeightPx);
-          scene.render(&painter);
-          clearPage(&view,&scene);
-          // save the image to the selected directory
-          // internationalization of "_page_"?
-          QString pn = QString("%1") .arg(displayPageNum);
-          image.save( QDir::toNativeSeparators(directoryName + "/" + baseName + "_page_" + pn + suffix));
+      // save the image to the selected directory
+      // internationalization of "_page_"?
+      QString pn = QString("%1") .arg(displayPageNum);
+      writers.start(new ImageWriteJob(image,
+                                      QDir::toNativeSeparators(directoryName + "/" + baseName + "_page_" + pn + suffix),
+                                      freeSlots,
+                                      failed));
+    }
 
-          painter.end();
-        }
-      m_progressDlgProgressBar->setValue(printPages.count());
+  while ( ! writers.waitForDone(100)) {
+      QApplication::processEvents();
     }
+  exportProgressValue(printPages.count());
 
-  // release 3D Viewer
-  setExportingSig(false);
+  logStatus() << QString("Exported %1 %2 images with %3 writer threads. %4")
+                 .arg(printPages.count())
+                 .arg(suffix)
+                 .arg(threads)
+                 .arg(elapsedTime(exportTimer.elapsed()));
 
   // return to whatever page we were viewing before output
   displayPageNum = savePageNumber;
-  drawPage(KpageView,KpageScene,false);
 
   // hide progress bar
-  m_progressDialog->hide();
-
-  emit messageSig(true,QString("Export as %1 completed.").arg(suffix.remove(".")));
+  exportProgressStop();
 
-  //display completion message
-  QMessageBox box;
-  box.setTextFormat (Qt::RichText);
-  box.setIcon (QMessageBox::Information);
-  box.setStandardButtons (QMessageBox::Yes| QMessageBox::No);
-  box.setDefaultButton   (QMessageBox::Yes);
-  box.setWindowFlags (Qt::Dialog | Qt::CustomizeWindowHint | Qt::WindowTitleHint);
-  box.setWindowTitle(tr ("Export %1").arg(suffix.remove(".")));
+  if (failed.load()) {
+      emit messageSig(false,QString("%1 of %2 images could not be written to %3.")
+                      .arg(failed.load()).arg(printPages.count()).arg(directoryName));
+      return false;
+    }
 
-  QString title = "<b> Export " + suffix.remove(".") + " completed. </b>";
-  QString text = tr ("Your instruction document images are finished exporting.\n"
-                     "Do you want to open the image folder ?\n %1")
-                     .arg(directoryName);
+  return true;
+}
 
-  box.setText (title);
-  box.setInformativeText (text);
+void Gui::exportProgressStart(const QString &title)
+{
+  if (m_batchExporting)
+    return;
+  m_progressDialog->setWindowTitle(title);
+  m_progressDialog->show();
+}
 
-  if (box.exec() == QMessageBox::Yes){
-      QString CommandPath = directoryName;
-      QProcess *Process = new QProcess(this);
-      Process->setWorkingDirectory(QDir::currentPath() + "/");
+void Gui::exportProgress(const QString &text, int value)
+{
+  if (m_batchExporting) {
+      fprintf(stdout,"%s\n",qPrintable(text));
+      fflush(stdout);
+      return;
+    }
+  m_progressDlgMessageLbl->setText(text);
+  if (value >= 0)
+    m_progressDlgProgressBar->setValue(value);
+  QApplication::processEvents();
+}
 
-#ifdef Q_OS_WIN
-      Process->setNativeArguments(CommandPath);
-      QDesktopServices::openUrl((QUrl("file:///"+CommandPath, QUrl::TolerantMode)));
-#else
-      Process->execute(CommandPath);
-      Process->waitForFinished();
+void Gui::exportProgressRange(int max)
+{
+  if (! m_batchExporting)
+    m_progressDlgProgressBar->setRange(1,max);
+}
 
-      QProcess::ExitStatus Status = Process->exitStatus();
+void Gui::exportProgressValue(int value)
+{
+  if (! m_batchExporting)
+    m_progressDlgProgressBar->setValue(value);
+}
 
-      if (Status != 0) {  // look for error
-          QErrorMessage *m = new QErrorMessage(this);
-          m->showMessage(QString("%1\n%2").arg("Failed to open image folder!").arg(CommandPath));
-        }
-#endif
-      return;
-    } else {
-      return;
-    }
+void Gui::exportProgressStop()
+{
+  if (! m_batchExporting)
+    m_progressDialog->hide();
 }
 
 //-----------------PRINT FUNCTIONS------------------------//
@@ -36,10 +36,13 @@
 #include <QStringList>
 #include <QPixmap>
 #include <QProcess>
+#include <QRunnable>
 #include <QFile>
 #include <QDir>
 #include <QTextStream>
 #include "render.h"
+#include "rendercache.h"
+#include "imageanalysis.h"
 #include "resolution.h"
 #include "meta.h"
 #include "math.h"
@@ -60,6 +63,8 @@ LDGLite ldglite;
 LDView  ldview;
 POVRay  povray;
 
+RenderQueue renderQueue;
+
 
 //#define LduDistance 5729.57
 #define CA "-ca0.01"
@@ -143,100 +148,134 @@ bool Render::useLDViewSCall(bool override){
     return Preferences::useLDViewSingleCall;
 }
 
+/*
+ * POV-Ray renders in two dependent stages (LDView to .pov, then POV-Ray)
+ * and LDView single call already batches a page into one process, so the
+ * render queue is only used for the one image per process renderers.
+ */
+
+bool Render::useRenderQueue(){
+  return Preferences::rendererProcesses > 1 &&
+         ! useLDViewSCall()                 &&
+         renderer != &povray;
+}
+
+/*
+ * Render queue
+ */
+
+class RenderJobRunner : public QRunnable
+{
+public:
+  RenderJobRunner(RenderJob *_job, QSemaphore *_finished)
+    : job(_job), finished(_finished) {}
+
+  void run()
+  {
+    // an image left from an earlier render must not pass for this one
+    QFile::remove(job->imageName);
+
+    QProcess process;
+    process.setEnvironment(job->environment);
+    process.setWorkingDirectory(job->workingDirectory);
+    process.setProcessChannelMode(QProcess::MergedChannels);
+    process.start(job->program,job->arguments);
+
+    if ( ! process.waitForFinished(job->timeout)) {
+        process.kill();
+        process.waitForFinished(1000);
+        job->failed = true;
+      }
+    job->exitCode = process.exitCode();
+    job->output   = QString(process.readAll());
+
+    if (process.exitStatus() != QProcess::NormalExit || job->exitCode != 0) {
+        job->failed = true;
+      }
+
+    if ( ! QFileInfo(job->imageName).exists()) {
+        job->failed = true;
+      }
+
+    finished->release();
+  }
+
+private:
+  RenderJob  *job;
+  QSemaphore *finished;
+};
+
+RenderQueue::~RenderQueue()
+{
+  pool.waitForDone();
+  qDeleteAll(jobs);
+}
+
+void RenderQueue::enqueue(const RenderJob &job)
+{
+  if (queuedImages.contains(job.imageName)) {
+      return;
+    }
+  queuedImages.insert(job.imageName);
+
+  RenderJob *queued = new RenderJob(job);
+  jobs.append(queued);
+
+  pool.setMaxThreadCount(qMax(1,Preferences::rendererProcesses));
+  pool.start(new RenderJobRunner(queued,&finished));
+
+  qDebug() << qPrintable(job.description + " Arguments: " + job.program + " " + job.arguments.join(" ")) << "\n";
+}
+
+int RenderQueue::waitForFinished()
+{
+  if (jobs.isEmpty()) {
+      return 0;
+    }
+
+  QElapsedTimer timer;
+  timer.start();
+
+  int total = jobs.size();
+  for (int done = 1; done <= total; done++) {
+      finished.acquire();
+      emit gui->messageSig(true, QString("Rendered %1 of %2 images.").arg(done).arg(total));
+    }
+
+  int rc = 0;
+  foreach (RenderJob *job, jobs) {
+      if (job->failed) {
+          emit gui->messageSig(false,QMessageBox::tr("%1 render failed for %2 with exit code %3\n%4")
+                               .arg(job->description)
+                               .arg(job->imageName)
+                               .arg(job->exitCode)
+                               .arg(job->output));
+          renderCache.remove(job->imageName);
+          rc = -1;
+        }
+      delete job;
+    }
+  jobs.clear();
+  queuedImages.clear();
+
+  logStatus() << Render::getRenderer()
+              << "render queue took"
+              << timer.elapsed() << "milliseconds"
+              << "to render" << total << (total > 1 ? "images" : "image")
+              << "using up to" << pool.maxThreadCount() << "processes.";
+
+  return rc;
+}
+
 void clipImage(QString const &pngName){
-	//printf("\n");
 	QImage toClip(QDir::toNativeSeparators(pngName));
-	QRect clipBox = toClip.rect();
-	
-	//printf("clipping %s from %d x %d at (%d,%d)\n",qPrintable(QDir::toNativeSeparators(pngName)),clipBox.width(),clipBox.height(),clipBox.x(),clipBox.y());
+	QRect clipBox = ImageAnalysis::contentBounds(toClip);
 	
-	int x,y;
-	int initLeft = clipBox.left();
-	int initTop = clipBox.top();
-	int initRight = clipBox.right();
-	int initBottom = clipBox.bottom();
-	for(x = initLeft; x < initRight; x++){
-		for(y = initTop; y < initBottom; y++){
-			QRgb pixel = toClip.pixel(x, y);
-			if(!toClip.valid(x,y) || !QColor::fromRgba(pixel).isValid()){
-				//printf("something blew up when scanning at (%d,%d) - got %d %d\n",x,y,toClip.valid(x,y),QColor::fromRgba(pixel).isValid());
-			}
-			if ( pixel != 0){
-				//printf("bumped into something at (%d,%d)\n",x,y);
-				break;
-			}
-		}
-		if (y != initBottom) {
-			clipBox.setLeft(x);
-			break;
-		}
-	}
-	
-	//printf("clipped to %d x %d at (%d,%d)\n",clipBox.width(),clipBox.height(),clipBox.x(),clipBox.y());
-	
-	
-	initLeft = clipBox.left();
-	for(x = initRight; x >= initLeft; x--){
-		for(y = initTop; y < initBottom; y++){
-			QRgb pixel = toClip.pixel(x, y);
-			if(!toClip.valid(x,y) || !QColor::fromRgba(pixel).isValid()){
-				//printf("something blew up when scanning at (%d,%d) - got %d %d\n",x,y,toClip.valid(x,y),QColor::fromRgba(pixel).isValid());
-			}
-			if ( pixel != 0){
-				//printf("bumped into something at (%d,%d)\n",x,y);
-				break;
-			}
-		}
-		if (y != initBottom) {
-			clipBox.setRight(x);
-			break;
-		}
-	}
-	
-	//printf("clipped to %d x %d at (%d,%d)\n",clipBox.width(),clipBox.height(),clipBox.x(),clipBox.y());
-	
-	initRight = clipBox.right();
-	for(y = initTop; y < initBottom; y++){
-		for(x = initLeft; x < initRight; x++){
-			QRgb pixel = toClip.pixel(x, y);
-			if(!toClip.valid(x,y) || !QColor::fromRgba(pixel).isValid()){
-				//printf("something blew up when scanning at (%d,%d) - got %d %d\n",x,y,toClip.valid(x,y),QColor::fromRgba(pixel).isValid());
-			}
-			if ( pixel != 0){
-				//printf("bumped into something at (%d,%d)\n",x,y);
-				break;
-			}
-		}
-		if (x != initRight) {
-			clipBox.setTop(y);
-			break;
-		}
-	}
-	
-	//printf("clipped to %d x %d at (%d,%d)\n",clipBox.width(),clipBox.height(),clipBox.x(),clipBox.y());
-	
-	initTop = clipBox.top();
-	for(y = initBottom; y >= initTop; y--){
-		for(x = initLeft; x < initRight; x++){
-			QRgb pixel = toClip.pixel(x, y);
-			if(!toClip.valid(x,y) || !QColor::fromRgba(pixel).isValid()){
-				//printf("something blew up when scanning at (%d,%d) - got %d %d\n",x,y,toClip.valid(x,y),QColor::fromRgba(pixel).isValid());
-			}
-			if ( pixel != 0){
-				//printf("bumped into something at (%d,%d)\n",x,y);
-				break;
-			}
-		}
-		if (x != initRight) {
-			clipBox.setBottom(y);
-			break;
-		}
-	}
-	
-	//printf("clipped to %d x %d at (%d,%d)\n\n",clipBox.width(),clipBox.height(),clipBox.x(),clipBox.y());
+	// nothing rendered, leave the image as it is
+	if (clipBox.isNull() || clipBox == toClip.rect())
+		return;
 	
 	QImage clipped = toClip.copy(clipBox);
-	//toClip.save(QDir::toNativeSeparators(pngName+"-orig.png"));
 	clipped.save(QDir::toNativeSeparators(pngName));
 }
 
@@ -604,6 +643,9 @@ int LDGLite::renderCsi(
 	QString ldrName;
 	int rc;
 	ldrName = QDir::currentPath() + "/" + Paths::tmpDir + "/csi.ldr";
+	if (useRenderQueue()) {   // queued jobs each need their own input file
+		ldrName = QDir::currentPath() + "/" + Paths::tmpDir + "/" + QFileInfo(pngName).completeBaseName() + ".ldr";
+	}
 	if ((rc = rotateParts(addLine,meta.rotStep, csiParts, ldrName)) < 0) {
 		return rc;
 	}
@@ -652,8 +694,6 @@ int LDGLite::renderCsi(
   arguments << mf;                  // .png file name
   arguments << ldrName;             // csi.ldr (input file)
 
-  emit gui->messageSig(true, "Execute command: LDGLite render CSI.");
-
   QProcess    ldglite;
   QStringList env = QProcess::systemEnvironment();
   env << "LDRAWDIR=" + Preferences::ldrawPath;
@@ -664,6 +704,15 @@ int LDGLite::renderCsi(
     //logDebug() << qPrintable("LDSEARCHDIRS: " + Preferences::ldgliteSearchDirs);
   }
 
+  if (useRenderQueue()) {
+    emit gui->messageSig(true, "Queue command: LDGLite render CSI.");
+    renderQueue.enqueue(RenderJob("LDGLite CSI",Preferences::ldgliteExe,arguments,env,
+                                  QDir::currentPath() + "/" + Paths::tmpDir,pngName,rendererTimeout()));
+    return 0;
+  }
+
+  emit gui->messageSig(true, "Execute command: LDGLite render CSI.");
+
   ldglite.setEnvironment(env);
   //logDebug() << qPrintable("ENV: " + env);
 
@@ -737,8 +786,6 @@ int LDGLite::renderPli(
   arguments << mf;
   arguments << ldrName;
   
-  emit gui->messageSig(true, "Execute command: LDGLite render PLI.");
-
   QProcess    ldglite;
   QStringList env = QProcess::systemEnvironment();
   env << "LDRAWDIR=" + Preferences::ldrawPath;
@@ -749,6 +796,15 @@ int LDGLite::renderPli(
     //logDebug() << qPrintable("LDSEARCHDIRS: " + Preferences::ldgliteSearchDirs);
   }
 
+  if (useRenderQueue()) {
+    emit gui->messageSig(true, "Queue command: LDGLite render PLI.");
+    renderQueue.enqueue(RenderJob("LDGLite PLI",Preferences::ldgliteExe,arguments,env,
+                                  QDir::currentPath(),pngName,rendererTimeout()));
+    return 0;
+  }
+
+  emit gui->messageSig(true, "Execute command: LDGLite render PLI.");
+
   ldglite.setEnvironment(env);
   ldglite.setWorkingDirectory(QDir::currentPath());
   ldglite.setStandardErrorFile(QDir::currentPath() + "/stderr-ldglite");
@@ -818,6 +874,9 @@ int LDView::renderCsi(
   QString ldrName;
   int rc;
   ldrName = QDir::currentPath() + "/" + Paths::tmpDir + "/csi.ldr";
+  if (useRenderQueue()) {   // queued jobs each need their own input file
+      ldrName = QDir::currentPath() + "/" + Paths::tmpDir + "/" + QFileInfo(pngName).completeBaseName() + ".ldr";
+    }
   if ((rc = rotateParts(addLine,meta.rotStep, csiParts, ldrName)) < 0) {
       return rc;
     }
@@ -858,6 +917,13 @@ int LDView::renderCsi(
   }
   arguments << ldrName;
 
+  if (useRenderQueue()) {
+      emit gui->messageSig(true, "Queue command: LDView render CSI.");
+      renderQueue.enqueue(RenderJob("LDView CSI",Preferences::ldviewExe,arguments,QProcess::systemEnvironment(),
+                                    QDir::currentPath() + "/" + Paths::tmpDir,pngName,rendererTimeout()));
+      return 0;
+    }
+
   emit gui->messageSig(true, "Execute command: LDView render CSI.");
   
   QProcess    ldview;
@@ -933,6 +999,13 @@ int LDView::renderPli(
   }
   arguments << ldrName;
 
+  if (useRenderQueue()) {
+      emit gui->messageSig(true, "Queue command: LDView render PLI.");
+      renderQueue.enqueue(RenderJob("LDView PLI",Preferences::ldviewExe,arguments,QProcess::systemEnvironment(),
+                                    QDir::currentPath(),pngName,rendererTimeout()));
+      return 0;
+    }
+
   emit gui->messageSig(true, "Execute command: LDView render PLI.");
 
   QProcess    ldview;
@@ -29,10 +29,13 @@
 #ifndef RENDER_H
 #define RENDER_H
 
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QSemaphore>
+#include <QThreadPool>
 #include "QsLog.h"
 
-class QString;
-class QStringList;
 class Meta;
 class RotStepMeta;
 
@@ -44,6 +47,7 @@ public:
   static QString const   getRenderer();
   static void            setRenderer(QString const &name);
   bool                   useLDViewSCall(bool override = false);
+  bool                   useRenderQueue();
   virtual int 		 renderCsi(const QString &,
                                    const QStringList &,
                                    const QString &,
@@ -84,6 +88,80 @@ protected:
 
 extern Render *renderer;
 
+/*
+ * A single renderer process invocation.  When the render queue is in use
+ * renderCsi and renderPli describe their renderer call with one of these
+ * rather than running the process themselves.
+ */
+
+class RenderJob
+{
+public:
+  QString     description;      // e.g. "LDView CSI", used in messages
+  QString     program;
+  QStringList arguments;
+  QStringList environment;
+  QString     workingDirectory;
+  QString     imageName;        // the image this job produces
+  int         timeout;          // milliseconds, -1 for no timeout
+  bool        failed;
+  int         exitCode;
+  QString     output;
+
+  RenderJob()
+  {
+    timeout  = -1;
+    failed   = false;
+    exitCode = 0;
+  }
+  RenderJob(const QString     &_description,
+            const QString     &_program,
+            const QStringList &_arguments,
+            const QStringList &_environment,
+            const QString     &_workingDirectory,
+            const QString     &_imageName,
+            int                _timeout)
+  {
+    description      = _description;
+    program          = _program;
+    arguments        = _arguments;
+    environment      = _environment;
+    workingDirectory = _workingDirectory;
+    imageName        = _imageName;
+    timeout          = _timeout;
+    failed           = false;
+    exitCode         = 0;
+  }
+};
+
+/*
+ * Runs renderer processes concurrently, up to Preferences::rendererProcesses
+ * at a time.  Jobs start as soon as they are queued, so the renderers work
+ * while the rest of the page is being traversed.  The page only waits (in
+ * waitForFinished) at the point where it needs the images loaded.
+ */
+
+class RenderQueue
+{
+public:
+  RenderQueue() {}
+  ~RenderQueue();
+  void enqueue(const RenderJob &job);
+  int  waitForFinished();
+  int  pendingJobs()
+  {
+    return jobs.size();
+  }
+
+private:
+  QList<RenderJob *> jobs;
+  QSet<QString>      queuedImages;
+  QThreadPool        pool;
+  QSemaphore         finished;
+};
+
+extern RenderQueue renderQueue;
+
 class POVRay : public Render
 {
 public:
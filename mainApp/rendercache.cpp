@@ -0,0 +1,466 @@
+ 
+/****************************************************************************
+**
+** Copyright (C) 2007-2009 Kevin Clague. All rights reserved.
+** Copyright (C) 2015 - 2017 Trevor SANDY. All rights reserved.
+**
+** This file may be used under the terms of the GNU General Public
+** License version 2.0 as published by the Free Software Foundation
+** and appearing in the file LICENSE.GPL included in the packaging of
+** this file.  Please review the following information to ensure GNU
+** General Public Licensing requirements will be met:
+** http://www.trolltech.com/products/qt/opensource.html
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QCryptographicHash>
+#include "rendercache.h"
+#include "lpub.h"
+#include "lpub_preferences.h"
+#include "resolution.h"
+#include "version.h"
+#include "render.h"
+#include "meta.h"
+#include "imageanalysis.h"
+#include "QsLog.h"
+
+RenderCache renderCache;
+
+#define MANIFEST "manifest.txt"
+
+/*
+ * The LDConfig colours, the parts libraries, the search directories and
+ * the LDView ini the renderer reads.  The version is worked out again
+ * whenever one of these files changes, e.g. when the unofficial archive
+ * is refreshed and reloaded or the ini is edited.
+ */
+
+static QString fileStamp(const QFileInfo &info)
+{
+  return QString("%1 %2 %3")
+      .arg(info.filePath())
+      .arg(info.size())
+      .arg(info.lastModified().toMSecsSinceEpoch());
+}
+
+QString RenderCache::libraryVersion()
+{
+  static QString stamp;
+  static QString version;
+
+  QFileInfo ldConfig(QDir::toNativeSeparators(Preferences::ldrawPath + "/LDConfig.ldr"));
+  QFileInfo library(Preferences::lpub3dLibFile);
+  QFileInfo unofficial(library.absolutePath() + "/" + VER_LPUB3D_UNOFFICIAL_ARCHIVE);
+  QFileInfo ldviewIni(Preferences::ldviewIni);
+
+  QStringList files;
+  files << fileStamp(ldConfig)
+        << fileStamp(library)
+        << fileStamp(unofficial)
+        << fileStamp(ldviewIni)
+        << Preferences::ldSearchDirs;
+
+  QString current = files.join("\n");
+  if (current == stamp) {
+      return version;
+    }
+  stamp = current;
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  QFile ldConfigFile(ldConfig.filePath());
+  if (ldConfigFile.open(QIODevice::ReadOnly)) {
+      hash.addData(ldConfigFile.readAll());
+      ldConfigFile.close();
+    }
+
+  hash.addData(QString("%1 %2").arg(library.fileName()).arg(library.size()).toUtf8());
+  if (unofficial.exists()) {
+      hash.addData(QString("%1 %2 %3")
+                   .arg(unofficial.fileName())
+                   .arg(unofficial.size())
+                   .arg(unofficial.lastModified().toMSecsSinceEpoch()).toUtf8());
+    }
+
+  if ( ! Preferences::ldviewIni.isEmpty()) {
+      QFile ini(Preferences::ldviewIni);
+      if (ini.open(QIODevice::ReadOnly)) {
+          hash.addData(ini.readAll());
+          ini.close();
+        }
+    }
+
+  hash.addData(Preferences::ldSearchDirs.join("\n").toUtf8());
+
+  version = QString(hash.result().toHex());
+  return version;
+}
+
+/*
+ * Everything besides the ldr content that goes into a renderer command line
+ */
+
+QStringList RenderCache::rendererSettings(Meta &meta)
+{
+  QStringList settings;
+  settings << Render::getRenderer()
+           << QString::number(Gui::pageSize(meta.LPub.page, 0))
+           << QString::number(Gui::pageSize(meta.LPub.page, 1))
+           << QString::number(resolution())
+           << (resolutionType() == DPI ? "DPI" : "DPCM")
+           << QFileInfo(Preferences::ldviewIni).fileName()
+           << Preferences::ldgliteSearchDirs
+           << meta.LPub.fadeStep.fadeColor.value();
+  return settings;
+}
+
+QStringList RenderCache::csiSettings(Meta &meta)
+{
+  AssemMeta &assem = meta.LPub.assem;
+  QStringList settings = rendererSettings(meta);
+  settings << QString::number(assem.modelScale.value())
+           << assem.ldviewParms.value()
+           << assem.ldgliteParms.value()
+           << assem.povrayParms.value();
+  return settings;
+}
+
+QStringList RenderCache::pliSettings(Meta &meta, bool bom)
+{
+  PliMeta &pliMeta = bom ? meta.LPub.bom : meta.LPub.pli;
+  QStringList settings = rendererSettings(meta);
+  settings << QString::number(pliMeta.modelScale.value())
+           << QString::number(pliMeta.angle.value(0))
+           << QString::number(pliMeta.angle.value(1))
+           << meta.LPub.pli.ldviewParms.value()
+           << meta.LPub.pli.ldgliteParms.value()
+           << meta.LPub.pli.povrayParms.value();
+  return settings;
+}
+
+QString RenderCache::imageHash(
+  const QStringList &ldrLines,
+  const QStringList &settings)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  hash.addData(libraryVersion().toUtf8());
+  hash.addData(settings.join("\n").toUtf8());
+
+  QStringList tokens;
+  for (int i = 0; i < ldrLines.size(); i++) {
+      hash.addData("\n",1);
+      hash.addData(ldrLines[i].toUtf8());
+
+      // lines alone do not say what a submodel looks like, so include
+      // the content of any submodel (or its faded copy) it refers to
+
+      split(ldrLines[i],tokens);
+      if (tokens.size() == 15 && tokens[0] == "1") {
+          QString type = tokens[14];
+          QByteArray subHash = gui->contentHash(type);
+          if (subHash.isEmpty() && type.contains("-fade.",Qt::CaseInsensitive)) {
+              subHash = gui->contentHash(type.replace("-fade.",".",Qt::CaseInsensitive));
+            }
+          hash.addData(subHash);
+        }
+    }
+
+  return QString(hash.result().toHex());
+}
+
+QHash<QString, QString> &RenderCache::manifest(const QString &dirName)
+{
+  QHash<QString, QHash<QString, QString> >::iterator i = manifests.find(dirName);
+  if (i != manifests.end()) {
+      return i.value();
+    }
+
+  QHash<QString, QString> &entries = manifests[dirName];
+
+  QFile file(dirName + "/" + MANIFEST);
+  if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+      QTextStream in(&file);
+      int lines = 0;
+      while ( ! in.atEnd()) {
+          QString line = in.readLine();
+          int space = line.indexOf(' ');
+          if (space > 0) {
+              entries.insert(line.mid(space + 1),line.left(space));  // later lines win
+              lines++;
+            }
+        }
+      file.close();
+
+      // the manifest is only ever appended to, so drop superseded lines
+      // once they outnumber the live ones
+
+      if (lines > 2 * entries.size() &&
+          file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+          QTextStream out(&file);
+          QHash<QString, QString>::const_iterator e;
+          for (e = entries.constBegin(); e != entries.constEnd(); ++e) {
+              out << e.value() << " " << e.key() << endl;
+            }
+          file.close();
+        }
+    }
+
+  return entries;
+}
+
+bool RenderCache::upToDate(
+  const QString &imageName,
+  const QString &hash)
+{
+  QFileInfo info(imageName);
+  if ( ! info.exists()) {
+      return false;
+    }
+  return manifest(info.absolutePath()).value(info.fileName()) == hash;
+}
+
+void RenderCache::update(
+  const QString &imageName,
+  const QString &hash)
+{
+  imageCache.remove(imageName);      // it has just been rendered again
+
+  QFileInfo info(imageName);
+  QHash<QString, QString> &entries = manifest(info.absolutePath());
+  if (entries.value(info.fileName()) == hash) {
+      return;
+    }
+  entries.insert(info.fileName(),hash);
+
+  QFile file(info.absolutePath() + "/" + MANIFEST);
+  if (file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+      QTextStream out(&file);
+      out << hash << " " << info.fileName() << endl;
+      file.close();
+    }
+}
+
+void RenderCache::remove(const QString &imageName)
+{
+  QFileInfo info(imageName);
+  if (manifest(info.absolutePath()).contains(info.fileName())) {
+      update(imageName,QString("-"));
+    }
+}
+
+void RenderCache::defer(
+  const QString &ldrName,
+  const QString &imageName,
+  const QString &hash)
+{
+  deferred.insert(ldrName,qMakePair(imageName,hash));
+}
+
+/*
+ * Record the hashes held for ldrNames once their images are rendered.  A
+ * failed render leaves the old hash, so the image is rendered next time.
+ */
+
+void RenderCache::rendered(const QStringList &ldrNames, bool ok)
+{
+  foreach (QString ldrName, ldrNames) {
+      QPair<QString, QString> image = deferred.take(ldrName);
+      if (ok && ! image.first.isEmpty()) {
+          update(image.first,image.second);
+        }
+    }
+}
+
+void RenderCache::clear(const QString &dirName)
+{
+  manifests.remove(QFileInfo(dirName).absoluteFilePath());
+  imageCache.clear();
+}
+
+ImageCache imageCache;
+
+#define IMAGE_CACHE_KBYTES (256*1024)
+
+ImageCache::ImageCache()
+{
+  hits      = 0;
+  misses    = 0;
+  evictions = 0;
+  pixmapScale = 1.0;
+  images.setMaxCost(IMAGE_CACHE_KBYTES);
+}
+
+/*
+ * The entry for fileName, decoding the file when it is not cached or has
+ * changed on disk.  An image too big to cache is decoded into uncached.
+ * Call with the mutex held.
+ */
+
+CachedImage *ImageCache::cached(const QString &fileName, CachedImage &uncached)
+{
+  QFileInfo info(fileName);
+  if ( ! info.exists()) {
+      return NULL;
+    }
+  QString key = info.absoluteFilePath();
+
+  CachedImage *entry = images.object(key);
+  if (entry &&
+      entry->fileSize == info.size() &&
+      entry->modified == info.lastModified()) {
+      hits++;
+      return entry;
+    }
+  misses++;
+
+  QImage image;
+  if ( ! image.load(key)) {
+      images.remove(key);
+      return NULL;
+    }
+
+  // load() keeps a pixmap of about the same size next to the image
+  int cost = qMax(1,2 * (image.byteCount() / 1024));
+  if (cost > images.maxCost()) {
+      images.remove(key);
+      entry = &uncached;
+    } else {
+      int before = images.count() + (images.contains(key) ? 0 : 1);
+      entry = new CachedImage;
+      images.insert(key,entry,cost);
+      int evicted = before - images.count();
+      if (evicted > 0) {
+          evictions += evicted;
+          logTrace() << "Image cache evicted" << evicted << (evicted > 1 ? "images," : "image,")
+                     << summary();
+        }
+    }
+
+  entry->image    = image;
+  entry->fileSize = info.size();
+  entry->modified = info.lastModified();
+  entry->hasEdges = false;
+  entry->pixmap   = QPixmap();
+  return entry;
+}
+
+bool ImageCache::image(const QString &fileName, QImage &image)
+{
+  QMutexLocker locker(&mutex);
+  CachedImage uncached;
+  CachedImage *entry = cached(fileName,uncached);
+  if ( ! entry) {
+      return false;
+    }
+  image = entry->image;
+  return true;
+}
+
+bool ImageCache::load(const QString &fileName, QPixmap *pixmap)
+{
+  QMutexLocker locker(&mutex);
+  CachedImage uncached;
+  CachedImage *entry = cached(fileName,uncached);
+  if ( ! entry) {
+      *pixmap = QPixmap();
+      return false;
+    }
+  if (entry->pixmap.isNull() || entry->pixmapScale != pixmapScale) {
+      entry->pixmap      = makePixmap(entry->image,pixmapScale);
+      entry->pixmapScale = pixmapScale;
+    }
+  *pixmap = entry->pixmap;
+  return true;
+}
+
+/*
+ * A scaled down pixmap keeps the size of the image on the page by taking
+ * the scale as its device pixel ratio.
+ */
+
+QPixmap ImageCache::makePixmap(const QImage &image, qreal scale)
+{
+  if (scale >= 1.0) {
+      return QPixmap::fromImage(image);
+    }
+  QPixmap pixmap = QPixmap::fromImage(
+        image.scaled(qMax(1,qRound(image.width()  * scale)),
+                     qMax(1,qRound(image.height() * scale)),
+                     Qt::IgnoreAspectRatio,Qt::SmoothTransformation));
+  pixmap.setDevicePixelRatio(scale);
+  return pixmap;
+}
+
+/*
+ * The left and right edge profiles of the image (see
+ * ImageAnalysis::edgeProfiles), appended to left and right.
+ */
+
+bool ImageCache::edgeProfiles(
+  const QString &fileName,
+  QList<int>    &left,
+  QList<int>    &right)
+{
+  QMutexLocker locker(&mutex);
+  CachedImage uncached;
+  CachedImage *entry = cached(fileName,uncached);
+  if ( ! entry) {
+      return false;
+    }
+  if ( ! entry->hasEdges) {
+      ImageAnalysis::edgeProfiles(entry->image,entry->leftEdge,entry->rightEdge);
+      entry->hasEdges = true;
+    }
+  left  += entry->leftEdge;
+  right += entry->rightEdge;
+  return true;
+}
+
+void ImageCache::remove(const QString &fileName)
+{
+  QMutexLocker locker(&mutex);
+  images.remove(QFileInfo(fileName).absoluteFilePath());
+}
+
+void ImageCache::clear()
+{
+  QMutexLocker locker(&mutex);
+  images.clear();
+}
+
+void ImageCache::setPixmapScale(qreal scale)
+{
+  QMutexLocker locker(&mutex);
+  pixmapScale = qBound(qreal(0.01),scale,qreal(1.0));
+}
+
+void ImageCache::setMaxSize(int kbytes)
+{
+  QMutexLocker locker(&mutex);
+  images.setMaxCost(kbytes);
+}
+
+QString ImageCache::statistics()
+{
+  QMutexLocker locker(&mutex);
+  return summary();
+}
+
+QString ImageCache::summary()
+{
+  return QString("%1 images, %2 of %3 KB, %4 hits, %5 misses, %6 evictions")
+      .arg(images.count())
+      .arg(images.totalCost())
+      .arg(images.maxCost())
+      .arg(hits)
+      .arg(misses)
+      .arg(evictions);
+}
@@ -0,0 +1,151 @@
+ 
+/****************************************************************************
+**
+** Copyright (C) 2007-2009 Kevin Clague. All rights reserved.
+** Copyright (C) 2015 - 2017 Trevor SANDY. All rights reserved.
+**
+** This file may be used under the terms of the GNU General Public
+** License version 2.0 as published by the Free Software Foundation
+** and appearing in the file LICENSE.GPL included in the packaging of
+** this file.  Please review the following information to ensure GNU
+** General Public Licensing requirements will be met:
+** http://www.trolltech.com/products/qt/opensource.html
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+**
+****************************************************************************/
+
+/****************************************************************************
+ *
+ * The render cache decides when a CSI or PLI image needs to be rendered
+ * again.  Each image cache directory (Paths::assemDir and Paths::partsDir)
+ * keeps a manifest recording, for every image, a hash of the renderer
+ * input that produced it: the rotated ldr content (including the content
+ * of every submodel it uses), the renderer, its arguments, the resolution
+ * and the LDConfig/parts library in use.  An image is only rendered again
+ * when that hash changes, so saving a submodel no longer invalidates every
+ * image that uses it, and because nothing in the hash depends on file
+ * dates or paths an image cache can be copied between checkouts.
+ *
+ * The image cache keeps the decoded images themselves in memory, up to a
+ * set size, for pages that are drawn again.
+ *
+ * Please see lpub.h for an overall description of how the files in LPub
+ * make up the LPub program.
+ *
+ ***************************************************************************/
+
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QPair>
+#include <QList>
+#include <QCache>
+#include <QMutex>
+#include <QImage>
+#include <QPixmap>
+#include <QDateTime>
+
+class Meta;
+
+class RenderCache
+{
+public:
+  RenderCache() {}
+
+  static QString imageHash(const QStringList &ldrLines,   // renderer input
+                           const QStringList &settings);  // renderer, args, resolution...
+  static QStringList csiSettings(Meta &meta);
+  static QStringList pliSettings(Meta &meta, bool bom);
+
+  bool upToDate(const QString &imageName, const QString &hash);
+  void update(  const QString &imageName, const QString &hash);
+  void remove(  const QString &imageName);
+  void clear(   const QString &dirName);
+
+  /* LDView single call renders run after the page is laid out, so the
+     hash of each ldr file is held until its image has been rendered */
+
+  void defer(   const QString &ldrName, const QString &imageName, const QString &hash);
+  void rendered(const QStringList &ldrNames, bool ok);
+
+private:
+  QHash<QString, QHash<QString, QString> > manifests;    // dir -> image -> hash
+  QHash<QString, QPair<QString, QString> > deferred;     // ldr -> image, hash
+
+  QHash<QString, QString> &manifest(const QString &dirName);
+  static QString libraryVersion();
+  static QStringList rendererSettings(Meta &meta);
+};
+
+extern RenderCache renderCache;
+
+/*
+ * The decoded CSI and PLI images, so drawing a page again does not read
+ * and decode its PNG files again.  Images are kept by file name along
+ * with the file's size and time, and read again when either changes.
+ * The render cache drops an image whenever it is rendered again.  The
+ * PLI edge profiles are kept with the image they came from.
+ *
+ * load() hands out the same QPixmap for a file every time, so a pdf
+ * writer, which keeps images by QPixmap::cacheKey, embeds each part and
+ * assembly image once however many pages show it.  For pdf export the
+ * pixmaps can be scaled down, keeping their size on the page through
+ * the device pixel ratio.
+ */
+
+class CachedImage
+{
+public:
+  QImage      image;
+  qint64      fileSize;
+  QDateTime   modified;
+  bool        hasEdges;
+  QList<int>  leftEdge;
+  QList<int>  rightEdge;
+  QPixmap     pixmap;        // GUI thread only
+  qreal       pixmapScale;
+
+  CachedImage()
+  {
+    fileSize    = 0;
+    hasEdges    = false;
+    pixmapScale = 1.0;
+  }
+};
+
+class ImageCache
+{
+public:
+  ImageCache();
+
+  bool image(const QString &fileName, QImage &image);
+  bool load(const QString &fileName, QPixmap *pixmap);  // as QPixmap::load, GUI thread only
+  bool edgeProfiles(const QString &fileName, QList<int> &left, QList<int> &right);
+
+  void remove(const QString &fileName);
+  void clear();
+  void setMaxSize(int kbytes);
+  void setPixmapScale(qreal scale);       // 1 is full resolution
+  QString statistics();                   // hits, misses, evictions
+
+private:
+  QMutex                       mutex;
+  QCache<QString, CachedImage> images;    // cost in kbytes, image and pixmap
+  int                          hits;
+  int                          misses;
+  int                          evictions;
+  qreal                        pixmapScale;
+
+  static QPixmap makePixmap(const QImage &image, qreal scale);
+  CachedImage *cached(const QString &fileName, CachedImage &uncached);
+  QString summary();                      // statistics with the mutex held
+};
+
+extern ImageCache imageCache;
+
+#endif
@@ -259,8 +259,8 @@ int Render::rotateParts(
 
   for (int i = 0; i < parts.size(); i++) {
 
-    QString line = parts[i];
-    QStringList tokens;
+    const QString &line = parts[i];
+    QVector<QStringRef> tokens;
 
     split(line,tokens);
 
@@ -271,9 +271,9 @@ int Render::rotateParts(
     double v[4][3];
 
     if (tokens[0] == "1") {
-      v[0][0] = tokens[2].toFloat();
-      v[0][1] = tokens[3].toFloat();
-      v[0][2] = tokens[4].toFloat();
+      v[0][0] = tokenToFloat(tokens[2]);
+      v[0][1] = tokenToFloat(tokens[3]);
+      v[0][2] = tokenToFloat(tokens[4]);
 
       rotatePoint(v[0],rm);
 
@@ -288,9 +288,9 @@ int Render::rotateParts(
     } else if (tokens[0] == "2") {
       int c = 2;
       for (int j = 0; j < 2; j++) {
-        v[j][0] = tokens[c].toDouble();
-        v[j][1] = tokens[c+1].toDouble();
-        v[j][2] = tokens[c+2].toDouble();
+        v[j][0] = tokenToDouble(tokens[c]);
+        v[j][1] = tokenToDouble(tokens[c+1]);
+        v[j][2] = tokenToDouble(tokens[c+2]);
         c += 3;
         rotatePoint(v[j],rm);
 
@@ -306,9 +306,9 @@ int Render::rotateParts(
     } else if (tokens[0] == "3") {
       int c = 2;
       for (int j = 0; j < 3; j++) {
-        v[j][0] = tokens[c].toDouble();
-        v[j][1] = tokens[c+1].toDouble();
-        v[j][2] = tokens[c+2].toDouble();
+        v[j][0] = tokenToDouble(tokens[c]);
+        v[j][1] = tokenToDouble(tokens[c+1]);
+        v[j][2] = tokenToDouble(tokens[c+2]);
         c += 3;
         rotatePoint(v[j],rm);
 
@@ -324,9 +324,9 @@ int Render::rotateParts(
     } else if (tokens[0] == "4") {
       int c = 2;
       for (int j = 0; j < 4; j++) {
-        v[j][0] = tokens[c].toDouble();
-        v[j][1] = tokens[c+1].toDouble();
-        v[j][2] = tokens[c+2].toDouble();
+        v[j][0] = tokenToDouble(tokens[c]);
+        v[j][1] = tokenToDouble(tokens[c+1]);
+        v[j][2] = tokenToDouble(tokens[c+2]);
         c += 3;
         rotatePoint(v[j],rm);
 
@@ -342,9 +342,9 @@ int Render::rotateParts(
     } else if (tokens[0] == "5") {
       int c = 2;
       for (int j = 0; j < 4; j++) {
-        v[j][0] = tokens[c].toDouble();
-        v[j][1] = tokens[c+1].toDouble();
-        v[j][2] = tokens[c+2].toDouble();
+        v[j][0] = tokenToDouble(tokens[c]);
+        v[j][1] = tokenToDouble(tokens[c+1]);
+        v[j][2] = tokenToDouble(tokens[c+2]);
         c += 3;
         rotatePoint(v[j],rm);
 
@@ -368,8 +368,8 @@ int Render::rotateParts(
   }
 
   for (int i = 0; i < parts.size(); i++) {
-    QString line = parts[i];
-    QStringList tokens;
+    const QString &line = parts[i];
+    QVector<QStringRef> tokens;
 
     split(line,tokens);
 
@@ -383,13 +383,13 @@ int Render::rotateParts(
 
     if (tokens[0] == "1") {
       int c = 2;
-      v[0][0] = tokens[c].toFloat();
-      v[0][1] = tokens[c+1].toFloat();
-      v[0][2] = tokens[c+2].toFloat();
+      v[0][0] = tokenToFloat(tokens[c]);
+      v[0][1] = tokenToFloat(tokens[c+1]);
+      v[0][2] = tokenToFloat(tokens[c+2]);
       c += 3;
       for (int y = 0; y < 3; y++) {
         for (int x = 0; x < 3; x++) {
-          pm[y][x] = tokens[c++].toDouble();
+          pm[y][x] = tokenToDouble(tokens[c++]);
         }
       }
       rotatePoint(v[0],rm);
@@ -405,12 +405,12 @@ int Render::rotateParts(
                    "%11 %12 %13 "
                    "%14")
 
-                   .arg(tokens[1])
+                   .arg(tokens[1].toString())
                    .arg( v[0][0]) .arg( v[0][1]) .arg( v[0][2])
                    .arg(pm[0][0]) .arg(pm[0][1]) .arg(pm[0][2])
                    .arg(pm[1][0]) .arg(pm[1][1]) .arg(pm[1][2])
                    .arg(pm[2][0]) .arg(pm[2][1]) .arg(pm[2][2])
-                   .arg(tokens[tokens.size()-1]);
+                   .arg(tokens[tokens.size()-1].toString());
 
       parts[i] = t1;
     } else if (tokens[0] == "2") {
@@ -418,7 +418,7 @@ int Render::rotateParts(
       int c = 2;
       for (int n = 0; n < 2; n++) {
         for (int d = 0; d < 3; d++) {
-          v[n][d] = tokens[c++].toDouble();
+          v[n][d] = tokenToDouble(tokens[c++]);
         }
         rotatePoint(v[n],rm);
         for (int d = 0; d < 3; d++) {
@@ -429,7 +429,7 @@ int Render::rotateParts(
       t1 = QString("2 %1 "
                    "%2 %3 %4 "
                    "%5 %6 %7")
-                   .arg(tokens[1])
+                   .arg(tokens[1].toString())
                    .arg( v[0][0]) .arg( v[0][1]) .arg( v[0][2])
                    .arg( v[1][0]) .arg( v[1][1]) .arg( v[1][2]);
       parts[i] = t1;
@@ -438,7 +438,7 @@ int Render::rotateParts(
       int c = 2;
       for (int n = 0; n < 3; n++) {
         for (int d = 0; d < 3; d++) {
-          v[n][d] = tokens[c++].toDouble();
+          v[n][d] = tokenToDouble(tokens[c++]);
         }
         rotatePoint(v[n],rm);
         for (int d = 0; d < 3; d++) {
@@ -450,7 +450,7 @@ int Render::rotateParts(
                    "%2 %3 %4  "
                    "%5 %6 %7  "
                    "%8 %9 %10")
-                     .arg(tokens[1])
+                     .arg(tokens[1].toString())
                      .arg( v[0][0]) .arg( v[0][1]) .arg( v[0][2])
                      .arg( v[1][0]) .arg( v[1][1]) .arg( v[1][2])
                      .arg( v[2][0]) .arg( v[2][1]) .arg( v[2][2]);
@@ -460,7 +460,7 @@ int Render::rotateParts(
       int c = 2;
       for (int n = 0; n < 4; n++) {
         for (int d = 0; d < 3; d++) {
-          v[n][d] = tokens[c++].toDouble();
+          v[n][d] = tokenToDouble(tokens[c++]);
         }
         rotatePoint(v[n],rm);
         for (int d = 0; d < 3; d++) {
@@ -473,7 +473,7 @@ int Render::rotateParts(
                    "%5 %6 %7 "
                    "%8 %9 %10 "
                    "%11 %12 %13")
-                     .arg(tokens[1])
+                     .arg(tokens[1].toString())
                      .arg( v[0][0]) .arg( v[0][1]) .arg( v[0][2])
                      .arg( v[1][0]) .arg( v[1][1]) .arg( v[1][2])
                      .arg( v[2][0]) .arg( v[2][1]) .arg( v[2][2])
@@ -484,7 +484,7 @@ int Render::rotateParts(
       int c = 2;
       for (int n = 0; n < 4; n++) {
         for (int d = 0; d < 3; d++) {
-          v[n][d] = tokens[c++].toDouble();
+          v[n][d] = tokenToDouble(tokens[c++]);
         }
         rotatePoint(v[n],rm);
         for (int d = 0; d < 3; d++) {
@@ -497,7 +497,7 @@ int Render::rotateParts(
                    "%5 %6 %7 "
                    "%8 %9 %10 "
                    "%11 %12 %13")
-                     .arg(tokens[1])
+                     .arg(tokens[1].toString())
                      .arg( v[0][0]) .arg( v[0][1]) .arg( v[0][2])
                      .arg( v[1][0]) .arg( v[1][1]) .arg( v[1][2])
                      .arg( v[2][0]) .arg( v[2][1]) .arg( v[2][2])
@@ -36,6 +36,7 @@
 #include "ranges.h"
 #include "ranges_element.h"
 #include "render.h"
+#include "rendercache.h"
 #include "callout.h"
 #include "calloutbackgrounditem.h"
 #include "pointer.h"
@@ -200,13 +201,17 @@ int Step::createCsi(
 
   csiOutOfDate = false;
 
+  // hash what the renderer would be fed, so the image is only rendered
+  // again when its pixels could actually change
+
+  QStringList rotatedParts = csiParts;
+  Render::rotateParts(addLine,meta.rotStep,rotatedParts);
+  QString csiHash = RenderCache::imageHash(rotatedParts,RenderCache::csiSettings(meta));
+
   QFile csi(pngName);
   csiExist = csi.exists();
   if (csiExist) {
-      QDateTime lastModified = QFileInfo(pngName).lastModified();
-      QStringList stack = submodelStack();
-      stack << parent->modelName();
-      if ( ! isOlder(stack,lastModified)) {
+      if ( ! renderCache.upToDate(pngName,csiHash)) {
           csiOutOfDate = true;
         }
     }
@@ -230,6 +235,7 @@ int Step::createCsi(
                                     .arg(ldrName));
               return rc;
             }
+          renderCache.defer(ldrName,pngName,csiHash);
 
         } else {
 
@@ -244,6 +250,7 @@ int Step::createCsi(
                                     .arg(pngName));
               return rc;
             }
+          renderCache.update(pngName,csiHash);
 
 //          qDebug() << Render::getRenderer()
           logTrace() << "\n" << Render::getRenderer()
@@ -255,11 +262,14 @@ int Step::createCsi(
         }
     }
 
-  // If not using LDView SCall, populate pixmap
-  if (! renderer->useLDViewSCall()) {
-      pixmap->load(pngName);
-      csiPlacement.size[0] = pixmap->width();
-      csiPlacement.size[1] = pixmap->height();
+  // If not using LDView SCall or the render queue, populate pixmap
+  if (! renderer->useLDViewSCall() && ! renderer->useRenderQueue()) {
+      imageCache.load(pngName,pixmap);
+      // size from the full resolution image, the pixmap may be scaled
+      QImage image;
+      imageCache.image(pngName,image);
+      csiPlacement.size[0] = image.width();
+      csiPlacement.size[1] = image.height();
     }
 
   if (! gui->exporting()) {
@@ -707,7 +717,7 @@ int  y)// accumulate sub-col margin widths here
   square[stepNumber.tbl[XX]][stepNumber.tbl[YY]] = StepNumberType;
   square[rotateIcon.tbl[XX]][rotateIcon.tbl[YY]] = RotateIconType;
   
-  int pixmapSize[2] = { csiPixmap.width(), csiPixmap.height() };
+  int pixmapSize[2] = { csiPlacement.size[XX], csiPlacement.size[YY] };
   int max = pixmapSize[y];
 
   for (int i = 0; i < numCallouts; i++) {
@@ -14,6 +14,11 @@
 
 #include <QFileInfo>
 #include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QDataStream>
 
 #include "threadworkers.h"
 #include "ldrawini.h"
@@ -690,6 +695,85 @@ bool PartWorker::processColourParts(const QStringList &colourPartList) {
 }
 
 
+/*
+ * Writes the fade copy of one colour part.  The jobs only read the colour
+ * parts map, which does not change while they run, so they all run at
+ * the same time.
+ */
+class FadePartFileJob : public QRunnable
+{
+public:
+    const QMap<QString, ColourPart> *colourParts;
+    QString                          partName;      // _colourParts key
+    QString                          fadePartFile;  // absolute path of the fade copy
+    QAtomicInt                      *done;
+    QString                          error;         // set if the file could not be written
+
+    FadePartFileJob()
+    {
+        setAutoDelete(false);
+    }
+
+    void run();
+};
+
+void FadePartFileJob::run()
+{
+    QString materialColor  ="16";  // Internal Common Material Colour (main)
+    QString edgeColor      ="24";  // Internal Common Material Color (edge)
+
+    QStringList fadePartContent;
+    QMap<QString, ColourPart>::const_iterator cp = colourParts->constFind(partName);
+    const QStringList &contents = cp.value()._contents;
+
+    // process fade part contents
+    for (int i = 0; i < contents.size(); i++) {
+        QString line =  contents[i];
+        QStringList tokens;
+        QString fileNameStr;
+
+        split(line,tokens);
+        if (tokens.size() == 15 && tokens[0] == "1") {
+            fileNameStr = tokens[tokens.size()-1].toLower();
+            QString searchFileNameStr = fileNameStr;
+            // check if part at this line has a matching colour part in the colourPart list - if yes, rename with '-fade'
+            searchFileNameStr = searchFileNameStr.split("\\").last();
+            QMap<QString, ColourPart>::const_iterator cpc = colourParts->constFind(searchFileNameStr);
+            if (cpc != colourParts->constEnd()){
+                if (cpc.value()._fileNameStr == searchFileNameStr){
+                    fileNameStr = fileNameStr.replace(".dat","-fade.dat");
+                }
+            }
+            tokens[tokens.size()-1] = fileNameStr;
+        }
+        // check if coloured line and set to 16 if yes
+        if((((tokens.size() == 15 && tokens[0] == "1")  ||
+             (tokens.size() == 8  && tokens[0] == "2")  ||
+             (tokens.size() == 11 && tokens[0] == "3")  ||
+             (tokens.size() == 14 && tokens[0] == "4")  ||
+             (tokens.size() == 14 && tokens[0] == "5")) &&
+             (tokens[1] != materialColor) 				&&
+             (tokens[1] != edgeColor))){
+            tokens[1] = materialColor;
+        }
+        line = tokens.join(" ");
+        fadePartContent << line;
+    }
+
+    // write faded part file to fade directory
+    QFile file(fadePartFile);
+    if ( ! file.open(QFile::WriteOnly | QFile::Text)) {
+        error = QString("Failed to open %1 for writing: %2").arg(fadePartFile).arg(file.errorString());
+    } else {
+        QTextStream out(&file);
+        for (int i = 0; i < fadePartContent.size(); i++) {
+            out << fadePartContent[i] << endl;
+        }
+        file.close();
+    }
+    done->ref();
+}
+
 bool PartWorker::createFadePartFiles(){
 
     int maxValue            = _partList.size();
@@ -697,15 +781,11 @@ bool PartWorker::createFadePartFiles(){
     emit progressMessageSig("Creating Fade Colour Parts");
     emit progressRangeSig(1, maxValue);
 
-    QString materialColor  ="16";  // Internal Common Material Colour (main)
-    QString edgeColor      ="24";  // Internal Common Material Color (edge)
-
-    QStringList fadePartContent;
-    QString fadePartFile;
+    QList<FadePartFileJob *> jobs;
+    QAtomicInt done(0);
 
     for(int part = 0; part < _partList.size() && endThreadNotRequested(); part++){
 
-        emit progressSetValueSig(part);
         QMap<QString, ColourPart>::iterator cp = _colourParts.find(_partList[part]);
 
         if(cp != _colourParts.end()){
@@ -736,79 +816,39 @@ bool PartWorker::createFadePartFiles(){
                 logNotice() << "PART ALREADY EXISTS: " << fadeStepColorPartFileInfo.absoluteFilePath();
                 continue;
             }
-            fadePartFile = fadeStepColorPartFileInfo.absoluteFilePath();
             //logTrace() << "A. PART CONTENT ABSOLUTE FILEPATH: " << fadeStepColorPartFileInfo.absoluteFilePath();
 
-            // process fade part contents
-            for (int i = 0; i < cp.value()._contents.size() && endThreadNotRequested(); i++) {
-                QString line =  cp.value()._contents[i];
-                QStringList tokens;
-                QString fileNameStr;
-
-                split(line,tokens);
-                if (tokens.size() == 15 && tokens[0] == "1") {
-                    fileNameStr = tokens[tokens.size()-1].toLower();
-                    QString searchFileNameStr = fileNameStr;
-                    // check if part at this line has a matching colour part in the colourPart list - if yes, rename with '-fade'
-                    searchFileNameStr = searchFileNameStr.split("\\").last();
-                    QMap<QString, ColourPart>::iterator cpc = _colourParts.find(searchFileNameStr);
-                    if (cpc != _colourParts.end()){
-                        if (cpc.value()._fileNameStr == searchFileNameStr){
-                            fileNameStr = fileNameStr.replace(".dat","-fade.dat");
-                        }
-                    }
-                    tokens[tokens.size()-1] = fileNameStr;
-                }
-                // check if coloured line and set to 16 if yes
-                if((((tokens.size() == 15 && tokens[0] == "1")  ||
-                     (tokens.size() == 8  && tokens[0] == "2")  ||
-                     (tokens.size() == 11 && tokens[0] == "3")  ||
-                     (tokens.size() == 14 && tokens[0] == "4")  ||
-                     (tokens.size() == 14 && tokens[0] == "5")) &&
-                     (tokens[1] != materialColor) 				&&
-                     (tokens[1] != edgeColor))){
-
-                    //QString oldColour(tokens[1]);       //logging only: show colour lines
-                    tokens[1] = materialColor;
-                    //logTrace() << "D. CHANGE CHILD PART COLOUR: " << fileNameStr << " NewColour: " << tokens[1] << " OldColour: " << oldColour;
-                }
-                line = tokens.join(" ");
-                fadePartContent << line;
-            }
-            //logTrace() << "04 SAVE COLOUR PART: " << fadePartFile;
-            if(saveFadeFile(fadePartFile, fadePartContent))
-                _fadedParts++;
-            fadePartContent.clear();
+            FadePartFileJob *job = new FadePartFileJob;
+            job->colourParts     = &_colourParts;
+            job->partName        = cp.key();
+            job->fadePartFile    = fadeStepColorPartFileInfo.absoluteFilePath();
+            job->done            = &done;
+            jobs << job;
         }
     }
-    emit progressSetValueSig(maxValue);
-    return true;
-}
-
 
-/*
-     * Write faded part files to fade directory.
-     */
-bool PartWorker::saveFadeFile(
-        const QString     &fileName,
-        const QStringList &fadePartContent) {
-
-    QFile file(fileName);
-    if ( ! file.open(QFile::WriteOnly | QFile::Text)) {
-        QString message = QString("Failed to open %1 for writing: %2").arg(fileName).arg(file.errorString());
-        emit messageSig(true,message);
-        logError() << message;
-        return false;
+    // write the fade parts on all cores
+    QThreadPool pool;
+    for (int i = 0; i < jobs.size(); i++) {
+        pool.start(jobs[i]);
+    }
+    while (! pool.waitForDone(100)) {
+        emit progressSetValueSig(maxValue - jobs.size() + done.load());
+    }
 
-    } else {
-        QTextStream out(&file);
-        for (int i = 0; i < fadePartContent.size(); i++) {
-            out << fadePartContent[i] << endl;
+    for (int i = 0; i < jobs.size(); i++) {
+        if (! jobs[i]->error.isEmpty()) {
+            emit messageSig(true,jobs[i]->error);
+            logError() << jobs[i]->error;
+        } else {
+            logNotice() << "05 WRITE FADE PART TO DISC:" << jobs[i]->fadePartFile;
+            _fadedParts++;
         }
-        file.close();
-        logNotice() << "05 WRITE FADE PART TO DISC:" << fileName;
-        return true;
+        delete jobs[i];
     }
+
+    emit progressSetValueSig(maxValue);
+    return true;
 }
 
 
@@ -1041,6 +1081,9 @@ void ColourPartListWorker::generateFadeColourPartsList()
     _timer.start();
     _colWidthFileName = 0;
 
+    loadScanCache();
+    _scans.clear();
+
     int libCount = 1;
 
     fileSectionHeader(FADESTEP_INTRO_HEADER);
@@ -1071,6 +1114,9 @@ void ColourPartListWorker::generateFadeColourPartsList()
 
     processChildren();
 
+    if (endThreadNotRequested())
+        saveScanCache();
+
     writeFadeFile();
 
     int secs = _timer.elapsed() / 1000;
@@ -1095,6 +1141,148 @@ void ColourPartListWorker::generateFadeColourPartsList()
     logInfo() << fileStatus;
 }
 
+/*
+ * Scan one library part for lines with a static colour, that is any
+ * colour but 16 and 24.  Keeps the lines processChildren looks at.  This
+ * runs on the ColourPartScanJob threads, so it only works on its
+ * arguments.
+ */
+static void scanColourPart(
+        QByteArray          &qba,
+        const QString       &entry,
+        const QString       &libType,
+        ColourPartScan      &scan)
+{
+    QString materialColor  ="16";  // Internal Common Material Colour (main)
+    QString edgeColor      ="24";  // Internal Common Material Color (edge)
+    QString fileName;
+    QString firstLine;
+    QStringList tokens;
+    bool first = true;
+
+    QTextStream in(&qba);
+    while (! in.atEnd()) {
+        QString line = in.readLine(0).toLower();
+
+        split(line,tokens);
+        bool nameLine = tokens.size() == 3 && line.contains("name:");
+        if (first || nameLine || (tokens.size() == 15 && tokens[0] == "1")) {
+            scan._contents << line;
+        }
+        if (first) {
+            firstLine = line;
+            first = false;
+        }
+
+        if (scan._hasColour) {
+            continue;
+        }
+
+        if (nameLine)
+            fileName  = tokens[tokens.size()-1];
+
+        if((tokens.size() == 15 && tokens[0] == "1") ||
+           (tokens.size() == 8  && tokens[0] == "2") ||
+           (tokens.size() == 11 && tokens[0] == "3") ||
+           (tokens.size() == 14 && tokens[0] == "4") ||
+           (tokens.size() == 14 && tokens[0] == "5")) {
+            QString colour = tokens[1];
+            if (colour != edgeColor && colour != materialColor) {
+                scan._hasColour = true;
+                if (fileName.isEmpty()) {
+                    fileName = entry.split("/").last();
+                    scan._unnamed = true;
+                }
+                scan._fileName  = fileName;
+                scan._fileEntry = QString("%1:::%2:::%3").arg(fileName).arg(libType).arg(firstLine.mid(2));
+            }
+        }
+    }
+}
+
+/*
+ * Scans every slices-th part of an archive, starting at slice, through
+ * its own reader.  Parts whose CRC matches the cache are taken from it.
+ */
+class ColourPartScanJob : public QRunnable
+{
+public:
+    QString                                archiveFile;
+    QString                                libType;      // U or O
+    const QStringList                     *entries;      // the .dat entries, in archive order
+    ColourPartScan                        *scans;        // one per entry
+    const QHash<QString, ColourPartScan>  *cache;
+    int                                    slice;
+    int                                    slices;
+    QAtomicInt                            *done;
+    QAtomicInt                            *reused;
+    const bool                            *endRequested;
+    QString                                error;
+
+    ColourPartScanJob()
+    {
+        setAutoDelete(false);
+    }
+
+    void run();
+};
+
+void ColourPartScanJob::run()
+{
+    QuaZip zip(archiveFile);
+    if (!zip.open(QuaZip::mdUnzip)) {
+        error = QString("! zip.open(): %1 @ %2").arg(zip.getZipError()).arg(archiveFile);
+        return;
+    }
+
+    int index = 0;
+    for(bool f=zip.goToFirstFile(); f && ! *endRequested; f=zip.goToNextFile()) {
+
+        QString entry = zip.getCurrentFileName();
+        if (entry.toLower().split(".").last() != "dat") {
+            continue;
+        }
+        int i = index++;
+        if (i % slices != slice) {
+            continue;
+        }
+        if (i >= entries->size() || entries->at(i) != entry) {
+            error = QString("Archive %1 changed while it was read").arg(archiveFile);
+            break;
+        }
+
+        QuaZipFileInfo info;
+        zip.getCurrentFileInfo(&info);
+
+        QHash<QString, ColourPartScan>::const_iterator cached = cache->constFind(libType + ":" + entry);
+        if (cached != cache->constEnd() && cached.value()._crc == info.crc) {
+            scans[i] = cached.value();
+            reused->ref();
+            done->ref();
+            continue;
+        }
+
+        QByteArray qba;
+        QuaZipFile zipFile(&zip);
+        if (zipFile.open(QIODevice::ReadOnly)) {
+            qba = zipFile.readAll();
+            zipFile.close();
+        } else {
+            error = QString("Failed to OPEN Part file :%1").arg(entry);
+            break;
+        }
+
+        scanColourPart(qba, entry, libType, scans[i]);
+        scans[i]._crc = info.crc;
+        done->ref();
+    }
+
+    zip.close();
+    if (error.isEmpty() && zip.getZipError() != UNZ_OK) {
+        error = QString("zip.close() zipError(): %1").arg(zip.getZipError());
+    }
+}
+
 bool ColourPartListWorker::processArchiveParts(const QString &archiveFile) {
 
     bool isUnOffLib = true;
@@ -1104,6 +1292,7 @@ bool ColourPartListWorker::processArchiveParts(const QString &archiveFile) {
         library = "Official Library";
         isUnOffLib = false;
     }
+    QString libType = isUnOffLib ? "U" : "O";
 
     QuaZip zip(archiveFile);
     if (!zip.open(QuaZip::mdUnzip)) {
@@ -1111,136 +1300,168 @@ bool ColourPartListWorker::processArchiveParts(const QString &archiveFile) {
         return false;
     }
 
-    // get part count
+    // get the parts, in archive order
     emit progressRangeSig(0, 0);
     emit progressMessageSig("Generating " + library + " Colour Parts...");
 
-    int partCount = 1;
+    QStringList entries;
     for(bool f=zip.goToFirstFile(); f; f=zip.goToNextFile()) {
-        if (zip.getCurrentFileName().toLower().split(".").last() != "dat") {
-            continue;
-
-        } else {
-            partCount++;
+        QString entry = zip.getCurrentFileName();
+        if (entry.toLower().split(".").last() == "dat") {
+            entries << entry;
         }
     }
-    logInfo() << QString("Processing %1 - Parts Count: %2").arg(library).arg(partCount);
+    zip.close();
+    if (zip.getZipError() != UNZ_OK) {
+        logError() << QString("zip.close() zipError(): %1").arg(zip.getZipError());
+        return false;
+    }
+    logInfo() << QString("Processing %1 - Parts Count: %2").arg(library).arg(entries.size());
 
     emit progressResetSig();
-    emit progressRangeSig(1, partCount);
-    partCount = 0;
-
-    for(bool f=zip.goToFirstFile(); f&&endThreadNotRequested(); f=zip.goToNextFile()) {
-
-        // set file and extract content
-        if (zip.getCurrentFileName().toLower().split(".").last() != "dat") {
-            continue;
+    emit progressRangeSig(1, entries.size());
+
+    // scan the parts on all cores, each job with its own archive reader
+    QVector<ColourPartScan> scans(entries.size());
+    QAtomicInt done(0);
+    QAtomicInt reused(0);
+    QList<ColourPartScanJob *> jobs;
+    QThreadPool pool;
+
+    int slices = qMax(1, QThread::idealThreadCount());
+    for (int slice = 0; slice < slices; slice++) {
+        ColourPartScanJob *job = new ColourPartScanJob;
+        job->archiveFile  = archiveFile;
+        job->libType      = libType;
+        job->entries      = &entries;
+        job->scans        = scans.data();
+        job->cache        = &_scanCache;
+        job->slice        = slice;
+        job->slices       = slices;
+        job->done         = &done;
+        job->reused       = &reused;
+        job->endRequested = &_endThreadNowRequested;
+        jobs << job;
+        pool.start(job);
+    }
+    while (! pool.waitForDone(100)) {
+        emit progressSetValueSig(done.load());
+    }
 
-          } else {
+    bool ok = true;
+    for (int i = 0; i < jobs.size(); i++) {
+        if (! jobs[i]->error.isEmpty()) {
+            logError() << jobs[i]->error;
+            ok = false;
+        }
+        delete jobs[i];
+    }
+    if (! ok) {
+        return false;
+    }
 
-            QString libFileName = zip.getCurrentFileName();
-            libFileName = isUnOffLib ? libFileName : libFileName.remove(0,6);  // Remove 'ldraw/' prefix from official file path
+    // add the results in archive order, so the list comes out the same every time
+    for (int i = 0; i < entries.size() && endThreadNotRequested(); i++) {
+        const ColourPartScan &scan = scans[i];
 
-            QByteArray qba;
-            QuaZipFile zipFile(&zip);
-            if (zipFile.open(QIODevice::ReadOnly)) {
-                qba = zipFile.readAll();
-                zipFile.close();
-            } else {
-                logError() << QString("Failed to OPEN Part file :%1").arg(libFileName);
-                return false;
-            }
+        QString libFileName = entries[i];
+        libFileName = isUnOffLib ? libFileName : libFileName.remove(0,6);  // Remove 'ldraw/' prefix from official file path
 
-            // convert to text stream and populate contents
-            QTextStream in(&qba);
-            while (! in.atEnd() && endThreadNotRequested()) {
-                QString line = in.readLine(0);
-                _partFileContents << line.toLower();
-            }
+        _scans.insert(libType + ":" + entries[i], scan);
 
-            // add content to ColourParts map
-            insert(_partFileContents, libFileName,-1,isUnOffLib);
+        // add content to ColourParts map
+        insert(scan._contents, libFileName, -1, isUnOffLib);
 
-            // process file contents
-            processFileContents(libFileName,isUnOffLib);
+        if (! scan._hasColour) {
+            continue;
+        }
 
-            emit progressSetValueSig(partCount++);
+        if (scan._unnamed) {
+            emit messageSig(false,QString("Part: %1 \nhas no 'Name:' attribute. Using library path name %2 instead.\n"
+                                          "You may want to update the part content and fade colour parts list.")
+                            .arg(scan._fileName).arg(libFileName));
+        }
+        remove(libFileName);
+        //logNotice() << "Remove from list as it is a known colour part: " << libFileName;
+
+        QString libEntry       = libFileName;
+        QString libFilePath    = libEntry.remove("/" + libEntry.split("/").last());
+        if (libFilePath != _filePath){
+            fileSectionHeader(FADESTEP_COLOUR_PARTS_HEADER, QString("# Library path: %1").arg(libFilePath));
+            _filePath = libFilePath;
         }
+        _cpLines++;
+        _fadeStepColourParts  << scan._fileEntry.toLower();
+        if (scan._fileName.size() > _colWidthFileName)
+            _colWidthFileName = scan._fileName.size();
     }
-    emit progressSetValueSig(partCount);
-    logInfo() << QString("Finished %1").arg(library);
+    emit progressSetValueSig(entries.size());
+    logInfo() << QString("Finished %1: %2 parts read, %3 unchanged since the last run")
+                 .arg(library).arg(entries.size() - reused.load()).arg(reused.load());
 
-    zip.close();
-    if (zip.getZipError() != UNZ_OK) {
-        logError() << QString("zip.close() zipError(): %1").arg(zip.getZipError());
-        return false;
-    }
     return true;
 }
 
 /*
- * parse colour part file to determine children parts with static colour.
+ * The scans of the last run, keyed by library type and archive entry,
+ * next to the colour parts list they made.
  */
-void ColourPartListWorker::processFileContents(const QString &libFileName, const bool isUnOffLib){
+static const quint32 ColourPartsCacheMagic   = 0x4c504353;  // LPCS
+static const quint32 ColourPartsCacheVersion = 1;
 
-    QString materialColor  ="16";  // Internal Common Material Colour (main)
-    QString edgeColor      ="24";  // Internal Common Material Color (edge)
-    QString fileEntry;
-    QString fileName;
-    QString colour;
-    QString libType        = isUnOffLib ? "U" : "O";
-    QString libEntry       = libFileName;
-    QString libFilePath    = libEntry.remove("/" + libEntry.split("/").last());
-    //logTrace() << "Processing libFileName" << libFileName;
-    bool hasColour = false;
-
-    for (int i = 0; i < _partFileContents.size() && endThreadNotRequested(); i++){
-        QString line = _partFileContents[i];
-        QStringList tokens;
+static QString scanCacheFile()
+{
+    QFileInfo colourFileList(Preferences::fadeStepColorPartsFile);
+    return QDir(colourFileList.absolutePath()).filePath("fadeStepColorParts.cache");
+}
 
-        //logInfo() << " File contents CHECK: " << line;
-        split(line,tokens);
-        if (tokens.size() == 3 && line.contains("Name:", Qt::CaseInsensitive))
-            fileName  = tokens[tokens.size()-1];
+void ColourPartListWorker::loadScanCache()
+{
+    _scanCache.clear();
 
-        //      if (tokens.size() == 15 && tokens[0] == "1") {
-         if((tokens.size() == 15 && tokens[0] == "1") ||
-            (tokens.size() == 8  && tokens[0] == "2") ||
-            (tokens.size() == 11 && tokens[0] == "3") ||
-            (tokens.size() == 14 && tokens[0] == "4") ||
-            (tokens.size() == 14 && tokens[0] == "5")) {
-            colour = tokens[1];
-            if (colour == edgeColor || colour == materialColor){
-                continue;
+    QFile file(scanCacheFile());
+    if ( ! file.open(QFile::ReadOnly)) {
+        return;
+    }
 
-            } else {
-                hasColour = true;
-                //logInfo() << " File contents VERIFY: " << line << " COLOUR: " << colour;
-                if (fileName.isEmpty()){
-                    fileName = libFileName.split("/").last();
-                    emit messageSig(false,QString("Part: %1 \nhas no 'Name:' attribute. Using library path name %2 instead.\n"
-                                                  "You may want to update the part content and fade colour parts list.")
-                                    .arg(fileName).arg(libFileName));
-                }
-                fileEntry = QString("%1:::%2:::%3").arg(fileName).arg(libType).arg(_partFileContents[0].remove(0,2));
-                remove(libFileName);
-                //logNotice() << "Remove from list as it is a known colour part: " << libFileName;
-                break;
-            }
-        } // token size
+    QDataStream in(&file);
+    quint32 magic, version;
+    qint32  count;
+    in >> magic >> version >> count;
+    if (magic != ColourPartsCacheMagic || version != ColourPartsCacheVersion) {
+        return;
     }
-    _partFileContents.clear();
-    if(hasColour) {
-         if (libFilePath != _filePath){
-             fileSectionHeader(FADESTEP_COLOUR_PARTS_HEADER, QString("# Library path: %1").arg(libFilePath));
-             _filePath = libFilePath;
-         }
-        _cpLines++;
-        _fadeStepColourParts  << fileEntry.toLower();
-        if (fileName.size() > _colWidthFileName)
-            _colWidthFileName = fileName.size();
-        //logNotice() << "ADD COLOUR PART: " << fileName << " libFileName: " << libFileName << " Colour: " << colour;
+
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString        key;
+        ColourPartScan scan;
+        in >> key >> scan._crc >> scan._hasColour >> scan._unnamed
+           >> scan._fileName >> scan._fileEntry >> scan._contents;
+        _scanCache.insert(key, scan);
+    }
+    if (in.status() != QDataStream::Ok) {
+        logError() << QString("Colour parts cache %1 is damaged, all parts will be read").arg(file.fileName());
+        _scanCache.clear();
+    }
+}
+
+void ColourPartListWorker::saveScanCache()
+{
+    QFile file(scanCacheFile());
+    if ( ! file.open(QFile::WriteOnly)) {
+        logError() << QString("Failed to OPEN colour parts cache %1 for writing:\n%2").arg(file.fileName()).arg(file.errorString());
+        return;
+    }
+
+    QDataStream out(&file);
+    out << ColourPartsCacheMagic << ColourPartsCacheVersion << qint32(_scans.size());
+    QHash<QString, ColourPartScan>::const_iterator i;
+    for (i = _scans.constBegin(); i != _scans.constEnd(); ++i) {
+        const ColourPartScan &scan = i.value();
+        out << i.key() << scan._crc << scan._hasColour << scan._unnamed
+            << scan._fileName << scan._fileEntry << scan._contents;
     }
+    file.close();
 }
 
 void ColourPartListWorker::processChildren(){
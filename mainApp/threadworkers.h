@@ -18,6 +18,7 @@
 #include <QFile>
 #include <QList>
 #include <QMap>
+#include <QHash>
 #include <QObject>
 #include <QRegExp>
 #include <QElapsedTimer>
@@ -71,6 +72,28 @@ public:
     }
 };
 
+/*
+ * What scanning one library part for static colours found.  Kept in the
+ * colour parts cache under the part's archive CRC, so parts that did not
+ * change since the last list was generated are not read again.
+ */
+class ColourPartScan {
+public:
+    quint32     _crc;                             // archive entry CRC-32
+    bool        _hasColour;                       // has a line coloured other than 16 or 24
+    bool        _unnamed;                         // no Name: line, _fileName is from the path
+    QString     _fileName;
+    QString     _fileEntry;                       // colour parts list entry, when _hasColour
+    QStringList _contents;                        // first, Name: and type 1 lines, for processChildren
+
+    ColourPartScan()
+    {
+        _crc       = 0;
+        _hasColour = false;
+        _unnamed   = false;
+    }
+};
+
 class PartWorker: public QObject
 {
    Q_OBJECT
@@ -182,10 +205,6 @@ private:
 
    void empty();
 
-   bool saveFadeFile(
-        const QString        &fileName,
-        const QStringList    &fadePartContent);
-
    bool createFadePartFiles();                       // convert static color files // replace color code with fade color
 
    // new
@@ -224,7 +243,6 @@ public:
     {
         _colourParts.empty();
         _fadeStepColourParts.clear();
-        _partFileContents.clear();
     }
 
     void insert(
@@ -281,9 +299,10 @@ private:
     int                       _colWidthFileName;
 
     QStringList               _fadeStepColourParts;
-    QStringList               _partFileContents;
     QElapsedTimer             _timer;
     QString                   _filePath;
+    QHash<QString, ColourPartScan> _scanCache;       // last run's scans, by library type and entry
+    QHash<QString, ColourPartScan> _scans;           // this run's scans, saved as the next cache
     LDPartsDirs                ldPartsDirs;                     // automatically load LDraw.ini parameters
 
     bool endThreadNotRequested(){ return ! _endThreadNowRequested;}
@@ -291,8 +310,8 @@ private:
     void writeFadeFile(bool append = false);
 
     bool processArchiveParts(const QString &archiveFile);
-    void processFileContents(const QString &libFileName,
-                             const bool       isUnOffLib);
+    void loadScanCache();
+    void saveScanCache();
     void fileSectionHeader(const int &option,
                            const QString &heading = "");
 
@@ -41,6 +41,10 @@
 #include <QGraphicsScene>
 #include <QString>
 #include <QFileInfo>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QRunnable>
+#include <climits>
 #include "lpub_preferences.h"
 #include "ranges.h"
 #include "callout.h"
@@ -50,6 +54,7 @@
 #include "step.h"
 #include "paths.h"
 #include "metaitem.h"
+#include "rendercache.h"
 
 #include "QsLog.h"
 
@@ -211,6 +216,12 @@ static void remove_partname(
  * but continues parsing through to the last page, so we know how many pages
  * are in the building instuctions.
  *
+ * When findPage walks the whole model it records the start of page parse
+ * state for every page in the page index (see PageState in lpub.h).  Until
+ * the model changes, drawing any page (e.g. next page, or each page of an
+ * export) starts drawPage directly from the recorded state instead of
+ * traversing the model again from the top.
+ *
  */
 
 Range *newRange(
@@ -306,6 +317,7 @@ int Gui::drawPage(
       Meta   &curMeta = callout ? callout->meta : steps->meta;
 
       QStringList tokens;
+      LDrawLine   parsed;
 
       // If we hit end of file we've got to note end of step
 
@@ -313,20 +325,31 @@ int Gui::drawPage(
           line.clear();
           gprc = EndOfFileRc;
           tokens << "0";
+          parsed.kind = 0;
 
           // not end of file, so get the next LDraw line
 
         } else {
-          line = ldrawFile.readLine(current.modelName,current.lineNumber);
-          split(line,tokens);
+          line   = ldrawFile.readLine(current.modelName,current.lineNumber);
+          parsed = ldrawFile.parsedLine(current.modelName,current.lineNumber);
+
+          // a ghosted line is a meta-command here, so it keeps its 0 GHOST
+          if (parsed.ghost) {
+              split(line,tokens);
+              parsed = LDrawLine();
+              parsed.kind = 0;
+            } else {
+              tokens = parsed.tokens;
+            }
         }
 
-      if (tokens.size() == 15 && tokens[0] == "1") {
+      if (parsed.kind == 1) {
 
-          QString color = tokens[1];
-          QString type  = tokens[tokens.size()-1];
+          QString color = parsed.color;
+          QString type  = parsed.type;
 
           if (color == "16") {
+              split(line,tokens);
               QStringList addTokens;
               split(addLine,addTokens);
               if (addTokens.size() == 15) {
@@ -438,11 +461,11 @@ int Gui::drawPage(
                   Meta tmpMeta = curMeta;
                   Where walk = current;
                   for (++walk; walk < numLines; ++walk) {
-                      QStringList tokens;
-                      QString scanLine = ldrawFile.readLine(walk.modelName,walk.lineNumber);
-                      split(scanLine,tokens);
-                      if (tokens.size() > 0 && tokens[0] == "0") {
-                          Rc rc = tmpMeta.parse(scanLine,walk,false);
+                      LDrawLine scanParsed = ldrawFile.parsedLine(walk.modelName,walk.lineNumber);
+                      if (scanParsed.kind == 0 || scanParsed.ghost) {
+                          QString scanLine = ldrawFile.readLine(walk.modelName,walk.lineNumber);
+                          Rc rc = scanParsed.ghost ? tmpMeta.parse(scanLine,walk,false)
+                                                   : tmpMeta.parse(scanLine,scanParsed.tokens,walk,false);
                           if (rc == StepRc || rc == RotStepRc) {
                               break;
                             }
@@ -484,7 +507,7 @@ int Gui::drawPage(
                         current2,
                         csiParts2,
                         calloutParts,
-                        ldrawFile.mirrored(tokens),
+                        parsed.mirrored,
                         calloutBfx,
                         printing,
                         bfxStore2,
@@ -520,11 +543,7 @@ int Gui::drawPage(
               emit messageSig(true, "Processing " + current.modelName);
             }
 
-        } else if (tokens.size() > 0 &&
-                   (tokens[0] == "2" ||
-                    tokens[0] == "3" ||
-                    tokens[0] == "4" ||
-                    tokens[0] == "5")) {
+        } else if (parsed.kind >= 2) {
 
           csiParts << line;
           partsAdded = true;
@@ -548,7 +567,7 @@ int Gui::drawPage(
               range->append(step);
             }
 
-        } else if ( (tokens.size() > 0 && tokens[0] == "0") || gprc == EndOfFileRc) {
+        } else if (parsed.kind == 0 || gprc == EndOfFileRc) {
 
           /* must be meta-command (or comment) */
           if (global && tokens.contains("!LPUB") && tokens.contains("GLOBAL")) {
@@ -560,7 +579,7 @@ int Gui::drawPage(
           if (gprc == EndOfFileRc) {
               rc = gprc;
             } else {
-              rc = curMeta.parse(line,current,true);
+              rc = curMeta.parse(line,tokens,current,true);
             }
 
           InsertData insertData;
@@ -951,6 +970,7 @@ int Gui::drawPage(
                       timer.start();
 
                       int rc = renderer->renderLDViewSCallCsi(ldrStepFiles, steps->meta);
+                      renderCache.rendered(ldrStepFiles, rc == 0);
                       if (rc != 0) {
                           QMessageBox::critical(NULL,QMessageBox::tr(VER_PRODUCTNAME_STR),
                                                 QMessageBox::tr("Render CSI images failed."));
@@ -966,6 +986,15 @@ int Gui::drawPage(
                                  << "step group on page" << stepPageNum << ".";
                     }
 
+                  if (renderer->useRenderQueue()) {
+                      int rc = renderQueue.waitForFinished();
+                      if (rc != 0) {
+                          QMessageBox::critical(NULL,QMessageBox::tr(VER_PRODUCTNAME_STR),
+                                                QMessageBox::tr("Render CSI images failed."));
+                          return rc;
+                        }
+                    }
+
                   addGraphicsPageItems(steps, coverPage, endOfSubmodel, view, scene, printing);
 
                   return HitEndOfPage;
@@ -1162,6 +1191,7 @@ int Gui::drawPage(
                           timer.start();
 
                           int rc = renderer->renderLDViewSCallCsi(ldrStepFiles, steps->meta);
+                          renderCache.rendered(ldrStepFiles, rc == 0);
                           if (rc != 0) {
                               QMessageBox::critical(NULL,QMessageBox::tr(VER_PRODUCTNAME_STR),
                                                     QMessageBox::tr("Render CSI images failed."));
@@ -1177,6 +1207,15 @@ int Gui::drawPage(
                                      << "single step on page" << stepPageNum << ".";
                         }
 
+                      if (renderer->useRenderQueue()) {
+                          int rc = renderQueue.waitForFinished();
+                          if (rc != 0) {
+                              QMessageBox::critical(NULL,QMessageBox::tr(VER_PRODUCTNAME_STR),
+                                                    QMessageBox::tr("Render CSI images failed."));
+                              return rc;
+                            }
+                        }
+
                       addGraphicsPageItems(steps,coverPage,endOfSubmodel,view,scene,printing);
                       stepPageNum += ! coverPage;
                       steps->setBottomOfSteps(current);
@@ -1303,18 +1342,22 @@ int Gui::findPage(
           line = line.mid(8).trimmed();
         }
 
+      // the same line parsed, with any 0 GHOST set aside as above
+      LDrawLine parsed = ldrawFile.parsedLine(current.modelName,current.lineNumber);
+
       QStringList tokens, addTokens;
+      QString     color = parsed.color;
 
       switch (line.toLatin1()[0]) {
         case '1':
-          split(line,tokens);
-
-          if (tokens[1] == "16") {
+          if (color == "16") {
+              split(line,tokens);
               split(addLine,addTokens);
               if (addTokens.size() == 15) {
                   tokens[1] = addTokens[1];
                 }
               line = tokens.join(" ");
+              color = tokens[1];
             }
 
           if ( ! partIgnore) {
@@ -1326,11 +1369,7 @@ int Gui::findPage(
                 }
               lastStepPageNum = pageNum;
 
-              QStringList token;
-
-              split(line,token);
-
-              QString    type = token[token.size()-1];
+              QString    type = parsed.type;
 
               bool contains   = ldrawFile.isSubmodel(type);
               CalloutBeginMeta::CalloutMode mode = meta.LPub.callout.begin.value();
@@ -1338,9 +1377,9 @@ int Gui::findPage(
               // if submodel or callout treated as part (added to parent as assembled image)
               if (contains && (!callout || (callout && mode != CalloutBeginMeta::Unassembled))) {
 
-                  bool rendered = ldrawFile.rendered(type,ldrawFile.mirrored(token));
+                  bool rendered = ldrawFile.rendered(type,parsed.mirrored);
                   if (! meta.LPub.mergeInstanceCount.value())
-                      rendered = ldrawFile.rendered(type,ldrawFile.mirrored(token)) && stepNumber == renderStepNum;
+                      rendered = ldrawFile.rendered(type,parsed.mirrored) && stepNumber == renderStepNum;
 
 //                  logTrace() << QString("Submodel %1 in parent %4 at line %3, step %5 %2")
 //                                .arg(type)
@@ -1348,12 +1387,12 @@ int Gui::findPage(
 //                                .arg(current.lineNumber).arg(current.modelName)
 //                                .arg(stepNumber);
 
-                  if ( ! rendered && (! bfxStore2 || ! bfxParts.contains(token[1]+type))) {
+                  if ( ! rendered && (! bfxStore2 || ! bfxParts.contains(color+type))) {
 
                       // store the step where the submodel is rendered for later comparison
                       renderStepNum = stepNumber;
 
-                      isMirrored = ldrawFile.mirrored(token);
+                      isMirrored = parsed.mirrored;
 
                       // can't be a callout
                       SubmodelStack tos(current.modelName,current.lineNumber,stepNumber);
@@ -1398,13 +1437,13 @@ int Gui::findPage(
                     }
                 }
               if (bfxStore1) {
-                  bfxParts << token[1]+type;
+                  bfxParts << color+type;
                 }
 
             } else if (partIgnore){
 
-              if (tokens.size() == 15){
-                  QString lineItem = tokens[tokens.size()-1];
+              if (parsed.kind == 1){
+                  QString lineItem = parsed.type;
 
                   if (ldrawFile.isSubmodel(lineItem)){
                       //Where model(lineItem,0);
@@ -1423,7 +1462,7 @@ int Gui::findPage(
           break;
 
         case '0':
-          rc = meta.parse(line,current);
+          rc = meta.parse(line,parsed.tokens,current);
           switch (rc) {
             case StepGroupBeginRc:
               stepGroup = true;
@@ -1436,6 +1475,21 @@ int Gui::findPage(
             case StepGroupEndRc:
               if (stepGroup && ! noStep2) {
                   stepGroup = false;
+                  if (pageIndexBuilding) {
+                      recordPageState(pageNum,
+                                      pageNum == 1 ? meta : saveMeta,
+                                      stepGroupCurrent,
+                                      addLine,
+                                      saveCsiParts,
+                                      saveBfxParts,
+                                      saveBfx,
+                                      saveStepNumber,
+                                      saveStepPageNum,
+                                      isMirrored,
+                                      stepGroupBfxStore2);
+                      pageIndex[pageNum].meta.pop();
+                      pageIndex[pageNum].meta.rotStep = saveRotStep;
+                    }
                   if (pageNum < displayPageNum) {
                       saveCsiParts   = csiParts;
                       saveStepNumber = stepNumber;
@@ -1528,6 +1582,21 @@ int Gui::findPage(
               if (partsAdded && ! noStep) {
                   stepNumber += ! coverPage && ! stepPage;
                   stepPageNum += ! coverPage && ! stepGroup;
+                  if (pageIndexBuilding && ! stepGroup) {
+                      recordPageState(pageNum,
+                                      pageNum == 1 ? meta : saveMeta,
+                                      saveCurrent,
+                                      addLine,
+                                      saveCsiParts,
+                                      saveBfxParts,
+                                      saveBfx,
+                                      saveStepNumber,
+                                      saveStepPageNum,
+                                      isMirrored,
+                                      bfxStore2);
+                      pageIndex[pageNum].meta.pop();
+                      pageIndex[pageNum].meta.rotStep = meta.rotStep;
+                    }
                   if (pageNum < displayPageNum) {
                       if ( ! stepGroup) {
                           saveCsiParts   = csiParts;
@@ -1764,6 +1833,19 @@ int Gui::findPage(
   csiParts.clear();
 
   if (partsAdded && ! noStep) {
+      if (pageIndexBuilding) {
+          recordPageState(pageNum,
+                          saveMeta,
+                          saveCurrent,
+                          addLine,
+                          saveCsiParts,
+                          saveBfxParts,
+                          saveBfx,
+                          saveStepNumber,
+                          stepPageNum,
+                          isMirrored,
+                          bfxStore2);
+        }
       if (pageNum == displayPageNum) {
 
           saveFadePosition = saveCsiParts.size();
@@ -1868,21 +1950,23 @@ int Gui::getBOMParts(
           line = line.mid(8).trimmed();
         }
 
+      LDrawLine parsed = ldrawFile.parsedLine(current.modelName,current.lineNumber);
+
       switch (line.toLatin1()[0]) {
         case '1':
           if ( ! partIgnore && ! pliIgnore && ! synthBegin) {
 
-              QStringList token,addToken;
+              QString    type  = parsed.type;
+              QString    color = parsed.color;
 
-              split(line,token);
-
-              QString    type = token[token.size()-1];
-
-              if (token[1] == "16") {
+              if (color == "16") {
+                  QStringList token,addToken;
                   split(addLine,addToken);
                   if (addToken.size() == 15) {
+                      split(line,token);
                       token[1] = addToken[1];
                       line = token.join(" ");
+                      color = token[1];
                     }
                 }
 
@@ -1890,7 +1974,7 @@ int Gui::getBOMParts(
            * Automatically ignore parts added twice due to buffer exchange
            */
               bool removed = false;
-              QString colorPart = token[1] + type;
+              QString colorPart = color + type;
 
               if (bfxStore2 && bfxLoad) {
                   int i;
@@ -1938,7 +2022,7 @@ int Gui::getBOMParts(
             }
           break;
         case '0':
-          rc = meta.parse(line,current);
+          rc = meta.parse(line,parsed.tokens,current);
 
           /* substitute part/parts with this */
 
@@ -2109,9 +2193,9 @@ int Gui::getBOMOccurrence(Where	current) {		// start at top of ldrawFile
   if (occurrenceNum > 1) {
       // now set the bom occurrance based on our current position
       Where here = gui->topOfPages[gui->displayPageNum-1];
+      Meta meta;     // only INSERT values are read, each right after its parse
       for (++here; here.lineNumber < ldrawFile.size(here.modelName); here++) {
           QString line = gui->readLine(here);
-          Meta meta;
           Rc rc;
 
           rc = meta.parse(line,here);
@@ -2189,6 +2273,10 @@ void Gui::countPages()
   if (maxPages < 1) {
       writeToTmp();
       statusBarMsg("Counting");
+
+      QElapsedTimer countTimer;
+      countTimer.start();
+
       Where current(ldrawFile.topLevelFile(),0);
       int savedDpn     = displayPageNum;
       displayPageNum   = 1 << 31;
@@ -2203,6 +2291,10 @@ void Gui::countPages()
       topOfPages.append(current);
       maxPages--;
 
+      logTrace() << QString("Counted %1 pages. %2")
+                    .arg(maxPages)
+                    .arg(elapsedTime(countTimer.elapsed()));
+
       if (displayPageNum > maxPages) {
           displayPageNum = maxPages;
         } else {
@@ -2221,6 +2313,22 @@ void Gui::drawPage(
 {
   QApplication::setOverrideCursor(Qt::WaitCursor);
 
+  /* the page index is still good, so go straight to the page */
+
+  if (pageIndexValid() && pageIndex.contains(displayPageNum)) {
+      ldrawFile.unrendered();
+      ldrawFile.countInstances();
+      writeToTmp();
+      drawIndexedPage(view,scene,printing);
+
+      QString string = QString("%1 of %2") .arg(displayPageNum) .arg(maxPages);
+      if (! exporting())
+        setPageLineEdit->setText(string);
+
+      QApplication::restoreOverrideCursor();
+      return;
+    }
+
   ldrawFile.unrendered();
   ldrawFile.countInstances();
   writeToTmp();
@@ -2252,10 +2360,27 @@ void Gui::drawPage(
 #endif
     }
 
+  /* walk the whole model once, recording the top of every page, then
+     draw the page of interest from what was recorded */
+
+  int savedDpn      = displayPageNum;
+  displayPageNum    = INT_MAX;
+  clearPageIndex();
+  pageIndexBuilding = true;
+
   findPage(view,scene,maxPages,empty,current,pageSize,false,meta,printing);
   topOfPages.append(current);
   maxPages--;
 
+  pageIndexBuilding  = false;
+  pageIndexExporting = exporting();
+  pageIndexVersion   = ldrawFile.contentVersion();
+  displayPageNum     = savedDpn;
+
+  if (pageIndex.contains(displayPageNum)) {
+      drawIndexedPage(view,scene,printing);
+    }
+
   QString string = QString("%1 of %2") .arg(displayPageNum) .arg(maxPages);
   if (! exporting())
     setPageLineEdit->setText(string);
@@ -2263,6 +2388,76 @@ void Gui::drawPage(
   QApplication::restoreOverrideCursor();
 }
 
+bool Gui::pageIndexValid()
+{
+  return ! pageIndex.isEmpty() &&
+         pageIndexVersion   == ldrawFile.contentVersion() &&
+         pageIndexExporting == exporting();
+}
+
+void Gui::recordPageState(
+    int            pageNum,
+    const Meta    &meta,
+    const Where   &current,
+    const QString &addLine,
+    const QStringList &csiParts,
+    const QStringList &bfxParts,
+    const QHash<QString, QStringList> &bfx,
+    int            stepNumber,
+    int            stepPageNum,
+    bool           isMirrored,
+    bool           bfxStore2)
+{
+  PageState &state   = pageIndex[pageNum];
+  state.meta         = meta;
+  state.current      = current;
+  state.addLine      = addLine;
+  state.csiParts     = csiParts;
+  state.bfxParts     = bfxParts;
+  state.bfx          = bfx;
+  state.stepNumber   = stepNumber;
+  state.stepPageNum  = stepPageNum;
+  state.fadePosition = csiParts.size();
+  state.isMirrored   = isMirrored;
+  state.bfxStore2    = bfxStore2;
+}
+
+void Gui::drawIndexedPage(
+    LGraphicsView  *view,
+    QGraphicsScene *scene,
+    bool            printing)
+{
+  const PageState &state = pageIndex[displayPageNum];
+
+  /* drawPage consumes its parse state, so hand it copies */
+
+  Where       current  = state.current;
+  QStringList csiParts = state.csiParts;
+  QStringList bfxParts = state.bfxParts;
+  QHash<QString, QStringList> bfx = state.bfx;
+  QStringList pliParts;
+  QStringList ldrStepFiles;
+
+  page.meta        = state.meta;
+  stepPageNum      = state.stepPageNum;
+  saveFadePosition = state.fadePosition;
+
+  (void) drawPage(view,
+                  scene,
+                  &page,
+                  state.stepNumber,
+                  state.addLine,
+                  current,
+                  csiParts,
+                  pliParts,
+                  state.isMirrored,
+                  bfx,
+                  printing,
+                  state.bfxStore2,
+                  bfxParts,
+                  ldrStepFiles);
+}
+
 void Gui::skipHeader(Where &current)
 {
   int numLines = ldrawFile.size(current.modelName);
@@ -2353,6 +2548,160 @@ Where &Gui::bottomOfPage()
     }
 }
 
+/*
+ * The meta commands writeToTmp acts on, recognised from the split line
+ * (tokens[0] is "0") without building a Meta.  As in Meta::parse, LPUB
+ * is taken for !LPUB and LOCAL or GLOBAL may follow any keyword.
+ */
+
+static int tmpMetaScope(const QStringList &tokens, int index)
+{
+  if (index + 1 < tokens.size() &&
+      (tokens[index] == "LOCAL" || tokens[index] == "GLOBAL")) {
+      index++;
+    }
+  return index;
+}
+
+static Rc tmpMetaRc(const QStringList &tokens, QString &value)
+{
+  int size = tokens.size();
+
+  if (size < 4) {
+      return OkRc;
+    }
+
+  if (tokens[1] == "BUFEXCHG") {
+      int i = tmpMetaScope(tokens,2);
+      if (i + 2 == size && tokens[i].size() == 1 &&
+          tokens[i][0] >= 'A' && tokens[i][0] <= 'Z') {
+          value = tokens[i];
+          if (tokens[i+1] == "STORE") {
+              return BufferStoreRc;
+            } else if (tokens[i+1] == "RETRIEVE") {
+              return BufferLoadRc;
+            }
+        }
+    } else if (tokens[1] == "!LPUB" || tokens[1] == "LPUB") {
+      int i = tmpMetaScope(tokens,2);
+      if (i + 2 < size && tokens[i] == "REMOVE") {
+          i = tmpMetaScope(tokens,i + 1);
+          Rc rc = tokens[i] == "GROUP" ? RemoveGroupRc :
+                  tokens[i] == "PART"  ? RemovePartRc  :
+                  tokens[i] == "NAME"  ? RemoveNameRc  : OkRc;
+          i = tmpMetaScope(tokens,i + 1);
+          if (rc != OkRc && i + 1 == size) {
+              value = tokens[i];
+              return rc;
+            }
+        }
+    }
+  return OkRc;
+}
+
+/*
+ * The faded form of one line: its colour set to the fade colour, edges
+ * excepted, and static colour parts and submodels renamed to their -fade
+ * copies.  submodels holds the lower case names of the model's own
+ * submodels; this also runs on the writeToTmp threads, so it does not
+ * touch the Gui.
+ */
+static QString fadeLine(const QString &line, const QString &fadeColor,
+                        const QSet<QString> &submodels)
+{
+  QString edgeColor = "24";  // Internal Common Material Color (edge)
+  QStringList argv;
+
+  split(line, argv);
+  if (argv.size() == 15 && argv[0] == "1") {
+      // set fade colour
+      if (argv[1] != edgeColor){
+          argv[1] = fadeColor;}
+      // process static colored parts
+      QString fileNameStr = argv[argv.size()-1].toLower();
+      if (FadeStepColorParts::isStaticColorPart(fileNameStr)){
+          fileNameStr = QDir::toNativeSeparators(fileNameStr.replace(".dat","-fade.dat"));
+        }
+      // process subfile naming
+      if (submodels.contains(fileNameStr)) {
+          QString extension = QFileInfo(fileNameStr).suffix().toLower();
+          bool ldr = extension == "ldr";
+          bool mpd = extension == "mpd";
+          bool dat = extension == "dat";
+          if (ldr) {
+              fileNameStr = fileNameStr.replace(".ldr","-fade.ldr");
+            } else if (mpd) {
+              fileNameStr = fileNameStr.replace(".mpd","-fade.mpd");
+            } else if (dat) {
+              fileNameStr = fileNameStr.replace(".dat","-fade.dat");
+            }
+        }
+      argv[argv.size()-1] = fileNameStr;
+    } else if ((argv.size() == 8  && argv[0] == "2") ||
+               (argv.size() == 11 && argv[0] == "3") ||
+               (argv.size() == 14 && argv[0] == "4") ||
+               (argv.size() == 14 && argv[0] == "5")) {
+      if (argv[1] != edgeColor){
+          argv[1] = fadeColor;}
+    }
+  return argv.join(" ");
+}
+
+/*
+ * Fade writeToTmp content - make fade copies of submodel files.  Lines
+ * the last copy of the file already faded are taken from before, only new
+ * or edited lines are faded again; after gets the lines of this copy.
+ */
+static QStringList fadeSubFile(const QStringList &contents, const QString &color,
+                               const QSet<QString> &submodels,
+                               const QHash<QString, QString> &before,
+                               QHash<QString, QString> &after)
+{
+  QStringList fadeContents;
+
+  if (contents.size() == 0) {
+      return contents;
+    }
+
+  for (int index = 0; index < contents.size(); index++) {
+      const QString &contentLine = contents[index];
+      QHash<QString, QString>::const_iterator faded = before.constFind(contentLine);
+      QString fadedLine = faded != before.constEnd() ?
+                          faded.value() : fadeLine(contentLine, color, submodels);
+      after.insert(contentLine, fadedLine);
+      fadeContents << fadedLine;
+    }
+  return fadeContents;
+}
+
+/*
+ * One file writeToTmp puts in the temp directory: a submodel, or its
+ * faded copy.  Jobs share nothing but implicitly shared, read only
+ * data, so they run on a thread pool.
+ */
+
+class TmpFileJob : public QRunnable
+{
+public:
+  QString            fileName;     // temp file name, relative to the tmp dir
+  QStringList        contents;     // the submodel lines
+  QVector<LDrawLine> parsed;       // contents, parsed
+  bool               fade;
+  QString            fadeColor;
+  QSet<QString>      submodels;    // lower case, for fadeSubFile
+  QHash<QString, QString> fadedBefore; // faded lines of the last copy
+  QHash<QString, QString> faded;       // faded lines of this copy
+  QString            error;        // set if the file could not be written
+
+  TmpFileJob()
+  {
+    fade = false;
+    setAutoDelete(false);
+  }
+
+  void run();
+};
+
 /*
  * This function applies buffer exchange and LPub's remove
  * meta commands before writing them out for the renderers to use.
@@ -2360,102 +2709,144 @@ Where &Gui::bottomOfPage()
  * exchange
  */
 
-void Gui::writeToTmp(const QString &fileName,
-                     const QStringList &contents)
+void TmpFileJob::run()
 {
-  QString fname = QDir::currentPath() + "/" + Paths::tmpDir + "/" + fileName;
-  QFileInfo fileInfo(fname);
-  if(!fileInfo.dir().exists()) {
-     fileInfo.dir().mkpath(".");
-    }
-  QFile file(fname);
-  if ( ! file.open(QFile::WriteOnly|QFile::Text)) {
-      QMessageBox::warning(NULL,QMessageBox::tr("LPub3D"),
-                           QMessageBox::tr("Failed to open %1 for writing: %2")
-                           .arg(fname) .arg(file.errorString()));
-    } else {
-      QStringList csiParts;
-      QHash<QString, QStringList> bfx;
+  QStringList lines = fade ? fadeSubFile(contents,fadeColor,submodels,fadedBefore,faded) : contents;
+  QStringList csiParts;
+  QHash<QString, QStringList> bfx;
+  QString value;
 
-      for (int i = 0; i < contents.size(); i++) {
-          QString line = contents[i];
-          QStringList tokens;
+  for (int i = 0; i < lines.size() && i < parsed.size(); i++) {
+      const LDrawLine &line = parsed[i];
 
-          split(line,tokens);
-          if (tokens.size()) {
-              if (tokens[0] != "0") {
-                  csiParts << line;
-                } else {
-                  Meta meta;
-                  Rc   rc;
-                  Where here(fileName,i);
-                  rc = meta.parse(line,here,false);
+      // geometry, 0 GHOST lines included, goes out as it is
+      if (line.kind > 0) {
+          csiParts << lines[i];
+          continue;
+        }
 
-                  switch (rc) {
+      // blank and unrecognised lines, kept if split finds a token that
+      // is not a meta command's 0
+      if (line.kind < 0) {
+          QStringList tokens;
+          split(lines[i],tokens);
+          if (tokens.size() && tokens[0] != "0") {
+              csiParts << lines[i];
+            }
+          continue;
+        }
 
-                    /* Buffer exchange */
-                    case BufferStoreRc:
-                      bfx[meta.bfx.value()] = csiParts;
-                      break;
-                    case BufferLoadRc:
-                      csiParts = bfx[meta.bfx.value()];
-                      break;
+      // a bare 0 GHOST splits to nothing
+      if (line.tokens.isEmpty()) {
+          continue;
+        }
 
-                      /* remove a group or all instances of a part type */
-                    case GroupRemoveRc:
-                    case RemoveGroupRc:
-                    case RemovePartRc:
-                    case RemoveNameRc:
-                      {
-                        QStringList newCSIParts;
-                        if (rc == RemoveGroupRc) {
-                            remove_group(csiParts,meta.LPub.remove.group.value(),newCSIParts);
-                          } else if (rc == RemovePartRc) {
-                            remove_parttype(csiParts, meta.LPub.remove.parttype.value(),newCSIParts);
-                          } else {
-                            remove_partname(csiParts, meta.LPub.remove.partname.value(),newCSIParts);
-                          }
-                        csiParts = newCSIParts;
-                      }
-                      break;
-                    default:
-                      break;
-                    }
-                }
-            }
+      if (line.tokens[0] != "0") {
+          csiParts << lines[i];
+          continue;
         }
 
-      QTextStream out(&file);
-      for (int i = 0; i < csiParts.size(); i++) {
-          out << csiParts[i] << endl;
+      Rc rc = tmpMetaRc(line.tokens,value);
+
+      switch (rc) {
+
+        /* Buffer exchange */
+        case BufferStoreRc:
+          bfx[value] = csiParts;
+          break;
+        case BufferLoadRc:
+          csiParts = bfx[value];
+          break;
+
+          /* remove a group or all instances of a part type */
+        case RemoveGroupRc:
+        case RemovePartRc:
+        case RemoveNameRc:
+          {
+            QStringList newCSIParts;
+            if (rc == RemoveGroupRc) {
+                remove_group(csiParts,value,newCSIParts);
+              } else if (rc == RemovePartRc) {
+                remove_parttype(csiParts,value,newCSIParts);
+              } else {
+                remove_partname(csiParts,value,newCSIParts);
+              }
+            csiParts = newCSIParts;
+          }
+          break;
+        default:
+          break;
         }
-      file.close();
+    }
+
+  /* write it out in one go, replacing the old file only once complete */
+
+  QString fname = QDir::currentPath() + "/" + Paths::tmpDir + "/" + fileName;
+  QFileInfo fileInfo(fname);
+  if(!fileInfo.dir().exists()) {
+     fileInfo.dir().mkpath(".");
+    }
+  QSaveFile file(fname);
+  if ( ! file.open(QFile::WriteOnly|QFile::Text)) {
+      error = QMessageBox::tr("Failed to open %1 for writing: %2")
+                      .arg(fname) .arg(file.errorString());
+      return;
+    }
+
+  QTextStream out(&file);
+  for (int i = 0; i < csiParts.size(); i++) {
+      out << csiParts[i] << '\n';
+    }
+  out.flush();
+
+  if ( ! file.commit()) {
+      error = QMessageBox::tr("Failed to write %1: %2")
+                      .arg(fname) .arg(file.errorString());
     }
 }
 
+/*
+ * Bring the temp directory up to date with the model.  Only submodels
+ * changed since they were last written are processed, each with its fade
+ * copy when fade step is on, all at the same time.
+ */
+
 void Gui::writeToTmp()
 {
-  if (! exporting()) {
-      emit progressBarPermInitSig();
-      emit progressPermRangeSig(1, ldrawFile._subFileOrder.size());
-      emit progressPermMessageSig("Submodels...");
-    }
-  emit messageSig(true, "Writing submodels to temp directory...");
-
   bool    doFadeStep  = (page.meta.LPub.fadeStep.fadeStep.value() || Preferences::enableFadeStep);
   QString fadeColor   = LDrawColor::ldColorCode(page.meta.LPub.fadeStep.fadeColor.value());
-  bool upToDate = true;
 
-  QStringList content;
+  // fade copies missing or made with another colour
+  if (doFadeStep && fadeColor != tmpFadeColor) {
+      ldrawFile.tempCacheCleared();
+    }
+  if (doFadeStep) {
+      checkFadeCache(fadeColor);
+    }
+
+  QElapsedTimer writeTimer;
+  writeTimer.start();
+
+  QList<TmpFileJob *> jobs;
 
   for (int i = 0; i < ldrawFile._subFileOrder.size(); i++) {
 
       QString fileName = ldrawFile._subFileOrder[i].toLower();
 
-      if (! exporting())
-        emit progressPermSetValueSig(i);
+      if ( ! ldrawFile.changedSinceLastWrite(fileName)) {
+          continue;
+        }
+
+      TmpFileJob *job = new TmpFileJob;
+      job->fileName   = fileName;
+      job->contents   = ldrawFile.contents(fileName);
+      job->parsed     = ldrawFile.parsedLines(fileName);
+      jobs << job;
 
       if (doFadeStep) {
+
+          /* Faded version of submodels */
+
           QString fadeFileName = fileName;
           QString extension = QFileInfo(fileName).suffix().toLower();
           bool ldr = extension == "ldr";
@@ -2468,162 +2859,143 @@ void Gui::writeToTmp()
             } else if (dat) {
               fadeFileName = fadeFileName.replace(".dat","-fade.dat");
             }
-          content = ldrawFile.contents(fileName);
-          if (ldrawFile.changedSinceLastWrite(fileName)) {
 
-              upToDate = false;
-              writeToTmp(fileName,content);
-              content = fadeSubFile(content,fadeColor);
-              emit messageSig(true, "Writing submodel to temp directory: " + fileName);
-
-              /* Faded version of submodels */
-              writeToTmp(fadeFileName,content);
-              emit messageSig(true, "Writing submodel to temp directory: " + fadeFileName);
+          TmpFileJob *fadeJob = new TmpFileJob;
+          fadeJob->fileName   = fadeFileName;
+          fadeJob->contents   = job->contents;
+          fadeJob->parsed     = job->parsed;
+          fadeJob->fade       = true;
+          fadeJob->fadeColor  = fadeColor;
+          fadeJob->submodels  = fadeSubmodels;
+          fadeJob->fadedBefore = tmpFadeLines.value(fadeFileName);
+          jobs << fadeJob;
+        }
+    }
 
-            }
-        } else {
+  if (jobs.isEmpty()) {
+      emit messageSig(true, "No submodels written; temp directory up to date.");
+      return;
+    }
 
-          content = ldrawFile.contents(fileName);
-          if (ldrawFile.changedSinceLastWrite(fileName)) {
+  if (! exporting()) {
+      emit progressBarPermInitSig();
+      emit progressPermRangeSig(1, jobs.size());
+      emit progressPermMessageSig("Submodels...");
+    }
+  emit messageSig(true, "Writing submodels to temp directory...");
 
-              upToDate = false;
-              writeToTmp(fileName,content);
-             emit messageSig(true, "Writing submodel to temp directory: " + fileName);
-            }
+  if (jobs.size() == 1) {
+      jobs[0]->run();
+    } else {
+      QThreadPool pool;
+      for (int i = 0; i < jobs.size(); i++) {
+          pool.start(jobs[i]);
         }
+      pool.waitForDone();
     }
+
   if (! exporting()) {
-      emit progressPermSetValueSig(ldrawFile._subFileOrder.size());
+      emit progressPermSetValueSig(jobs.size());
       emit removeProgressPermStatusSig();
     }
-  emit messageSig(true, upToDate ? "No submodels written; temp directory up to date." : "Submodels written to temp directory.");
+
+  tmpFadeColor = doFadeStep ? fadeColor : QString();
+
+  for (int i = 0; i < jobs.size(); i++) {
+      if (! jobs[i]->error.isEmpty()) {
+          QMessageBox::warning(NULL,QMessageBox::tr("LPub3D"),jobs[i]->error);
+        }
+      if (jobs[i]->fade) {
+          tmpFadeLines.insert(jobs[i]->fileName,jobs[i]->faded);
+        }
+      delete jobs[i];
+    }
+
+  QString message = QString("%1 submodel files written to temp directory. %2")
+                            .arg(jobs.size()) .arg(elapsedTime(writeTimer.elapsed()));
+  logTrace() << message;
+  emit messageSig(true, message);
 }
 
 /*
- * Fade writeToTmp content - make fade copies of submodel files.
+ * The fade caches hold lines faded with one colour against one set of
+ * submodel names, so they go when either changes.
  */
-QStringList Gui::fadeSubFile(const QStringList &contents, const QString &color)
+void Gui::checkFadeCache(const QString &fadeColor)
 {
-  QStringList fadeContents;
-
-  if (contents.size() > 0) {
-
-      QString edgeColor = "24";  // Internal Common Material Color (edge)
-      QString fadeColor = color;
-      QStringList argv;
-
-      for (int index = 0; index < contents.size(); index++) {
-
-          QString contentLine = contents[index];
-          split(contentLine, argv);
-          if (argv.size() == 15 && argv[0] == "1") {
-              // set fade colour
-              if (argv[1] != edgeColor){
-                  argv[1] = fadeColor;}
-              // process static colored parts
-              QString fileNameStr = argv[argv.size()-1].toLower();
-              if (FadeStepColorParts::isStaticColorPart(fileNameStr)){
-                  fileNameStr = QDir::toNativeSeparators(fileNameStr.replace(".dat","-fade.dat"));
-                }
-              // process subfile naming
-              if (ldrawFile.isSubmodel(fileNameStr)) {
-                  QString extension = QFileInfo(fileNameStr).suffix().toLower();
-                  bool ldr = extension == "ldr";
-                  bool mpd = extension == "mpd";
-                  bool dat = extension == "dat";
-                  if (ldr) {
-                      fileNameStr = fileNameStr.replace(".ldr","-fade.ldr");
-                    } else if (mpd) {
-                      fileNameStr = fileNameStr.replace(".mpd","-fade.mpd");
-                    } else if (dat) {
-                      fileNameStr = fileNameStr.replace(".dat","-fade.dat");
-                    }
-                }
-              argv[argv.size()-1] = fileNameStr;
-            } else if ((argv.size() == 8  && argv[0] == "2") ||
-                       (argv.size() == 11 && argv[0] == "3") ||
-                       (argv.size() == 14 && argv[0] == "4") ||
-                       (argv.size() == 14 && argv[0] == "5")) {
-              if (argv[1] != edgeColor){
-                  argv[1] = fadeColor;}
+  if (fadeSubmodelsVersion != ldrawFile.contentVersion()) {
+      QSet<QString> submodels;
+      for (int i = 0; i < ldrawFile._subFileOrder.size(); i++) {
+          if (ldrawFile.isSubmodel(ldrawFile._subFileOrder[i])) {
+              submodels << ldrawFile._subFileOrder[i].toLower();
             }
-          contentLine = argv.join(" ");
-          fadeContents  << contentLine;
         }
-    } else {
-      return contents;
+      fadeSubmodelsVersion = ldrawFile.contentVersion();
+      if (submodels != fadeSubmodels) {
+          fadeSubmodels = submodels;
+          fadePrefixes.clear();
+          tmpFadeLines.clear();
+        }
+    }
+
+  if (fadeColor != fadeCacheColor) {
+      fadeCacheColor = fadeColor;
+      fadePrefixes.clear();
+      tmpFadeLines.clear();
     }
-  return fadeContents;
 }
 
 /*
- * Process csiParts list - fade all non-current step-parts.
+ * Process csiParts list - fade all non-current step-parts.  The lines
+ * faded for the submodel's previous step are reused as long as csiParts
+ * still starts with them, so each step only fades what was added since.
  */
 QStringList Gui::fadeStep(const QStringList &csiParts, const int &stepNum,  Where &current) {
 
-  QStringList fadeCsiParts;
   bool    doFadeStep  = (page.meta.LPub.fadeStep.fadeStep.value() || Preferences::enableFadeStep);
 
-  if (csiParts.size() > 0 && stepNum > 1 && doFadeStep) {
+  if (csiParts.size() == 0 || stepNum <= 1 || ! doFadeStep) {
+      ldrawFile.setFadePosition(current.modelName,csiParts.size());
+      return csiParts;
+    }
 
-      QString fadeColor   = LDrawColor::ldColorCode(page.meta.LPub.fadeStep.fadeColor.value());
-      QString edgeColor   = "24";  // Internal Common Material Color (edge)
+  QString fadeColor   = LDrawColor::ldColorCode(page.meta.LPub.fadeStep.fadeColor.value());
+  checkFadeCache(fadeColor);
 
-      int  fadePosition   = ldrawFile.getFadePosition(current.modelName);
-      if (fadePosition == 0 && saveFadePosition > 0)
-        fadePosition = saveFadePosition;
+  int  fadePosition   = ldrawFile.getFadePosition(current.modelName);
+  if (fadePosition == 0 && saveFadePosition > 0)
+    fadePosition = saveFadePosition;
+  fadePosition = qMin(fadePosition, csiParts.size());
 
-      //qDebug() << "Model:" << current.modelName << ", Step:"  << stepNum << ", FadeStep Get Fade Position:" << fadePosition
-      //         << ", CSI Size:" << csiParts.size() << ", Model Size:"  << ldrawFile.size(current.modelName);
-      QStringList argv;
+  //qDebug() << "Model:" << current.modelName << ", Step:"  << stepNum << ", FadeStep Get Fade Position:" << fadePosition
+  //         << ", CSI Size:" << csiParts.size() << ", Model Size:"  << ldrawFile.size(current.modelName);
 
-      for (int index = 0; index < csiParts.size(); index++) {
+  QElapsedTimer timer;
+  timer.start();
 
-          QString csiLine = csiParts[index];
-          if ((index + 1) <= fadePosition) {  // write fade with stuff
-              split(csiLine, argv);
-              if (argv.size() == 15 && argv[0] == "1") {
-                  // update fade colour
-                  if (argv[1] != edgeColor){
-                      argv[1] = fadeColor;}
-                  // process color parts naming
-                  QString fileNameStr = argv[argv.size()-1].toLower();
+  FadePrefix &prefix = fadePrefixes[current.modelName.toLower()];
 
-                  emit messageSig(true, "Do fadeStep for " + fileNameStr);
+  int reused = 0;
+  int common = qMin(fadePosition, prefix.source.size());
+  while (reused < common && prefix.source[reused] == csiParts[reused]) {
+      reused++;
+    }
 
-                  if (FadeStepColorParts::isStaticColorPart(fileNameStr)){
-                      fileNameStr = QDir::toNativeSeparators(fileNameStr.replace(".dat","-fade.dat"));
-                    }
-                  // process subfile naming
-                  if (ldrawFile.isSubmodel(fileNameStr)) {
-                      QString extension = QFileInfo(fileNameStr).suffix().toLower();
-                      bool ldr = extension == "ldr";
-                      bool mpd = extension == "mpd";
-                      bool dat = extension == "dat";
-                      if (ldr) {
-                          fileNameStr = fileNameStr.replace(".ldr","-fade.ldr");
-                        } else if (mpd) {
-                          fileNameStr = fileNameStr.replace(".mpd","-fade.mpd");
-                        } else if (dat) {
-                          fileNameStr = fileNameStr.replace(".dat","-fade.dat");
-                        }
-                    }
-                  argv[argv.size()-1] = fileNameStr;
-                } else if ((argv.size() == 8  && argv[0] == "2") ||
-                           (argv.size() == 11 && argv[0] == "3") ||
-                           (argv.size() == 14 && argv[0] == "4") ||
-                           (argv.size() == 14 && argv[0] == "5")) {
-                  if (argv[1] != edgeColor){
-                      argv[1] = fadeColor;}
-                }
-              csiLine = argv.join(" ");
-            }
-          fadeCsiParts  << csiLine;
-        }
-    } else {
-      ldrawFile.setFadePosition(current.modelName,csiParts.size());
-      return csiParts;
+  QStringList faded = reused == prefix.faded.size() ? prefix.faded : prefix.faded.mid(0,reused);
+  for (int index = reused; index < fadePosition; index++) {
+      faded << fadeLine(csiParts[index], fadeColor, fadeSubmodels);
     }
+
+  prefix.source = fadePosition == csiParts.size() ? csiParts : csiParts.mid(0,fadePosition);
+  prefix.faded  = faded;
+
+  logDebug() << QString("Fade step %1 of %2: %3 lines faded, %4 reused, in %5 microseconds")
+                .arg(stepNum) .arg(current.modelName)
+                .arg(fadePosition - reused) .arg(reused)
+                .arg(timer.nsecsElapsed() / 1000);
+
+  QStringList fadeCsiParts = faded + csiParts.mid(fadePosition);
+
   ldrawFile.setFadePosition(current.modelName,fadeCsiParts.size());
   return fadeCsiParts;
 }